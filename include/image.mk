@@ -10,7 +10,10 @@ include $(INCLUDE_DIR)/prereq.mk
 include $(INCLUDE_DIR)/kernel.mk
 include $(INCLUDE_DIR)/host.mk
 
+# the per-profile sub-make started by Image/Build/Profiles runs in parallel
+ifeq ($(IMAGE_ACTION),)
 .NOTPARALLEL:
+endif
 override MAKEFLAGS=
 override MAKE:=$(SUBMAKE)
 KDIR=$(KERNEL_BUILD_DIR)
@@ -226,6 +229,91 @@ define Image/Checksum
 endef
 
 
+ifneq ($(CONFIG_PKG_BUILD_USE_JOBSERVER),)
+  IMAGE_MAKE_J:=$(if $(MAKE_JOBSERVER),$(MAKE_JOBSERVER) -j)
+else
+  IMAGE_MAKE_J:=-j$(CONFIG_PKG_BUILD_JOBS)
+endif
+
+IMAGE_JOBS?=$(if $(CONFIG_PKG_BUILD_PARALLEL),$(IMAGE_MAKE_J),-j1)
+
+# Per-profile images are built as independent targets of a sub-make, one
+# target per profile and action (buildkernel, initramfs or a filesystem).
+# Every profile gets its own $(KDIR_TMP) and writes its images to a
+# private $(BIN_DIR) below it, so intermediate files of different devices
+# can't clash when they are built in parallel and the cache records only
+# the images the profile produced itself. They are moved to the real
+# $(BIN_DIR) once the profile is done.
+#
+# The outputs of a profile are cached, the key is a hash over the shared
+# inputs of the action (kernel, rootfs and host tools), the expanded recipe
+# and the keys of the actions it depends on. Profiles whose key matches the
+# one recorded on the last run and whose outputs still exist are skipped.
+IMAGE_CACHE_DIR:=$(KDIR)/image-cache
+IMAGE_CACHE_INPUTS ?= $(KDIR)/vmlinux* $(KDIR)/root.$(IMAGE_ACTION)*
+IMAGE_CACHE_DEPENDS ?= buildkernel
+
+# $(1): list of profiles.
+# $(2): action name, e.g. buildkernel, initramfs, squashfs, etc.
+define Image/Build/Profiles
+	$(if $(1),+$(MAKE) $(IMAGE_JOBS) image-profiles \
+		IMAGE_PROFILES="$(1)" IMAGE_ACTION=$(2) $(MAKEOVERRIDES))
+endef
+
+define Image/Cache/Inputs
+$(shell $(SH_FUNC) ( \
+	$(call FIND_L,$(STAGING_DIR_HOST)/bin) -maxdepth 1 -type f | \
+		LC_ALL=C sort | $(XARGS) ls -lnL; \
+	cat /dev/null $(sort $(wildcard $(IMAGE_CACHE_INPUTS))) \
+) | md5s)
+endef
+
+# $(1): profile name.
+define Image/Cache/Key
+$(shell $(SH_FUNC) ( \
+	echo $(IMAGE_CACHE_INPUTS_MD5); \
+	$(foreach action,$(filter-out $(IMAGE_ACTION),$(IMAGE_CACHE_DEPENDS)), \
+		head -n1 $(IMAGE_CACHE_DIR)/$(1).$(action) 2>/dev/null; ) \
+	printf '%s\n' '$(subst ','\'',$(call Image/Build/Profile/$(1),$(IMAGE_ACTION)))' \
+) | md5s)
+endef
+
+# $(1): profile name.
+# $(2): cache key.
+define Image/Cache/Valid
+$(shell f=$(IMAGE_CACHE_DIR)/$(1).$(IMAGE_ACTION); \
+	[ "$$(head -n1 $$f 2>/dev/null)" = "$(2)" ] && \
+	tail -n +2 $$f | while read file; do [ -e "$$file" ] || exit 1; done && \
+	echo y)
+endef
+
+# $(1): profile name.
+define Image/Cache/Rule
+  IMAGE_KEY/$(1):=$$(call Image/Cache/Key,$(1))
+
+  image-profile/$(1): KDIR_TMP=$(KDIR)/tmp/$(1)
+  image-profile/$(1): BIN_DIR=$(KDIR)/tmp/$(1)/bin
+  image-profile/$(1): FORCE
+  ifeq ($$(call Image/Cache/Valid,$(1),$$(IMAGE_KEY/$(1))),y)
+	@echo "$(1): $(IMAGE_ACTION) images are up to date"
+  else
+	@rm -f $(IMAGE_CACHE_DIR)/$(1).$(IMAGE_ACTION)
+	@rm -rf $$(BIN_DIR)
+	@mkdir -p $$(KDIR_TMP) $$(BIN_DIR) $(IMAGE_CACHE_DIR)
+	@touch $(IMAGE_CACHE_DIR)/$(1).$(IMAGE_ACTION).start
+	$$(call Image/Build/Profile/$(1),$(IMAGE_ACTION))
+	@( echo $$(IMAGE_KEY/$(1)); \
+		$(FIND) $$(BIN_DIR) -mindepth 1 -maxdepth 1 -type f | \
+			sed -e 's,^$$(BIN_DIR)/,$(BIN_DIR)/,'; \
+		$(FIND) $$(KDIR_TMP) -maxdepth 1 -type f \
+			-newer $(IMAGE_CACHE_DIR)/$(1).$(IMAGE_ACTION).start \
+	) > $(IMAGE_CACHE_DIR)/$(1).$(IMAGE_ACTION)
+	@$(FIND) $$(BIN_DIR) -mindepth 1 -maxdepth 1 -type f \
+		-exec mv -f {} $(BIN_DIR)/ \;
+	@rm -f $(IMAGE_CACHE_DIR)/$(1).$(IMAGE_ACTION).start
+  endif
+endef
+
 define BuildImage
 
   download:
@@ -281,4 +369,12 @@ define BuildImage
   install-targets:
   clean-targets:
 
+  ifneq ($(IMAGE_ACTION),)
+    IMAGE_CACHE_INPUTS_MD5:=$$(call Image/Cache/Inputs)
+    $$(foreach p,$$(IMAGE_PROFILES),$$(eval $$(call Image/Cache/Rule,$$(p))))
+
+    image-profiles: $$(addprefix image-profile/,$$(IMAGE_PROFILES))
+    .PHONY: image-profiles
+  endif
+
 endef
@@ -0,0 +1,614 @@
+/*
+ * virtual-switch.c: software switch for testing the swconfig API
+ *
+ * Copyright (C) 2014 OpenWrt.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The switch only exists in memory. Like most hardware drivers it keeps
+ * a staged copy of the configuration which is written to the "hardware"
+ * state by apply_config. Every simulated register access can be delayed
+ * to approximate the cost of MDIO/SMI on real chips.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
+#include <linux/switch.h>
+
+#define VSW_MAX_PORTS		32
+#define VSW_MAX_VLANS		4096
+#define VSW_MAX_VID		4094
+#define VSW_MAX_REG_DELAY	10000
+
+/* bytes per simulated packet */
+#define VSW_PKT_SIZE		512
+
+static int ports = 7;
+module_param(ports, int, 0444);
+MODULE_PARM_DESC(ports, "Number of switch ports (1-32)");
+
+static int vlans = VSW_MAX_VLANS;
+module_param(vlans, int, 0444);
+MODULE_PARM_DESC(vlans, "Number of VLAN table entries (1-4096)");
+
+static int cpu_port;
+module_param(cpu_port, int, 0444);
+MODULE_PARM_DESC(cpu_port, "CPU port number");
+
+static int reg_delay;
+module_param(reg_delay, int, 0444);
+MODULE_PARM_DESC(reg_delay, "Delay per register access in microseconds (0-10000)");
+
+enum {
+	VSW_MIB_RXPKT,
+	VSW_MIB_RXBYTE,
+	VSW_MIB_TXPKT,
+	VSW_MIB_TXBYTE,
+	VSW_NUM_MIBS,
+};
+
+static const char *vsw_mib_names[VSW_NUM_MIBS] = {
+	[VSW_MIB_RXPKT] = "RxPackets",
+	[VSW_MIB_RXBYTE] = "RxBytes",
+	[VSW_MIB_TXPKT] = "TxPackets",
+	[VSW_MIB_TXBYTE] = "TxBytes",
+};
+
+struct vsw_vlan {
+	u16 vid;
+	u32 members;
+	u32 tagged;
+};
+
+struct vsw_state {
+	bool vlan;
+	struct vsw_vlan *vlan_table;
+	u16 *pvid;
+};
+
+struct vsw_priv {
+	struct switch_dev dev;
+
+	/* configuration as set through swconfig */
+	struct vsw_state staged;
+	/* configuration last written by apply_config */
+	struct vsw_state hw;
+
+	unsigned int reg_delay;
+	atomic_long_t reg_accesses;
+
+	struct mutex mib_lock;
+	unsigned long mib_time;
+	u64 *mib_stats;
+
+	char buf[2048];
+};
+
+#define to_vsw(_dev) container_of(_dev, struct vsw_priv, dev)
+
+static struct vsw_priv *vsw;
+
+static void
+vsw_reg_access(struct vsw_priv *priv)
+{
+	atomic_long_inc(&priv->reg_accesses);
+
+	if (!priv->reg_delay)
+		return;
+
+	if (priv->reg_delay < 10)
+		udelay(priv->reg_delay);
+	else
+		usleep_range(priv->reg_delay, priv->reg_delay + 1);
+}
+
+static int
+vsw_state_alloc(struct vsw_state *s, int ports, int vlans)
+{
+	s->vlan_table = kcalloc(vlans, sizeof(*s->vlan_table), GFP_KERNEL);
+	s->pvid = kcalloc(ports, sizeof(*s->pvid), GFP_KERNEL);
+	if (!s->vlan_table || !s->pvid)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void
+vsw_state_free(struct vsw_state *s)
+{
+	kfree(s->vlan_table);
+	kfree(s->pvid);
+}
+
+static void
+vsw_state_init(struct vsw_priv *priv, struct vsw_state *s)
+{
+	int i;
+
+	s->vlan = false;
+	memset(s->vlan_table, 0, sizeof(*s->vlan_table) * priv->dev.vlans);
+	memset(s->pvid, 0, sizeof(*s->pvid) * priv->dev.ports);
+	for (i = 0; i < priv->dev.vlans; i++)
+		s->vlan_table[i].vid = i;
+}
+
+/* write the staged configuration to the simulated hardware */
+static void
+vsw_hw_write(struct vsw_priv *priv)
+{
+	struct vsw_state *st = &priv->staged, *hw = &priv->hw;
+	int i;
+
+	/* flush the vlan table, then load all entries in use */
+	vsw_reg_access(priv);
+	for (i = 0; i < priv->dev.vlans; i++) {
+		hw->vlan_table[i] = st->vlan_table[i];
+		if (st->vlan_table[i].members)
+			vsw_reg_access(priv);
+	}
+
+	/* pvid and vlan mode per port */
+	for (i = 0; i < priv->dev.ports; i++) {
+		hw->pvid[i] = st->pvid[i];
+		vsw_reg_access(priv);
+		vsw_reg_access(priv);
+	}
+	hw->vlan = st->vlan;
+}
+
+static void
+vsw_mib_update(struct vsw_priv *priv)
+{
+	unsigned long now = jiffies;
+	u64 pkts;
+	int i;
+
+	/* every port sees a constant amount of traffic per tick */
+	for (i = 0; i < priv->dev.ports; i++) {
+		u64 *mib = &priv->mib_stats[i * VSW_NUM_MIBS];
+
+		pkts = (u64) (now - priv->mib_time) * (i + 1);
+		mib[VSW_MIB_RXPKT] += pkts;
+		mib[VSW_MIB_RXBYTE] += pkts * VSW_PKT_SIZE;
+		mib[VSW_MIB_TXPKT] += pkts;
+		mib[VSW_MIB_TXBYTE] += pkts * VSW_PKT_SIZE;
+	}
+	priv->mib_time = now;
+}
+
+static void
+vsw_mib_fetch_port(struct vsw_priv *priv, int port)
+{
+	int i;
+
+	vsw_mib_update(priv);
+	for (i = 0; i < VSW_NUM_MIBS; i++)
+		vsw_reg_access(priv);
+}
+
+static int
+vsw_set_vlan(struct switch_dev *dev, const struct switch_attr *attr,
+	     struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	priv->staged.vlan = !!val->value.i;
+	return 0;
+}
+
+static int
+vsw_get_vlan(struct switch_dev *dev, const struct switch_attr *attr,
+	     struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	val->value.i = priv->staged.vlan;
+	return 0;
+}
+
+static int
+vsw_set_reg_delay(struct switch_dev *dev, const struct switch_attr *attr,
+		  struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	if (val->value.i < 0 || val->value.i > VSW_MAX_REG_DELAY)
+		return -EINVAL;
+
+	priv->reg_delay = val->value.i;
+	return 0;
+}
+
+static int
+vsw_get_reg_delay(struct switch_dev *dev, const struct switch_attr *attr,
+		  struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	val->value.i = priv->reg_delay;
+	return 0;
+}
+
+static int
+vsw_set_reg_accesses(struct switch_dev *dev, const struct switch_attr *attr,
+		     struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	atomic_long_set(&priv->reg_accesses, val->value.i);
+	return 0;
+}
+
+static int
+vsw_get_reg_accesses(struct switch_dev *dev, const struct switch_attr *attr,
+		     struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	val->value.i = atomic_long_read(&priv->reg_accesses);
+	return 0;
+}
+
+static int
+vsw_set_reset_mibs(struct switch_dev *dev, const struct switch_attr *attr,
+		   struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+	int i;
+
+	mutex_lock(&priv->mib_lock);
+	memset(priv->mib_stats, 0,
+	       sizeof(*priv->mib_stats) * dev->ports * VSW_NUM_MIBS);
+	priv->mib_time = jiffies;
+	for (i = 0; i < dev->ports; i++)
+		vsw_reg_access(priv);
+	mutex_unlock(&priv->mib_lock);
+
+	return 0;
+}
+
+static int
+vsw_get_port_mib(struct switch_dev *dev, const struct switch_attr *attr,
+		 struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+	int port = val->port_vlan;
+	char *buf = priv->buf;
+	u64 *mib;
+	int i, len = 0;
+
+	if (port >= dev->ports)
+		return -EINVAL;
+
+	mutex_lock(&priv->mib_lock);
+	vsw_mib_fetch_port(priv, port);
+
+	len += snprintf(buf + len, sizeof(priv->buf) - len,
+			"Port %d MIB counters\n", port);
+
+	mib = &priv->mib_stats[port * VSW_NUM_MIBS];
+	for (i = 0; i < VSW_NUM_MIBS; i++)
+		len += snprintf(buf + len, sizeof(priv->buf) - len,
+				"%-12s: %llu\n", vsw_mib_names[i], mib[i]);
+	mutex_unlock(&priv->mib_lock);
+
+	val->value.s = buf;
+	val->len = len;
+
+	return 0;
+}
+
+static int
+vsw_set_vid(struct switch_dev *dev, const struct switch_attr *attr,
+	    struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	if (val->port_vlan >= dev->vlans)
+		return -EINVAL;
+
+	if (val->value.i > VSW_MAX_VID)
+		return -EINVAL;
+
+	priv->staged.vlan_table[val->port_vlan].vid = val->value.i;
+	return 0;
+}
+
+static int
+vsw_get_vid(struct switch_dev *dev, const struct switch_attr *attr,
+	    struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	if (val->port_vlan >= dev->vlans)
+		return -EINVAL;
+
+	val->value.i = priv->staged.vlan_table[val->port_vlan].vid;
+	return 0;
+}
+
+static int
+vsw_get_vlan_ports(struct switch_dev *dev, struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+	struct vsw_vlan *v = &priv->staged.vlan_table[val->port_vlan];
+	int i;
+
+	val->len = 0;
+	for (i = 0; i < dev->ports; i++) {
+		struct switch_port *p;
+
+		if (!(v->members & BIT(i)))
+			continue;
+
+		p = &val->value.ports[val->len++];
+		p->id = i;
+		if (v->tagged & BIT(i))
+			p->flags = BIT(SWITCH_PORT_FLAG_TAGGED);
+		else
+			p->flags = 0;
+	}
+
+	return 0;
+}
+
+static int
+vsw_set_vlan_ports(struct switch_dev *dev, struct switch_val *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+	struct vsw_vlan *v = &priv->staged.vlan_table[val->port_vlan];
+	int i;
+
+	v->members = 0;
+	v->tagged = 0;
+	for (i = 0; i < val->len; i++) {
+		struct switch_port *p = &val->value.ports[i];
+
+		v->members |= BIT(p->id);
+		if (p->flags & BIT(SWITCH_PORT_FLAG_TAGGED))
+			v->tagged |= BIT(p->id);
+	}
+
+	return 0;
+}
+
+static int
+vsw_get_pvid(struct switch_dev *dev, int port, int *val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	*val = priv->staged.pvid[port];
+	return 0;
+}
+
+static int
+vsw_set_pvid(struct switch_dev *dev, int port, int val)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	if (val < 0 || val >= dev->vlans)
+		return -EINVAL;
+
+	priv->staged.pvid[port] = val;
+	return 0;
+}
+
+static int
+vsw_get_port_link(struct switch_dev *dev, int port,
+		  struct switch_port_link *link)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	vsw_reg_access(priv);
+
+	link->link = true;
+	link->duplex = true;
+	link->aneg = true;
+	link->speed = SWITCH_PORT_SPEED_1000;
+
+	return 0;
+}
+
+static int
+vsw_get_port_stats(struct switch_dev *dev, int port,
+		   struct switch_port_stats *stats)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+	u64 *mib;
+
+	mutex_lock(&priv->mib_lock);
+	vsw_mib_fetch_port(priv, port);
+	mib = &priv->mib_stats[port * VSW_NUM_MIBS];
+	stats->tx_bytes = mib[VSW_MIB_TXBYTE];
+	stats->rx_bytes = mib[VSW_MIB_RXBYTE];
+	mutex_unlock(&priv->mib_lock);
+
+	return 0;
+}
+
+static int
+vsw_apply_config(struct switch_dev *dev)
+{
+	vsw_hw_write(to_vsw(dev));
+	return 0;
+}
+
+static int
+vsw_reset_switch(struct switch_dev *dev)
+{
+	struct vsw_priv *priv = to_vsw(dev);
+
+	vsw_state_init(priv, &priv->staged);
+	vsw_hw_write(priv);
+
+	return 0;
+}
+
+static struct switch_attr vsw_attr_globals[] = {
+	{
+		.type = SWITCH_TYPE_INT,
+		.name = "enable_vlan",
+		.description = "Enable VLAN mode",
+		.set = vsw_set_vlan,
+		.get = vsw_get_vlan,
+		.max = 1,
+	},
+	{
+		.type = SWITCH_TYPE_NOVAL,
+		.name = "reset_mibs",
+		.description = "Reset all MIB counters",
+		.set = vsw_set_reset_mibs,
+	},
+	{
+		.type = SWITCH_TYPE_INT,
+		.name = "reg_delay",
+		.description = "Delay per register access in microseconds",
+		.set = vsw_set_reg_delay,
+		.get = vsw_get_reg_delay,
+		.max = VSW_MAX_REG_DELAY,
+	},
+	{
+		.type = SWITCH_TYPE_INT,
+		.name = "reg_accesses",
+		.description = "Number of simulated register accesses",
+		.set = vsw_set_reg_accesses,
+		.get = vsw_get_reg_accesses,
+	},
+};
+
+static struct switch_attr vsw_attr_port[] = {
+	{
+		.type = SWITCH_TYPE_STRING,
+		.name = "mib",
+		.description = "Get port's MIB counters",
+		.set = NULL,
+		.get = vsw_get_port_mib,
+	},
+};
+
+static struct switch_attr vsw_attr_vlan[] = {
+	{
+		.type = SWITCH_TYPE_INT,
+		.name = "vid",
+		.description = "VLAN ID (0-4094)",
+		.set = vsw_set_vid,
+		.get = vsw_get_vid,
+		.max = VSW_MAX_VID,
+	},
+};
+
+static const struct switch_dev_ops vsw_ops = {
+	.attr_global = {
+		.attr = vsw_attr_globals,
+		.n_attr = ARRAY_SIZE(vsw_attr_globals),
+	},
+	.attr_port = {
+		.attr = vsw_attr_port,
+		.n_attr = ARRAY_SIZE(vsw_attr_port),
+	},
+	.attr_vlan = {
+		.attr = vsw_attr_vlan,
+		.n_attr = ARRAY_SIZE(vsw_attr_vlan),
+	},
+	.get_vlan_ports = vsw_get_vlan_ports,
+	.set_vlan_ports = vsw_set_vlan_ports,
+	.get_port_pvid = vsw_get_pvid,
+	.set_port_pvid = vsw_set_pvid,
+	.apply_config = vsw_apply_config,
+	.reset_switch = vsw_reset_switch,
+	.get_port_link = vsw_get_port_link,
+	.get_port_stats = vsw_get_port_stats,
+};
+
+static void
+vsw_free(struct vsw_priv *priv)
+{
+	vsw_state_free(&priv->staged);
+	vsw_state_free(&priv->hw);
+	kfree(priv->mib_stats);
+	kfree(priv);
+}
+
+static int __init
+vsw_init(void)
+{
+	struct vsw_priv *priv;
+	int ret;
+
+	if (ports < 1 || ports > VSW_MAX_PORTS ||
+	    vlans < 1 || vlans > VSW_MAX_VLANS ||
+	    cpu_port < 0 || cpu_port >= ports || reg_delay < 0 ||
+	    reg_delay > VSW_MAX_REG_DELAY) {
+		pr_err("virtual-switch: invalid parameters\n");
+		return -EINVAL;
+	}
+
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	ret = vsw_state_alloc(&priv->staged, ports, vlans);
+	if (!ret)
+		ret = vsw_state_alloc(&priv->hw, ports, vlans);
+	priv->mib_stats = kcalloc(ports * VSW_NUM_MIBS,
+				  sizeof(*priv->mib_stats), GFP_KERNEL);
+	if (ret || !priv->mib_stats) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	mutex_init(&priv->mib_lock);
+	priv->mib_time = jiffies;
+	priv->reg_delay = reg_delay;
+	atomic_long_set(&priv->reg_accesses, 0);
+
+	priv->dev.name = "Virtual switch";
+	priv->dev.alias = "virtual";
+	priv->dev.ops = &vsw_ops;
+	priv->dev.ports = ports;
+	priv->dev.vlans = vlans;
+	priv->dev.cpu_port = cpu_port;
+
+	vsw_state_init(priv, &priv->staged);
+	vsw_state_init(priv, &priv->hw);
+
+	ret = register_switch(&priv->dev, NULL);
+	if (ret)
+		goto err_free;
+
+	pr_info("%s: %s with %d ports and %d vlans\n",
+		priv->dev.devname, priv->dev.name, ports, vlans);
+
+	vsw = priv;
+	return 0;
+
+err_free:
+	vsw_free(priv);
+	return ret;
+}
+
+static void __exit
+vsw_exit(void)
+{
+	unregister_switch(&vsw->dev);
+	vsw_free(vsw);
+}
+
+module_init(vsw_init);
+module_exit(vsw_exit);
+
+MODULE_DESCRIPTION("Software switch for testing the swconfig API");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,165 @@
+/*
+ * cache-bench.c	Host benchmark of the cache hash indices
+ *
+ * Emulates the lookups of a cache resync, one nl_cache_search() and
+ * replacement per dumped object, and of name lookups through
+ * nl_cache_search_name() on caches of 1k, 10k and 100k generic netlink
+ * families. Each runs once with the hash indices and once with the
+ * list walk they replace. The list walk is quadratic, it is timed on
+ * a sample of SAMPLE objects and scaled up to the full pass.
+ *
+ * Build and run on the build host with: make cache-bench && ./cache-bench
+ *
+ *	This library is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU Lesser General Public
+ *	License as published by the Free Software Foundation version 2.1
+ *	of the License.
+ */
+
+#include <netlink-local.h>
+#include <netlink/cache-api.h>
+#include <netlink/genl/family.h>
+#include <sys/time.h>
+
+#define SAMPLE	2000
+
+extern struct nl_object_ops genl_family_ops;
+
+static struct nl_object_ops list_ops;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static struct genl_family *family(struct nl_object_ops *ops, int id)
+{
+	struct genl_family *fam;
+	char name[GENL_NAMSIZ];
+
+	fam = (struct genl_family *) nl_object_alloc(ops);
+	if (!fam)
+		exit(1);
+
+	snprintf(name, sizeof(name), "fam%d", id);
+	genl_family_set_id(fam, id);
+	genl_family_set_name(fam, name);
+
+	return fam;
+}
+
+static struct nl_cache *fill(struct nl_cache_ops *ops, int n)
+{
+	struct nl_cache *cache;
+	struct genl_family *fam;
+	int i;
+
+	cache = nl_cache_alloc(ops);
+	if (!cache)
+		exit(1);
+
+	for (i = 0; i < n; i++) {
+		fam = family(ops->co_obj_ops, i);
+		if (nl_cache_add(cache, (struct nl_object *) fam) < 0)
+			exit(1);
+		genl_family_put(fam);
+	}
+
+	return cache;
+}
+
+/* what cache_include() does for every NL_ACT_NEW object of a resync */
+static double resync(struct nl_cache *cache, int n, int count)
+{
+	struct nl_object *obj, *old;
+	double start = now();
+	int i;
+
+	for (i = 0; i < count; i++) {
+		obj = (struct nl_object *)
+			family(cache->c_ops->co_obj_ops, rand() % n);
+
+		old = nl_cache_search(cache, obj);
+		if (!old)
+			exit(1);
+
+		nl_cache_remove(old);
+		nl_object_put(old);
+		nl_cache_add(cache, obj);
+		nl_object_put(obj);
+	}
+
+	return now() - start;
+}
+
+static double by_name(struct nl_cache *cache, int n, int count)
+{
+	struct genl_family *needle, *fam;
+	double start = now();
+	int i;
+
+	needle = family(cache->c_ops->co_obj_ops, 0);
+	needle->ce_mask = FAMILY_ATTR_NAME;
+
+	for (i = 0; i < count; i++) {
+		snprintf(needle->gf_name, GENL_NAMSIZ, "fam%d", rand() % n);
+
+		fam = (struct genl_family *) nl_cache_search_name(cache,
+				(struct nl_object *) needle);
+		if (!fam)
+			exit(1);
+
+		genl_family_put(fam);
+	}
+
+	genl_family_put(needle);
+
+	return now() - start;
+}
+
+static void bench(int n)
+{
+	struct nl_cache_ops hash_cache_ops = {
+		.co_name	= "bench/hash",
+		.co_obj_ops	= &genl_family_ops,
+	};
+	struct nl_cache_ops list_cache_ops = {
+		.co_name	= "bench/list",
+		.co_obj_ops	= &list_ops,
+	};
+	struct nl_cache *hash, *list;
+	int sample = n < SAMPLE ? n : SAMPLE;
+	double scale = (double) n / sample;
+
+	hash = fill(&hash_cache_ops, n);
+	list = fill(&list_cache_ops, n);
+
+	printf("%7d %12.2f %12.2f %12.2f %12.2f\n", n,
+	       resync(hash, n, n) * 1e3,
+	       resync(list, n, sample) * scale * 1e3,
+	       by_name(hash, n, n) * 1e3,
+	       by_name(list, n, sample) * scale * 1e3);
+
+	nl_cache_free(hash);
+	nl_cache_free(list);
+}
+
+int main(int argc, char **argv)
+{
+	/* same object type, without the hash indices */
+	list_ops = genl_family_ops;
+	list_ops.oo_keygen = NULL;
+	list_ops.oo_name_keygen = NULL;
+
+	srand(1);
+
+	printf("objects  resync hash  resync list    name hash    name list  (ms)\n");
+	bench(1000);
+	bench(10000);
+	bench(100000);
+
+	return 0;
+}
@@ -161,6 +161,135 @@ struct nl_object *nl_cache_get_prev(struct nl_object *obj)
 
 /** @} */
 
+/** @cond SKIP */
+#define CACHE_HASH_MIN	16
+
+/*
+ * Hash indices over the cached objects, one over the identity
+ * attributes (oo_id_attrs, oo_keygen) and one over the name attributes
+ * (oo_name_attrs, oo_name_keygen) for object types providing them.
+ * Objects lacking any of the attributes of an index never match a
+ * search through it and are left out of it.
+ */
+static int cache_hash_indexed(struct nl_object *obj, int idx)
+{
+	struct nl_object_ops *ops = obj->ce_ops;
+	uint32_t attrs;
+
+	if (idx == NL_HASH_NAME) {
+		if (!ops->oo_name_keygen)
+			return 0;
+		attrs = ops->oo_name_attrs;
+	} else {
+		if (!ops->oo_keygen)
+			return 0;
+		attrs = ops->oo_id_attrs;
+	}
+
+	return attrs && (obj->ce_mask & attrs) == attrs;
+}
+
+static struct nl_object **cache_hash_bucket(struct nl_cache *cache,
+					    struct nl_object *obj, int idx)
+{
+	struct nl_object_ops *ops = obj->ce_ops;
+	uint32_t key;
+
+	if (idx == NL_HASH_NAME)
+		key = ops->oo_name_keygen(obj);
+	else
+		key = ops->oo_keygen(obj);
+
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+
+	return &cache->c_hash[idx][key & (cache->c_hash_size - 1)];
+}
+
+static void cache_hash_insert(struct nl_cache *cache, struct nl_object *obj)
+{
+	struct nl_object **bucket;
+	int idx;
+
+	for (idx = 0; idx < NL_HASH_MAX; idx++) {
+		if (!cache_hash_indexed(obj, idx))
+			continue;
+
+		bucket = cache_hash_bucket(cache, obj, idx);
+		obj->ce_hnext[idx] = *bucket;
+		*bucket = obj;
+	}
+}
+
+static void cache_hash_unlink(struct nl_cache *cache, struct nl_object *obj)
+{
+	struct nl_object **pos;
+	int idx;
+
+	for (idx = 0; idx < NL_HASH_MAX; idx++) {
+		if (!cache_hash_indexed(obj, idx))
+			continue;
+
+		pos = cache_hash_bucket(cache, obj, idx);
+		while (*pos && *pos != obj)
+			pos = &(*pos)->ce_hnext[idx];
+
+		if (*pos)
+			*pos = obj->ce_hnext[idx];
+
+		obj->ce_hnext[idx] = NULL;
+	}
+}
+
+static void cache_hash_free(struct nl_cache *cache)
+{
+	int idx;
+
+	for (idx = 0; idx < NL_HASH_MAX; idx++) {
+		free(cache->c_hash[idx]);
+		cache->c_hash[idx] = NULL;
+	}
+	cache->c_hash_size = 0;
+}
+
+/*
+ * Double the indices and rebuild them from the item list. Without
+ * memory the indices are dropped and lookups fall back to walking the
+ * list.
+ */
+static void cache_hash_resize(struct nl_cache *cache)
+{
+	struct nl_object **hash[NL_HASH_MAX], *obj;
+	int size = cache->c_hash_size ? cache->c_hash_size * 2 : CACHE_HASH_MIN;
+	int idx;
+
+	for (idx = 0; idx < NL_HASH_MAX; idx++) {
+		hash[idx] = calloc(size, sizeof(*hash[idx]));
+		if (!hash[idx]) {
+			while (idx-- > 0)
+				free(hash[idx]);
+			cache_hash_free(cache);
+			return;
+		}
+	}
+
+	cache_hash_free(cache);
+	for (idx = 0; idx < NL_HASH_MAX; idx++)
+		cache->c_hash[idx] = hash[idx];
+	cache->c_hash_size = size;
+
+	nl_list_for_each_entry(obj, &cache->c_items, ce_list)
+		cache_hash_insert(cache, obj);
+}
+
+static int cache_hash_any(struct nl_object *obj)
+{
+	return cache_hash_indexed(obj, NL_HASH_ID) ||
+	       cache_hash_indexed(obj, NL_HASH_NAME);
+}
+/** @endcond */
+
 /**
  * @name Cache Creation/Deletion
  * @{
@@ -273,6 +402,9 @@ void nl_cache_clear(struct nl_cache *cache)
 
 	NL_DBG(1, "Clearing cache %p <%s>...\n", cache, nl_cache_name(cache));
 
+	/* Everything goes, no need to unlink objects from the index */
+	cache_hash_free(cache);
+
 	nl_list_for_each_entry_safe(obj, tmp, &cache->c_items, ce_list)
 		nl_cache_remove(obj);
 }
@@ -309,6 +441,13 @@ static int __cache_add(struct nl_cache *cache, struct nl_object *obj)
 	nl_list_add_tail(&obj->ce_list, &cache->c_items);
 	cache->c_nitems++;
 
+	if (cache_hash_any(obj)) {
+		if (cache->c_nitems > cache->c_hash_size)
+			cache_hash_resize(cache);
+		else
+			cache_hash_insert(cache, obj);
+	}
+
 	NL_DBG(1, "Added %p to cache %p <%s>.\n",
 	       obj, cache, nl_cache_name(cache));
 
@@ -388,6 +527,9 @@ void nl_cache_remove(struct nl_object *obj)
 	if (cache == NULL)
 		return;
 
+	if (cache->c_hash_size)
+		cache_hash_unlink(cache, obj);
+
 	nl_list_del(&obj->ce_list);
 	obj->ce_cache = NULL;
 	nl_object_put(obj);
@@ -397,14 +539,14 @@ void nl_cache_remove(struct nl_object *obj)
 	       obj, cache, nl_cache_name(cache));
 }
 
-#ifdef disabled
 /**
  * Search for an object in a cache
  * @arg cache		Cache to search in.
  * @arg needle		Object to look for.
  *
- * Iterates over the cache and looks for an object with identical
- * identifiers as the needle.
+ * Looks for an object with identical identifiers as the needle. Uses
+ * the hash index of the cache if the object type provides oo_keygen,
+ * otherwise iterates over the cache.
  *
  * @return Reference to object or NULL if not found.
  * @note The returned object must be returned via nl_object_put().
@@ -414,6 +556,18 @@ struct nl_object *nl_cache_search(struct nl_cache *cache,
 {
 	struct nl_object *obj;
 
+	if (cache->c_hash_size && cache_hash_indexed(needle, NL_HASH_ID)) {
+		for (obj = *cache_hash_bucket(cache, needle, NL_HASH_ID); obj;
+		     obj = obj->ce_hnext[NL_HASH_ID]) {
+			if (nl_object_identical(obj, needle)) {
+				nl_object_get(obj);
+				return obj;
+			}
+		}
+
+		return NULL;
+	}
+
 	nl_list_for_each_entry(obj, &cache->c_items, ce_list) {
 		if (nl_object_identical(obj, needle)) {
 			nl_object_get(obj);
@@ -423,7 +577,61 @@ struct nl_object *nl_cache_search(struct nl_cache *cache,
 
 	return NULL;
 }
-#endif
+
+/** @cond SKIP */
+static int cache_name_identical(struct nl_object *a, struct nl_object *b)
+{
+	struct nl_object_ops *ops = a->ce_ops;
+	uint32_t attrs = ops->oo_name_attrs;
+
+	if (ops != b->ce_ops || !attrs || !ops->oo_compare)
+		return 0;
+
+	if ((a->ce_mask & attrs) != attrs || (b->ce_mask & attrs) != attrs)
+		return 0;
+
+	return !ops->oo_compare(a, b, attrs, 0);
+}
+/** @endcond */
+
+/**
+ * Search for an object in a cache by name
+ * @arg cache		Cache to search in.
+ * @arg needle		Object to look for.
+ *
+ * Looks for an object with the same name attributes (oo_name_attrs)
+ * as the needle. Uses the name hash index of the cache if the object
+ * type provides oo_name_keygen, otherwise iterates over the cache.
+ *
+ * @return Reference to object or NULL if not found.
+ * @note The returned object must be returned via nl_object_put().
+ */
+struct nl_object *nl_cache_search_name(struct nl_cache *cache,
+				       struct nl_object *needle)
+{
+	struct nl_object *obj;
+
+	if (cache->c_hash_size && cache_hash_indexed(needle, NL_HASH_NAME)) {
+		for (obj = *cache_hash_bucket(cache, needle, NL_HASH_NAME); obj;
+		     obj = obj->ce_hnext[NL_HASH_NAME]) {
+			if (cache_name_identical(obj, needle)) {
+				nl_object_get(obj);
+				return obj;
+			}
+		}
+
+		return NULL;
+	}
+
+	nl_list_for_each_entry(obj, &cache->c_items, ce_list) {
+		if (cache_name_identical(obj, needle)) {
+			nl_object_get(obj);
+			return obj;
+		}
+	}
+
+	return NULL;
+}
 
 /** @} */
 
@@ -29,6 +29,7 @@
 #define CTRL_VERSION		0x0001
 
 static struct nl_cache_ops genl_ctrl_ops;
+extern struct nl_object_ops genl_family_ops;
 /** @endcond */
 
 static int ctrl_request_update(struct nl_cache *c, struct nl_sock *h)
@@ -157,19 +158,17 @@ int genl_ctrl_alloc_cache(struct nl_sock *sock, struct nl_cache **result)
  */
 struct genl_family *genl_ctrl_search(struct nl_cache *cache, int id)
 {
-	struct genl_family *fam;
+	struct genl_family needle = {
+		.ce_ops = &genl_family_ops,
+		.ce_mask = FAMILY_ATTR_ID,
+		.gf_id = id,
+	};
 
 	if (cache->c_ops != &genl_ctrl_ops)
 		BUG();
 
-	nl_list_for_each_entry(fam, &cache->c_items, ce_list) {
-		if (fam->gf_id == id) {
-			nl_object_get((struct nl_object *) fam);
-			return fam;
-		}
-	}
-
-	return NULL;
+	return (struct genl_family *)
+		nl_cache_search(cache, (struct nl_object *) &needle);
 }
 
 /**
@@ -192,19 +191,18 @@ struct genl_family *genl_ctrl_search(struct nl_cache *cache, int id)
 struct genl_family *genl_ctrl_search_by_name(struct nl_cache *cache,
 					    const char *name)
 {
-	struct genl_family *fam;
+	struct genl_family needle = {
+		.ce_ops = &genl_family_ops,
+		.ce_mask = FAMILY_ATTR_NAME,
+	};
 
 	if (cache->c_ops != &genl_ctrl_ops)
 		BUG();
 
-	nl_list_for_each_entry(fam, &cache->c_items, ce_list) {
-		if (!strcmp(name, fam->gf_name)) {
-			nl_object_get((struct nl_object *) fam);
-			return fam;
-		}
-	}
+	strncpy(needle.gf_name, name, GENL_NAMSIZ - 1);
 
-	return NULL;
+	return (struct genl_family *)
+		nl_cache_search_name(cache, (struct nl_object *) &needle);
 }
 
 /** @} */
@@ -275,10 +273,6 @@ static struct genl_ops genl_ops = {
 	.o_ncmds		= ARRAY_SIZE(genl_cmds),
 };
 
-/** @cond SKIP */
-extern struct nl_object_ops genl_family_ops;
-/** @endcond */
-
 static struct nl_cache_ops genl_ctrl_ops = {
 	.co_name		= "genl/family",
 	.co_hdrsize		= GENL_HDRSIZE(0),
@@ -83,6 +83,25 @@ static int family_compare(struct nl_object *_a, struct nl_object *_b,
 	return diff;
 }
 
+static uint32_t family_keygen(struct nl_object *_obj)
+{
+	struct genl_family *family = (struct genl_family *) _obj;
+
+	return family->gf_id;
+}
+
+static uint32_t family_name_keygen(struct nl_object *_obj)
+{
+	struct genl_family *family = (struct genl_family *) _obj;
+	const unsigned char *c;
+	uint32_t key = 2166136261U;
+
+	for (c = (const unsigned char *) family->gf_name; *c; c++)
+		key = (key ^ *c) * 16777619U;
+
+	return key;
+}
+
 
 /**
  * @name Family Object
@@ -130,6 +149,9 @@ struct nl_object_ops genl_family_ops = {
 	.oo_clone		= family_clone,
 	.oo_compare		= family_compare,
 	.oo_id_attrs		= FAMILY_ATTR_ID,
+	.oo_keygen		= family_keygen,
+	.oo_name_attrs		= FAMILY_ATTR_NAME,
+	.oo_name_keygen		= family_name_keygen,
 };
 /** @endcond */
 
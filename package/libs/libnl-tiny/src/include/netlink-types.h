@@ -22,6 +22,8 @@ struct nl_cache
 {
 	struct nl_list_head	c_items;
 	int			c_nitems;
+	struct nl_object **	c_hash[NL_HASH_MAX];
+	int			c_hash_size;
 	int                     c_iarg1;
 	int                     c_iarg2;
 	struct nl_cache_ops *   c_ops;
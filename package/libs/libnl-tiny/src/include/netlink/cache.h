@@ -65,6 +65,10 @@ extern int			nl_cache_include(struct nl_cache *,
 						 change_func_t);
 
 /* General */
+extern struct nl_object *	nl_cache_search(struct nl_cache *,
+						struct nl_object *);
+extern struct nl_object *	nl_cache_search_name(struct nl_cache *,
+						     struct nl_object *);
 extern int			nl_cache_is_empty(struct nl_cache *);
 extern void			nl_cache_mark_all(struct nl_cache *);
 
@@ -42,6 +42,7 @@ struct nla_policy;
 #define NL_AUTO_SEQ	0
 
 #define NL_MSG_CRED_PRESENT 1
+#define NL_MSG_BORROWED 2
 
 struct nl_msg
 {
@@ -175,6 +175,13 @@ extern "C" {
  * @{
  */
 
+/** @cond SKIP */
+/* Hash indices kept by caches, see oo_keygen and oo_name_keygen */
+#define NL_HASH_ID	0
+#define NL_HASH_NAME	1
+#define NL_HASH_MAX	2
+/** @endcond */
+
 /**
  * Common Object Header
  *
@@ -188,7 +195,8 @@ extern "C" {
 	struct nl_list_head	ce_list;	\
 	int			ce_msgtype;	\
 	int			ce_flags;	\
-	uint32_t		ce_mask;
+	uint32_t		ce_mask;	\
+	struct nl_object *	ce_hnext[NL_HASH_MAX];
 
 /**
  * Return true if attribute is available in both objects
@@ -263,6 +271,28 @@ struct nl_object_ops
 	/* List of attributes needed to uniquely identify the object */
 	uint32_t	oo_id_attrs;
 
+	/**
+	 * Hash key generator
+	 *
+	 * Optional. Returns a hash over the attributes listed in
+	 * oo_id_attrs, objects which are identical must produce the
+	 * same key. Caches of objects providing it keep a hash index
+	 * for nl_cache_search().
+	 */
+	uint32_t (*oo_keygen)(struct nl_object *);
+
+	/* List of attributes naming the object, see oo_name_keygen */
+	uint32_t	oo_name_attrs;
+
+	/**
+	 * Name hash key generator
+	 *
+	 * Optional. Returns a hash over the attributes listed in
+	 * oo_name_attrs. Caches of objects providing it keep a second
+	 * hash index for nl_cache_search_name().
+	 */
+	uint32_t (*oo_name_keygen)(struct nl_object *);
+
 	/**
 	 * Constructor function
 	 *
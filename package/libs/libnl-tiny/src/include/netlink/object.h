@@ -38,6 +38,9 @@ extern struct nl_object *	nl_object_alloc(struct nl_object_ops *);
 extern void			nl_object_free(struct nl_object *);
 extern struct nl_object *	nl_object_clone(struct nl_object *obj);
 
+extern int			nl_object_identical(struct nl_object *,
+						    struct nl_object *);
+
 #ifdef disabled
 
 extern int			nl_object_alloc_name(const char *,
@@ -49,8 +52,6 @@ extern uint32_t			nl_object_diff(struct nl_object *,
 					       struct nl_object *);
 extern int			nl_object_match_filter(struct nl_object *,
 						       struct nl_object *);
-extern int			nl_object_identical(struct nl_object *,
-						    struct nl_object *);
 extern char *			nl_object_attrs2str(struct nl_object *,
 						    uint32_t attrs, char *buf,
 						    size_t);
@@ -36,6 +36,8 @@ struct nl_sock
 	unsigned int		s_seq_expect;
 	int			s_flags;
 	struct nl_cb *		s_cb;
+	unsigned char *		s_rxbuf;
+	size_t			s_rxbuf_size;
 };
 
 
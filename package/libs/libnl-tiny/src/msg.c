@@ -514,7 +514,8 @@ void nlmsg_free(struct nl_msg *msg)
 		BUG();
 
 	if (msg->nm_refcnt <= 0) {
-		free(msg->nm_nlh);
+		if (!(msg->nm_flags & NL_MSG_BORROWED))
+			free(msg->nm_nlh);
 		free(msg);
 		NL_DBG(2, "msg %p: Freed\n", msg);
 	}
@@ -356,6 +356,146 @@ errout:
  * @{
  */
 
+/*
+ * Initial size of the receive buffer, large enough for the biggest
+ * chunk the kernel puts into a single dump message.
+ */
+#define NL_RXBUF_MIN	32768
+
+/*
+ * Make sure the socket's receive buffer can hold at least \c len octets.
+ * The buffer is kept across calls and only ever grows, so it is always
+ * as large as the biggest message seen so far.
+ */
+static int nl_rxbuf_reserve(struct nl_sock *sk, size_t len)
+{
+	static int page_size = 0;
+	unsigned char *buf;
+	size_t size;
+
+	if (page_size == 0)
+		page_size = getpagesize();
+
+	if (sk->s_rxbuf && sk->s_rxbuf_size >= len)
+		return 0;
+
+	size = sk->s_rxbuf_size ? sk->s_rxbuf_size :
+		(page_size > NL_RXBUF_MIN ? page_size : NL_RXBUF_MIN);
+	while (size < len)
+		size *= 2;
+
+	buf = realloc(sk->s_rxbuf, size);
+	if (!buf)
+		return -NLE_NOMEM;
+
+	sk->s_rxbuf = buf;
+	sk->s_rxbuf_size = size;
+
+	return 0;
+}
+
+static int nl_recvmsg_retry(struct nl_sock *sk, struct msghdr *msg, int flags)
+{
+	int n;
+
+retry:
+	n = recvmsg(sk->s_fd, msg, flags);
+	if (n < 0) {
+		if (errno == EINTR) {
+			NL_DBG(3, "recvmsg() returned EINTR, retrying\n");
+			goto retry;
+		} else if (errno == EAGAIN) {
+			NL_DBG(3, "recvmsg() returned EAGAIN, aborting\n");
+			return 0;
+		}
+
+		return -nl_syserr2nlerr(errno);
+	}
+
+	return n;
+}
+
+/*
+ * Receive a single message into the receive buffer of the socket.
+ * \c *buf is pointed at the buffer, which stays owned by the socket and
+ * is only valid until the next receive on it.
+ *
+ * The buffer starts at NL_RXBUF_MIN and is read into directly, so a
+ * single recvmsg() is enough. With NL_MSG_PEEK set, the pending message
+ * is probed with MSG_PEEK and MSG_TRUNC and a zero length iovec first,
+ * so the buffer is sized before the copying read. Without it, a message
+ * that did not fit grows the buffer to its size and -NLE_MSG_TRUNC is
+ * returned.
+ */
+static int __nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
+		     unsigned char **buf, struct ucred *creds, int *has_creds)
+{
+	int n, err;
+	char cbuf[CMSG_SPACE(sizeof(struct ucred))];
+	struct iovec iov;
+	struct msghdr msg = {
+		.msg_name = (void *) nla,
+		.msg_namelen = sizeof(struct sockaddr_nl),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = NULL,
+		.msg_controllen = 0,
+		.msg_flags = 0,
+	};
+	struct cmsghdr *cmsg;
+
+	*has_creds = 0;
+
+	if (sk->s_flags & NL_MSG_PEEK) {
+		iov.iov_base = NULL;
+		iov.iov_len = 0;
+
+		n = nl_recvmsg_retry(sk, &msg, MSG_PEEK | MSG_TRUNC);
+		if (n <= 0)
+			return n;
+	} else
+		n = 0;
+
+	err = nl_rxbuf_reserve(sk, n);
+	if (err < 0)
+		return err;
+
+	iov.iov_base = sk->s_rxbuf;
+	iov.iov_len = sk->s_rxbuf_size;
+	msg.msg_namelen = sizeof(struct sockaddr_nl);
+	msg.msg_flags = 0;
+
+	if (sk->s_flags & NL_SOCK_PASSCRED) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+	}
+
+	n = nl_recvmsg_retry(sk, &msg, MSG_TRUNC);
+	if (n <= 0)
+		return n;
+
+	if (iov.iov_len < n || msg.msg_flags & MSG_TRUNC) {
+		NL_DBG(3, "recvmsg() truncated %d byte message\n", n);
+		nl_rxbuf_reserve(sk, n);
+		return -NLE_MSG_TRUNC;
+	}
+
+	if (msg.msg_namelen != sizeof(struct sockaddr_nl))
+		return -NLE_NOADDR;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_CREDENTIALS) {
+			memcpy(creds, CMSG_DATA(cmsg), sizeof(struct ucred));
+			*has_creds = 1;
+			break;
+		}
+	}
+
+	*buf = sk->s_rxbuf;
+	return n;
+}
+
 /**
  * Receive data from netlink socket
  * @arg sk		Netlink socket.
@@ -378,92 +518,87 @@ errout:
 int nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
 	    unsigned char **buf, struct ucred **creds)
 {
-	int n;
-	int flags = 0;
-	static int page_size = 0;
-	struct iovec iov;
-	struct msghdr msg = {
-		.msg_name = (void *) nla,
-		.msg_namelen = sizeof(struct sockaddr_nl),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
-		.msg_control = NULL,
-		.msg_controllen = 0,
-		.msg_flags = 0,
-	};
-	struct cmsghdr *cmsg;
+	int n, has_creds;
+	unsigned char *data;
+	struct ucred cred;
 
-	if (sk->s_flags & NL_MSG_PEEK)
-		flags |= MSG_PEEK;
+	n = __nl_recv(sk, nla, &data, &cred, &has_creds);
+	if (n <= 0)
+		return n;
 
-	if (page_size == 0)
-		page_size = getpagesize();
+	*buf = malloc(n);
+	if (!*buf)
+		return -NLE_NOMEM;
 
-	iov.iov_len = page_size;
-	iov.iov_base = *buf = malloc(iov.iov_len);
+	memcpy(*buf, data, n);
 
-	if (sk->s_flags & NL_SOCK_PASSCRED) {
-		msg.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
-		msg.msg_control = calloc(1, msg.msg_controllen);
+	if (has_creds && creds) {
+		*creds = calloc(1, sizeof(struct ucred));
+		if (*creds)
+			memcpy(*creds, &cred, sizeof(struct ucred));
 	}
-retry:
 
-	n = recvmsg(sk->s_fd, &msg, flags);
-	if (!n)
-		goto abort;
-	else if (n < 0) {
-		if (errno == EINTR) {
-			NL_DBG(3, "recvmsg() returned EINTR, retrying\n");
-			goto retry;
-		} else if (errno == EAGAIN) {
-			NL_DBG(3, "recvmsg() returned EAGAIN, aborting\n");
-			goto abort;
+	return n;
+}
+
+/*
+ * Wrap a message from the socket receive buffer without copying it. The
+ * wrapper of the previous message is reused unless a callback kept a
+ * reference to it, in which case that message is detached first.
+ *
+ * Without memory for the copy the message cannot be detached. The socket
+ * then lets go of its receive buffer, so the message the callback holds
+ * stays valid, and -NLE_NOMEM is returned.
+ */
+static int nlmsg_unborrow(struct nl_sock *sk, struct nl_msg *msg)
+{
+	struct nlmsghdr *hdr;
+	int err = 0;
+
+	if (!msg)
+		return 0;
+
+	if ((msg->nm_flags & NL_MSG_BORROWED) && msg->nm_refcnt > 1) {
+		hdr = malloc(msg->nm_size);
+		if (hdr) {
+			memcpy(hdr, msg->nm_nlh, msg->nm_size);
+			msg->nm_flags &= ~NL_MSG_BORROWED;
+			msg->nm_nlh = hdr;
 		} else {
-			free(msg.msg_control);
-			free(*buf);
-			return -nl_syserr2nlerr(errno);
+			NL_DBG(1, "msg %p: failed to detach from receive buffer\n", msg);
+			sk->s_rxbuf = NULL;
+			sk->s_rxbuf_size = 0;
+			err = -NLE_NOMEM;
 		}
 	}
 
-	if (iov.iov_len < n ||
-	    msg.msg_flags & MSG_TRUNC) {
-		/* Provided buffer is not long enough, enlarge it
-		 * and try again. */
-		iov.iov_len *= 2;
-		iov.iov_base = *buf = realloc(*buf, iov.iov_len);
-		goto retry;
-	} else if (msg.msg_flags & MSG_CTRUNC) {
-		msg.msg_controllen *= 2;
-		msg.msg_control = realloc(msg.msg_control, msg.msg_controllen);
-		goto retry;
-	} else if (flags != 0) {
-		/* Buffer is big enough, do the actual reading */
-		flags = 0;
-		goto retry;
-	}
+	nlmsg_free(msg);
+	return err;
+}
 
-	if (msg.msg_namelen != sizeof(struct sockaddr_nl)) {
-		free(msg.msg_control);
-		free(*buf);
-		return -NLE_NOADDR;
+static struct nl_msg *nlmsg_borrow(struct nl_sock *sk, struct nl_msg *msg,
+				   struct nlmsghdr *hdr)
+{
+	if (msg && msg->nm_refcnt > 1) {
+		if (nlmsg_unborrow(sk, msg) < 0)
+			return NULL;
+		msg = NULL;
 	}
 
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-		if (cmsg->cmsg_level == SOL_SOCKET &&
-		    cmsg->cmsg_type == SCM_CREDENTIALS) {
-			*creds = calloc(1, sizeof(struct ucred));
-			memcpy(*creds, CMSG_DATA(cmsg), sizeof(struct ucred));
-			break;
-		}
+	if (!msg) {
+		msg = malloc(sizeof(*msg));
+		if (!msg)
+			return NULL;
 	}
 
-	free(msg.msg_control);
-	return n;
+	memset(msg, 0, sizeof(*msg));
+	msg->nm_refcnt = 1;
+	msg->nm_protocol = -1;
+	msg->nm_flags = NL_MSG_BORROWED;
+	msg->nm_nlh = hdr;
+	msg->nm_size = hdr->nlmsg_len;
 
-abort:
-	free(msg.msg_control);
-	free(*buf);
-	return 0;
+	return msg;
 }
 
 #define NL_CB_CALL(cb, type, msg) \
@@ -484,19 +619,23 @@ do { \
 
 static int recvmsgs(struct nl_sock *sk, struct nl_cb *cb)
 {
-	int n, err = 0, multipart = 0;
+	int n, err = 0, multipart = 0, has_creds;
+	int owned = cb->cb_recv_ow != NULL;
 	unsigned char *buf = NULL;
 	struct nlmsghdr *hdr;
 	struct sockaddr_nl nla = {0};
 	struct nl_msg *msg = NULL;
-	struct ucred *creds = NULL;
+	struct ucred *creds = NULL, cred;
 
 continue_reading:
 	NL_DBG(3, "Attempting to read from %p\n", sk);
-	if (cb->cb_recv_ow)
+	if (owned) {
 		n = cb->cb_recv_ow(sk, &nla, &buf, &creds);
-	else
-		n = nl_recv(sk, &nla, &buf, &creds);
+	} else {
+		/* Messages are parsed in place in the socket buffer */
+		n = __nl_recv(sk, &nla, &buf, &cred, &has_creds);
+		creds = has_creds ? &cred : NULL;
+	}
 
 	if (n <= 0)
 		return n;
@@ -507,8 +646,12 @@ continue_reading:
 	while (nlmsg_ok(hdr, n)) {
 		NL_DBG(3, "recgmsgs(%p): Processing valid message...\n", sk);
 
-		nlmsg_free(msg);
-		msg = nlmsg_convert(hdr);
+		if (owned) {
+			nlmsg_free(msg);
+			msg = nlmsg_convert(hdr);
+		} else {
+			msg = nlmsg_borrow(sk, msg, hdr);
+		}
 		if (!msg) {
 			err = -NLE_NOMEM;
 			goto out;
@@ -641,13 +784,18 @@ skip:
 		hdr = nlmsg_next(hdr, &n);
 	}
 	
-	nlmsg_free(msg);
-	free(buf);
-	free(creds);
+	err = nlmsg_unborrow(sk, msg);
+	if (owned) {
+		free(buf);
+		free(creds);
+	}
 	buf = NULL;
 	msg = NULL;
 	creds = NULL;
 
+	if (err < 0)
+		return err;
+
 	if (multipart) {
 		/* Multipart message not yet complete, continue reading */
 		goto continue_reading;
@@ -655,9 +803,12 @@ skip:
 stop:
 	err = 0;
 out:
-	nlmsg_free(msg);
-	free(buf);
-	free(creds);
+	if (nlmsg_unborrow(sk, msg) < 0 && err == 0)
+		err = -NLE_NOMEM;
+	if (owned) {
+		free(buf);
+		free(creds);
+	}
 
 	return err;
 }
@@ -2,13 +2,16 @@
 # Copyright (C) 2009 OpenWrt.org
 
 setup_switch_dev() {
+	local mode
 	config_get name "$1" name
 	name="${name:-$1}"
 	[ -d "/sys/class/net/$name" ] && ifconfig "$name" up
-	swconfig dev "$name" load network
+	[ "$2" = "incremental" ] && mode="--incremental"
+	swconfig dev "$name" load network $mode
 }
 
+# pass "incremental" to leave unchanged switch settings alone
 setup_switch() {
 	config_load network
-	config_foreach setup_switch_dev switch
+	config_foreach setup_switch_dev switch "$1"
 }
@@ -0,0 +1,264 @@
+/*
+ * bench.c: measure the cost of switch configuration operations
+ *
+ * Copyright (C) 2014 OpenWrt.org
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/switch.h>
+#include "swlib.h"
+
+static struct switch_attr *reg_attr;
+static uint64_t bench_start;
+static long bench_regs;
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+free_val(struct switch_attr *attr, struct switch_val *val)
+{
+	if (attr->type == SWITCH_TYPE_STRING)
+		free((void *) val->value.s);
+	else if (attr->type == SWITCH_TYPE_PORTS)
+		free(val->value.ports);
+}
+
+/* register accesses as counted by the virtual switch driver */
+static long
+reg_count(struct switch_dev *dev)
+{
+	struct switch_val val;
+
+	if (!reg_attr)
+		return -1;
+
+	memset(&val, 0, sizeof(val));
+	if (swlib_get_attr(dev, reg_attr, &val) < 0)
+		return -1;
+
+	return val.value.i;
+}
+
+static void
+bench_begin(struct switch_dev *dev)
+{
+	bench_regs = reg_count(dev);
+	bench_start = now_us();
+}
+
+static void
+bench_end(struct switch_dev *dev, const char *name, int n)
+{
+	uint64_t t = now_us() - bench_start;
+
+	printf("%-16s %8d %12.1f", name, n, (double) t / n);
+	if (bench_regs >= 0)
+		printf(" %12.1f", (double) (reg_count(dev) - bench_regs) / n);
+	putchar('\n');
+}
+
+static int
+get_attrs(struct switch_dev *dev, struct switch_attr *attr, int port_vlan)
+{
+	struct switch_val val;
+	int n = 0;
+
+	for (; attr; attr = attr->next) {
+		if (attr->type == SWITCH_TYPE_NOVAL)
+			continue;
+
+		memset(&val, 0, sizeof(val));
+		val.port_vlan = port_vlan;
+		if (!swlib_get_attr(dev, attr, &val))
+			free_val(attr, &val);
+		n++;
+	}
+
+	return n;
+}
+
+/* the way "swconfig show" worked before the dump request */
+static void
+show_single(struct switch_dev *dev)
+{
+	struct switch_attr *ports;
+	struct switch_val val;
+	int i;
+
+	get_attrs(dev, dev->ops, 0);
+	for (i = 0; i < dev->ports; i++)
+		get_attrs(dev, dev->port_ops, i);
+
+	ports = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_VLAN, "ports");
+	if (!ports)
+		return;
+
+	for (i = 0; i < dev->vlans; i++) {
+		memset(&val, 0, sizeof(val));
+		val.port_vlan = i;
+		if (swlib_get_attr(dev, ports, &val) < 0)
+			continue;
+		free(val.value.ports);
+		if (val.len)
+			get_attrs(dev, dev->vlan_ops, i);
+	}
+}
+
+static void
+dump_val(struct switch_attr *attr, struct switch_val *val, void *arg)
+{
+	int *n = arg;
+
+	(*n)++;
+}
+
+static int
+show_dump(struct switch_dev *dev)
+{
+	int n = 0;
+
+	get_attrs(dev, dev->ops, 0);
+	if (swlib_dump_attrs(dev, SWLIB_ATTR_GROUP_PORT, dump_val, &n) < 0)
+		return -1;
+	if (swlib_dump_attrs(dev, SWLIB_ATTR_GROUP_VLAN, dump_val, &n) < 0)
+		return -1;
+
+	return n;
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n <count>] [-s <count>] <dev>\n"
+		"\t-n <count>\tIterations of the get/set/apply tests (default 100)\n"
+		"\t-s <count>\tIterations of the show tests (default 3)\n"
+		"\n"
+		"The set and apply tests write back the current configuration,\n"
+		"run them against the virtual switch or an unused device.\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct switch_dev *dev;
+	struct switch_attr *attr, *ports, *apply;
+	struct switch_val val;
+	int n = 100, n_show = 3;
+	int ch, i, vlan;
+
+	while ((ch = getopt(argc, argv, "n:s:")) != -1) {
+		switch (ch) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 's':
+			n_show = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1 || n < 1 || n_show < 1)
+		usage(argv[0]);
+
+	dev = swlib_connect(argv[optind]);
+	if (!dev) {
+		fprintf(stderr, "Failed to connect to the switch\n");
+		return 1;
+	}
+	swlib_scan(dev);
+
+	reg_attr = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_GLOBAL, "reg_accesses");
+
+	printf("%s: %d ports, %d vlans\n\n", dev->dev_name, dev->ports, dev->vlans);
+	printf("%-16s %8s %12s%s\n", "test", "count", "us/op",
+		reg_attr ? "      regs/op" : "");
+
+	/* single attribute read */
+	for (attr = dev->ops; attr; attr = attr->next)
+		if (attr->type != SWITCH_TYPE_NOVAL && attr != reg_attr)
+			break;
+	if (attr) {
+		bench_begin(dev);
+		for (i = 0; i < n; i++) {
+			memset(&val, 0, sizeof(val));
+			if (!swlib_get_attr(dev, attr, &val))
+				free_val(attr, &val);
+		}
+		bench_end(dev, "get", n);
+	}
+
+	/* vlan port mapping write, using the current value of the first
+	 * active vlan */
+	ports = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_VLAN, "ports");
+	memset(&val, 0, sizeof(val));
+	for (vlan = 0; ports && vlan < dev->vlans; vlan++) {
+		val.port_vlan = vlan;
+		if (swlib_get_attr(dev, ports, &val) < 0)
+			continue;
+		if (val.len)
+			break;
+		free(val.value.ports);
+	}
+	if (ports && vlan < dev->vlans) {
+		bench_begin(dev);
+		for (i = 0; i < n; i++)
+			swlib_set_attr(dev, ports, &val);
+		bench_end(dev, "set", n);
+		free(val.value.ports);
+	}
+
+	apply = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_GLOBAL, "apply");
+	if (apply) {
+		bench_begin(dev);
+		for (i = 0; i < n; i++) {
+			memset(&val, 0, sizeof(val));
+			swlib_set_attr(dev, apply, &val);
+		}
+		bench_end(dev, "apply", n);
+	}
+
+	bench_begin(dev);
+	for (i = 0; i < n_show; i++)
+		show_single(dev);
+	bench_end(dev, "show (single)", n_show);
+
+	bench_begin(dev);
+	for (i = 0; i < n_show; i++) {
+		if (show_dump(dev) < 0)
+			break;
+	}
+	if (i == n_show)
+		bench_end(dev, "show (dump)", n_show);
+	else
+		printf("%-16s not supported by the kernel\n", "show (dump)");
+
+	swlib_free_all(dev);
+	return 0;
+}
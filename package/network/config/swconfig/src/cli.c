@@ -165,16 +165,60 @@ show_vlan(struct switch_dev *dev, int vlan, bool all)
 	show_attrs(dev, dev->vlan_ops, &val);
 }
 
+struct show_dump {
+	enum swlib_attr_group atype;
+	int port_vlan;
+};
+
+static void
+show_dump_val(struct switch_attr *attr, struct switch_val *val, void *arg)
+{
+	struct show_dump *sd = arg;
+
+	if (val->port_vlan != sd->port_vlan) {
+		sd->port_vlan = val->port_vlan;
+		if (sd->atype == SWLIB_ATTR_GROUP_PORT)
+			printf("Port %d:\n", val->port_vlan);
+		else
+			printf("VLAN %d:\n", val->port_vlan);
+	}
+
+	printf("\t%s: ", attr->name);
+	if (val->err < 0)
+		printf("???");
+	else
+		print_attr_val(attr, val);
+	putchar('\n');
+}
+
+/* fetch all ports or active vlans in one request, returns < 0 if the
+ * kernel does not support it and nothing has been printed yet */
+static int
+show_dump(struct switch_dev *dev, enum swlib_attr_group atype)
+{
+	struct show_dump sd = {
+		.atype = atype,
+		.port_vlan = -1,
+	};
+	int err;
+
+	err = swlib_dump_attrs(dev, atype, show_dump_val, &sd);
+	if (err < 0 && sd.port_vlan < 0)
+		return err;
+
+	return 0;
+}
+
 static void
 print_usage(void)
 {
 	printf("swconfig list\n");
-	printf("swconfig dev <dev> [port <port>|vlan <vlan>] (help|set <key> <value>|get <key>|load <config>|show)\n");
+	printf("swconfig dev <dev> [port <port>|vlan <vlan>] (help|set <key> <value>|get <key>|load <config> [--incremental] [--dry-run]|show)\n");
 	exit(1);
 }
 
 static void
-swconfig_load_uci(struct switch_dev *dev, const char *name)
+swconfig_load_uci(struct switch_dev *dev, const char *name, int incremental, int dry_run)
 {
 	struct uci_context *ctx;
 	struct uci_package *p = NULL;
@@ -190,13 +234,16 @@ swconfig_load_uci(struct switch_dev *dev, const char *name)
 		goto out;
 	}
 
-	ret = swlib_apply_from_uci(dev, p);
+	if (incremental || dry_run)
+		ret = swlib_update_from_uci(dev, p, dry_run);
+	else
+		ret = swlib_apply_from_uci(dev, p);
 	if (ret < 0)
 		fprintf(stderr, "Failed to apply configuration for switch '%s'\n", dev->dev_name);
 
 out:
 	uci_free_context(ctx);
-	exit(ret);
+	exit(ret < 0 ? ret : 0);
 }
 
 int main(int argc, char **argv)
@@ -214,6 +261,8 @@ int main(int argc, char **argv)
 	char *ckey = NULL;
 	char *cvalue = NULL;
 	char *csegment = NULL;
+	int cincremental = 0;
+	int cdryrun = 0;
 
 	if((argc == 2) && !strcmp(argv[1], "list")) {
 		swlib_list();
@@ -231,7 +280,11 @@ int main(int argc, char **argv)
 	for(i = 3; i < argc; i++)
 	{
 		char *arg = argv[i];
-		if (cmd != CMD_NONE) {
+		if (cmd == CMD_LOAD && !strcmp(arg, "--incremental")) {
+			cincremental = 1;
+		} else if (cmd == CMD_LOAD && !strcmp(arg, "--dry-run")) {
+			cdryrun = 1;
+		} else if (cmd != CMD_NONE) {
 			print_usage();
 		} else if (!strcmp(arg, "port") && i+1 < argc) {
 			cport = atoi(argv[++i]);
@@ -324,7 +377,7 @@ int main(int argc, char **argv)
 		putchar('\n');
 		break;
 	case CMD_LOAD:
-		swconfig_load_uci(dev, ckey);
+		swconfig_load_uci(dev, ckey, cincremental, cdryrun);
 		break;
 	case CMD_HELP:
 		list_attributes(dev);
@@ -340,10 +393,14 @@ int main(int argc, char **argv)
 				show_vlan(dev, cvlan, false);
 		} else {
 			show_global(dev);
-			for (i=0; i < dev->ports; i++)
-				show_port(dev, i);
-			for (i=0; i < dev->vlans; i++)
-				show_vlan(dev, i, true);
+			if (show_dump(dev, SWLIB_ATTR_GROUP_PORT) < 0) {
+				for (i=0; i < dev->ports; i++)
+					show_port(dev, i);
+			}
+			if (show_dump(dev, SWLIB_ATTR_GROUP_VLAN) < 0) {
+				for (i=0; i < dev->vlans; i++)
+					show_vlan(dev, i, true);
+			}
 		}
 		break;
 	}
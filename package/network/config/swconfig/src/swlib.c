@@ -76,13 +76,12 @@ wait_handler(struct nl_msg *msg, void *arg)
 
 /* helper function for performing netlink requests */
 static int
-swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
+swlib_call_flags(int cmd, int flags, int (*call)(struct nl_msg *, void *),
 		int (*data)(struct nl_msg *, void *), void *arg)
 {
 	struct nl_msg *msg;
 	struct nl_cb *cb = NULL;
 	int finished;
-	int flags = 0;
 	int err;
 
 	msg = nlmsg_alloc();
@@ -91,9 +90,6 @@ swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
 		exit(1);
 	}
 
-	if (!data)
-		flags |= NLM_F_DUMP;
-
 	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, genl_family_get_id(family), 0, flags, cmd, 0);
 	if (data) {
 		if (data(msg, arg) < 0)
@@ -117,10 +113,10 @@ swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
 	if (call)
 		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, call, arg);
 
-	if (data)
-		nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, wait_handler, &finished);
-	else
+	if (flags & NLM_F_DUMP)
 		nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, wait_handler, &finished);
+	else
+		nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, wait_handler, &finished);
 
 	err = nl_recvmsgs(handle, cb);
 	if (err < 0) {
@@ -138,6 +134,13 @@ nla_put_failure:
 	return err;
 }
 
+static int
+swlib_call(int cmd, int (*call)(struct nl_msg *, void *),
+		int (*data)(struct nl_msg *, void *), void *arg)
+{
+	return swlib_call_flags(cmd, data ? 0 : NLM_F_DUMP, call, data, arg);
+}
+
 static int
 send_attr(struct nl_msg *msg, void *arg)
 {
@@ -260,6 +263,123 @@ swlib_get_attr(struct switch_dev *dev, struct switch_attr *attr, struct switch_v
 	return err;
 }
 
+struct dump_attrs_arg {
+	struct switch_dev *dev;
+	struct switch_attr *attrs;
+	struct switch_port *ports;
+	void (*cb)(struct switch_attr *attr, struct switch_val *val, void *arg);
+	void *arg;
+};
+
+static int
+send_dump_id(struct nl_msg *msg, void *arg)
+{
+	struct dump_attrs_arg *d = arg;
+
+	NLA_PUT_U32(msg, SWITCH_ATTR_ID, d->dev->id);
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static int
+store_dump_val(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct dump_attrs_arg *d = arg;
+	struct switch_attr *attr;
+	struct switch_val val;
+	int id;
+
+	if (nla_parse(tb, SWITCH_ATTR_MAX - 1, genlmsg_attrdata(gnlh, 0),
+			genlmsg_attrlen(gnlh, 0), NULL) < 0)
+		goto done;
+
+	if (!tb[SWITCH_ATTR_OP_ID])
+		goto done;
+
+	id = nla_get_u32(tb[SWITCH_ATTR_OP_ID]);
+	for (attr = d->attrs; attr; attr = attr->next)
+		if (attr->id == id)
+			break;
+	if (!attr)
+		goto done;
+
+	memset(&val, 0, sizeof(val));
+	val.attr = attr;
+	if (tb[SWITCH_ATTR_OP_PORT])
+		val.port_vlan = nla_get_u32(tb[SWITCH_ATTR_OP_PORT]);
+	else if (tb[SWITCH_ATTR_OP_VLAN])
+		val.port_vlan = nla_get_u32(tb[SWITCH_ATTR_OP_VLAN]);
+
+	/* the kernel leaves out the value if it could not be read */
+	val.err = -EINVAL;
+	switch(attr->type) {
+	case SWITCH_TYPE_INT:
+		if (!tb[SWITCH_ATTR_OP_VALUE_INT])
+			break;
+		val.value.i = nla_get_u32(tb[SWITCH_ATTR_OP_VALUE_INT]);
+		val.err = 0;
+		break;
+	case SWITCH_TYPE_STRING:
+		if (!tb[SWITCH_ATTR_OP_VALUE_STR])
+			break;
+		val.value.s = nla_get_string(tb[SWITCH_ATTR_OP_VALUE_STR]);
+		val.err = 0;
+		break;
+	case SWITCH_TYPE_PORTS:
+		if (!tb[SWITCH_ATTR_OP_VALUE_PORTS])
+			break;
+		val.value.ports = d->ports;
+		val.err = store_port_val(msg, tb[SWITCH_ATTR_OP_VALUE_PORTS], &val);
+		break;
+	default:
+		break;
+	}
+
+	d->cb(attr, &val, d->arg);
+
+done:
+	return NL_SKIP;
+}
+
+int
+swlib_dump_attrs(struct switch_dev *dev, enum swlib_attr_group atype,
+		void (*cb)(struct switch_attr *attr, struct switch_val *val, void *arg),
+		void *arg)
+{
+	struct dump_attrs_arg d;
+	int cmd;
+	int err;
+
+	memset(&d, 0, sizeof(d));
+	switch(atype) {
+	case SWLIB_ATTR_GROUP_PORT:
+		cmd = SWITCH_CMD_GET_PORT;
+		d.attrs = dev->port_ops;
+		break;
+	case SWLIB_ATTR_GROUP_VLAN:
+		cmd = SWITCH_CMD_GET_VLAN;
+		d.attrs = dev->vlan_ops;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	d.dev = dev;
+	d.cb = cb;
+	d.arg = arg;
+	d.ports = malloc(sizeof(struct switch_port) * dev->ports);
+	if (!d.ports)
+		return -ENOMEM;
+
+	err = swlib_call_flags(cmd, NLM_F_DUMP, store_dump_val, send_dump_id, &d);
+	free(d.ports);
+
+	return err;
+}
+
 static int
 send_attr_ports(struct nl_msg *msg, struct switch_val *val)
 {
@@ -350,25 +470,23 @@ swlib_set_attr(struct switch_dev *dev, struct switch_attr *attr, struct switch_v
 	return swlib_call(cmd, NULL, send_attr_val, val);
 }
 
-int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int port_vlan, const char *str)
+int swlib_parse_attr_string(struct switch_dev *dev, struct switch_attr *a,
+		const char *str, struct switch_val *val)
 {
 	struct switch_port *ports;
-	struct switch_val val;
 	char *ptr;
 
-	memset(&val, 0, sizeof(val));
-	val.port_vlan = port_vlan;
 	switch(a->type) {
 	case SWITCH_TYPE_INT:
-		val.value.i = atoi(str);
+		val->value.i = atoi(str);
 		break;
 	case SWITCH_TYPE_STRING:
-		val.value.s = str;
+		val->value.s = str;
 		break;
 	case SWITCH_TYPE_PORTS:
-		ports = alloca(sizeof(struct switch_port) * dev->ports);
+		ports = val->value.ports;
 		memset(ports, 0, sizeof(struct switch_port) * dev->ports);
-		val.len = 0;
+		val->len = 0;
 		ptr = (char *)str;
 		while(ptr && *ptr)
 		{
@@ -381,14 +499,14 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int por
 			if (!isdigit(*ptr))
 				return -1;
 
-			if (val.len >= dev->ports)
+			if (val->len >= dev->ports)
 				return -1;
 
-			ports[val.len].flags = 0;
-			ports[val.len].id = strtoul(ptr, &ptr, 10);
+			ports[val->len].flags = 0;
+			ports[val->len].id = strtoul(ptr, &ptr, 10);
 			while(*ptr && !isspace(*ptr)) {
 				if (*ptr == 't')
-					ports[val.len].flags |= SWLIB_PORT_FLAG_TAGGED;
+					ports[val->len].flags |= SWLIB_PORT_FLAG_TAGGED;
 				else
 					return -1;
 
@@ -396,18 +514,34 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int por
 			}
 			if (*ptr)
 				ptr++;
-			val.len++;
+			val->len++;
 		}
-		val.value.ports = ports;
 		break;
 	case SWITCH_TYPE_NOVAL:
 		if (str && !strcmp(str, "0"))
-			return 0;
+			return 1;
 
 		break;
 	default:
 		return -1;
 	}
+	return 0;
+}
+
+int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *a, int port_vlan, const char *str)
+{
+	struct switch_val val;
+	int ret;
+
+	memset(&val, 0, sizeof(val));
+	val.port_vlan = port_vlan;
+	if (a->type == SWITCH_TYPE_PORTS)
+		val.value.ports = alloca(sizeof(struct switch_port) * dev->ports);
+
+	ret = swlib_parse_attr_string(dev, a, str, &val);
+	if (ret)
+		return ret < 0 ? ret : 0;
+
 	return swlib_set_attr(dev, a, &val);
 }
 
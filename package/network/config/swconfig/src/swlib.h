@@ -231,6 +231,18 @@ int swlib_set_attr(struct switch_dev *dev, struct switch_attr *attr,
 int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *attr,
 		int port_vlan, const char *str);
 
+/**
+ * swlib_parse_attr_string: convert a string to an attribute value
+ * @dev: switch device struct
+ * @attr: switch attribute struct
+ * @str: string value
+ * @val: attribute value pointer, for port lists val->value.ports must
+ *       point to a buffer of dev->ports entries
+ * returns 0 on success, 1 if the value means the attribute should not be set
+ */
+int swlib_parse_attr_string(struct switch_dev *dev, struct switch_attr *attr,
+		const char *str, struct switch_val *val);
+
 /**
  * swlib_get_attr: get the value for an attribute
  * @dev: switch device struct
@@ -242,6 +254,20 @@ int swlib_set_attr_string(struct switch_dev *dev, struct switch_attr *attr,
 int swlib_get_attr(struct switch_dev *dev, struct switch_attr *attr,
 		struct switch_val *val);
 
+/**
+ * swlib_dump_attrs: get the values of all port or vlan attributes at once
+ * @dev: switch device struct
+ * @atype: port or vlan
+ * @cb: called for every value, vlans without member ports are skipped
+ * @arg: passed to cb
+ * returns 0 on success, a negative error if the kernel does not support it
+ * values are only valid for the duration of the callback, val->err is set
+ * for attributes that could not be read
+ */
+int swlib_dump_attrs(struct switch_dev *dev, enum swlib_attr_group atype,
+		void (*cb)(struct switch_attr *attr, struct switch_val *val, void *arg),
+		void *arg);
+
 /**
  * swlib_apply_from_uci: set up the switch from a uci configuration
  * @dev: switch device struct
@@ -249,4 +275,15 @@ int swlib_get_attr(struct switch_dev *dev, struct switch_attr *attr,
  */
 int swlib_apply_from_uci(struct switch_dev *dev, struct uci_package *p);
 
+/**
+ * swlib_update_from_uci: bring the switch in line with a uci configuration
+ * without resetting it, only attributes whose live value differs are set
+ * @dev: switch device struct
+ * @p: uci package which contains the desired global config
+ * @dry_run: only print the planned changes
+ * returns the number of changed attributes or a negative error
+ */
+int swlib_update_from_uci(struct switch_dev *dev, struct uci_package *p,
+		int dry_run);
+
 #endif
@@ -105,14 +105,13 @@ skip:
 	}
 }
 
-int swlib_apply_from_uci(struct switch_dev *dev, struct uci_package *p)
+/* build the early settings and the settings list for dev from p */
+static int
+swlib_map_uci(struct switch_dev *dev, struct uci_package *p)
 {
-	struct switch_attr *attr;
 	struct uci_element *e;
 	struct uci_section *s;
 	struct uci_option *o;
-	struct uci_ptr ptr;
-	struct switch_val val;
 	int i;
 
 	settings = NULL;
@@ -217,6 +216,18 @@ found:
 		}
 	}
 
+	return 0;
+}
+
+int swlib_apply_from_uci(struct switch_dev *dev, struct uci_package *p)
+{
+	struct switch_attr *attr;
+	struct switch_val val;
+	int i;
+
+	if (swlib_map_uci(dev, p) < 0)
+		return -1;
+
 	for (i = 0; i < ARRAY_SIZE(early_settings); i++) {
 		struct swlib_setting *st = &early_settings[i];
 		if (!st->attr || !st->val)
@@ -244,3 +255,223 @@ found:
 
 	return 0;
 }
+
+static void
+swlib_print_val(struct switch_attr *attr, struct switch_val *val)
+{
+	int i;
+
+	switch (attr->type) {
+	case SWITCH_TYPE_INT:
+		printf("%d", val->value.i);
+		break;
+	case SWITCH_TYPE_STRING:
+		printf("%s", val->value.s);
+		break;
+	case SWITCH_TYPE_PORTS:
+		for (i = 0; i < val->len; i++) {
+			printf("%s%d%s", i ? " " : "",
+				val->value.ports[i].id,
+				(val->value.ports[i].flags &
+				 SWLIB_PORT_FLAG_TAGGED) ? "t" : "");
+		}
+		break;
+	}
+}
+
+static bool
+swlib_has_port(struct switch_val *val, struct switch_port *port)
+{
+	int i;
+
+	for (i = 0; i < val->len; i++)
+		if (val->value.ports[i].id == port->id)
+			return val->value.ports[i].flags == port->flags;
+
+	return false;
+}
+
+static bool
+swlib_val_equal(struct switch_attr *attr, struct switch_val *a,
+		struct switch_val *b)
+{
+	int i;
+
+	switch (attr->type) {
+	case SWITCH_TYPE_INT:
+		return a->value.i == b->value.i;
+	case SWITCH_TYPE_STRING:
+		return !strcmp(a->value.s, b->value.s);
+	case SWITCH_TYPE_PORTS:
+		/* port lists are unordered */
+		if (a->len != b->len)
+			return false;
+		for (i = 0; i < b->len; i++)
+			if (!swlib_has_port(a, &b->value.ports[i]))
+				return false;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* set a single attribute if its live value differs, returns 1 if it did */
+static int
+swlib_update_setting(struct switch_dev *dev, struct swlib_setting *st,
+		int dry_run)
+{
+	struct switch_attr *attr = st->attr;
+	struct switch_val cur, new;
+	bool known;
+	int ret = 0;
+
+	/* actions have no state to compare against */
+	if (attr->type == SWITCH_TYPE_NOVAL)
+		return 0;
+
+	memset(&new, 0, sizeof(new));
+	new.port_vlan = st->port_vlan;
+	if (attr->type == SWITCH_TYPE_PORTS)
+		new.value.ports = alloca(sizeof(struct switch_port) * dev->ports);
+
+	if (swlib_parse_attr_string(dev, attr, st->val, &new) < 0) {
+		fprintf(stderr, "Invalid value '%s' for attribute '%s'\n",
+			st->val, attr->name);
+		return 0;
+	}
+
+	memset(&cur, 0, sizeof(cur));
+	cur.port_vlan = st->port_vlan;
+	known = !swlib_get_attr(dev, attr, &cur);
+	if (known && swlib_val_equal(attr, &cur, &new))
+		goto out;
+
+	ret = 1;
+	if (!dry_run) {
+		swlib_set_attr(dev, attr, &new);
+		goto out;
+	}
+
+	switch (attr->atype) {
+	case SWLIB_ATTR_GROUP_PORT:
+		printf("port %d ", st->port_vlan);
+		break;
+	case SWLIB_ATTR_GROUP_VLAN:
+		printf("vlan %d ", st->port_vlan);
+		break;
+	}
+	printf("%s: ", attr->name);
+	if (known)
+		swlib_print_val(attr, &cur);
+	else
+		printf("???");
+	printf(" -> ");
+	swlib_print_val(attr, &new);
+	putchar('\n');
+
+out:
+	if (attr->type == SWITCH_TYPE_STRING)
+		free((void *) cur.value.s);
+	else if (attr->type == SWITCH_TYPE_PORTS)
+		free(cur.value.ports);
+	return ret;
+}
+
+static void
+swlib_mark_vlan(struct switch_attr *attr, struct switch_val *val, void *arg)
+{
+	char *active = arg;
+
+	if (!strcmp(attr->name, "ports") && !val->err && val->len > 0)
+		active[val->port_vlan] = 1;
+}
+
+/* vlans that are live but not configured would have been dropped by the
+ * reset, clear their port mapping instead */
+static int
+swlib_clear_vlans(struct switch_dev *dev, int dry_run)
+{
+	struct swlib_setting clear = { .val = "" };
+	struct swlib_setting *st;
+	struct switch_val val;
+	char *active;
+	int changes = 0;
+	int i;
+
+	clear.attr = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_VLAN, "ports");
+	if (!clear.attr)
+		return 0;
+
+	active = calloc(dev->vlans, 1);
+	if (!active)
+		return 0;
+
+	if (swlib_dump_attrs(dev, SWLIB_ATTR_GROUP_VLAN, swlib_mark_vlan,
+			active) < 0) {
+		for (i = 0; i < dev->vlans; i++) {
+			memset(&val, 0, sizeof(val));
+			val.port_vlan = i;
+			if (swlib_get_attr(dev, clear.attr, &val) < 0)
+				continue;
+			active[i] = val.len > 0;
+			free(val.value.ports);
+		}
+	}
+
+	for (st = settings; st; st = st->next)
+		if (st->attr == clear.attr && st->port_vlan < dev->vlans)
+			active[st->port_vlan] = 0;
+
+	for (i = 0; i < dev->vlans; i++) {
+		if (!active[i])
+			continue;
+		clear.port_vlan = i;
+		changes += swlib_update_setting(dev, &clear, dry_run);
+	}
+
+	free(active);
+	return changes;
+}
+
+int swlib_update_from_uci(struct switch_dev *dev, struct uci_package *p,
+		int dry_run)
+{
+	struct switch_attr *attr;
+	struct switch_val val;
+	int changes = 0;
+	int i;
+
+	if (swlib_map_uci(dev, p) < 0)
+		return -1;
+
+	for (i = 0; i < ARRAY_SIZE(early_settings); i++) {
+		struct swlib_setting *st = &early_settings[i];
+		if (!st->attr || !st->val)
+			continue;
+		changes += swlib_update_setting(dev, st, dry_run);
+	}
+
+	changes += swlib_clear_vlans(dev, dry_run);
+
+	while (settings) {
+		struct swlib_setting *st = settings;
+
+		changes += swlib_update_setting(dev, st, dry_run);
+		st = st->next;
+		free(settings);
+		settings = st;
+	}
+
+	if (!changes || dry_run)
+		return changes;
+
+	/* Apply the config */
+	attr = swlib_lookup_attr(dev, SWLIB_ATTR_GROUP_GLOBAL, "apply");
+	if (!attr)
+		return changes;
+
+	memset(&val, 0, sizeof(val));
+	swlib_set_attr(dev, attr, &val);
+
+	return changes;
+}
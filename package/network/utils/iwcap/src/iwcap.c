@@ -30,10 +30,13 @@
 #include <sys/time.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include <net/ethernet.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <linux/if_packet.h>
+#include <linux/filter.h>
 
 #define ARPHRD_IEEE80211_RADIOTAP	803
 
@@ -54,6 +57,15 @@ uint8_t run_dump   = 0;
 uint8_t run_stop   = 0;
 uint8_t run_daemon = 0;
 
+uint8_t filter_data   = 0;
+uint8_t filter_beacon = 0;
+int     filter_subtype = -1;
+uint8_t filter_bssid[6];
+uint8_t filter_bssid_set = 0;
+int     filter_rssi = 0;
+uint8_t filter_rssi_set = 0;
+uint8_t filter_kernel = 0;
+
 uint32_t frames_captured = 0;
 uint32_t frames_filtered = 0;
 
@@ -253,6 +265,414 @@ void ringbuf_free(struct ringbuf *r)
 }
 
 
+int filter_frame(uint8_t *buf, uint32_t len)
+{
+	radiotap_hdr_t *rhdr = (radiotap_hdr_t *)buf;
+	uint8_t frametype;
+
+	/* already applied by the socket filter */
+	if (filter_kernel)
+		return 0;
+
+	if (len <= sizeof(radiotap_hdr_t) || le16(rhdr->it_len) >= len)
+		return 1;
+
+	frametype = *(buf + le16(rhdr->it_len));
+
+	return ((filter_data   && (frametype & FRAMETYPE_MASK) == FRAMETYPE_DATA) ||
+	        (filter_beacon && (frametype & FRAMETYPE_MASK) == FRAMETYPE_BEACON));
+}
+
+/*
+ * Socket filter construction: the frame filters are compiled into a classic
+ * BPF program so that unwanted frames are dropped before they are copied to
+ * userspace. Jump targets are labels which get resolved once the program is
+ * complete, all checks fall through on success and jump to L_DROP on failure.
+ */
+#define FILTER_MAX_INSNS			96
+#define FILTER_MAX_LABELS			16
+
+#define L_NEXT						0
+#define L_PASS						1
+#define L_DROP						2
+
+struct filter_prog {
+	struct sock_filter insn[FILTER_MAX_INSNS];
+	uint8_t jt[FILTER_MAX_INSNS];
+	uint8_t jf[FILTER_MAX_INSNS];
+	int label[FILTER_MAX_LABELS];
+	int nlabels;
+	int len;
+};
+
+void fp_jump(struct filter_prog *p, uint16_t code, uint32_t k,
+             uint8_t jt, uint8_t jf)
+{
+	if (p->len < FILTER_MAX_INSNS)
+	{
+		p->insn[p->len].code = code;
+		p->insn[p->len].k    = k;
+		p->jt[p->len] = jt;
+		p->jf[p->len] = jf;
+	}
+
+	p->len++;
+}
+
+#define fp_stmt(p, code, k) fp_jump(p, code, k, L_NEXT, L_NEXT)
+
+int fp_label(struct filter_prog *p)
+{
+	if (p->nlabels < FILTER_MAX_LABELS)
+		return p->nlabels++;
+
+	/* make fp_resolve() fail */
+	p->len = FILTER_MAX_INSNS + 1;
+	return L_DROP;
+}
+
+void fp_bind(struct filter_prog *p, int l)
+{
+	p->label[l] = p->len;
+}
+
+int fp_resolve(struct filter_prog *p)
+{
+	int i, t, f;
+
+	if (p->len > FILTER_MAX_INSNS)
+		return -1;
+
+	for (i = 0; i < p->len; i++)
+	{
+		t = p->jt[i] ? p->label[p->jt[i]] - i - 1 : 0;
+		f = p->jf[i] ? p->label[p->jf[i]] - i - 1 : 0;
+
+		if (t < 0 || t > 255 || f < 0 || f > 255)
+			return -1;
+
+		if (p->insn[i].code == (BPF_JMP | BPF_JA))
+			p->insn[i].k = t;
+		else
+		{
+			p->insn[i].jt = t;
+			p->insn[i].jf = f;
+		}
+	}
+
+	return 0;
+}
+
+/* leaves the offset of the dBm antenna signal field in X */
+void fp_radiotap_signal(struct filter_prog *p)
+{
+	static const struct { uint8_t bit, align, size; } fields[] = {
+		{ 0x01, 8, 8 },	/* TSFT */
+		{ 0x02, 1, 1 },	/* FLAGS */
+		{ 0x04, 1, 1 },	/* RATE */
+		{ 0x08, 2, 4 },	/* CHANNEL */
+		{ 0x10, 2, 2 },	/* FHSS */
+	};
+
+	int i, l_fields = fp_label(p), l_skip;
+
+	/* fields start after the last it_present word */
+	for (i = 0; i < 4; i++)
+	{
+		fp_stmt(p, BPF_LDX | BPF_IMM, 8 + i * 4);
+		fp_stmt(p, BPF_LD | BPF_B | BPF_ABS, 7 + i * 4);
+		fp_jump(p, BPF_JMP | BPF_JSET | BPF_K, 0x80,
+		        (i < 3) ? L_NEXT : L_DROP, l_fields);
+	}
+
+	fp_bind(p, l_fields);
+	fp_stmt(p, BPF_LD | BPF_B | BPF_ABS, 4);
+	fp_stmt(p, BPF_ST, 0);
+
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+	{
+		l_skip = fp_label(p);
+
+		fp_stmt(p, BPF_LD | BPF_MEM, 0);
+		fp_jump(p, BPF_JMP | BPF_JSET | BPF_K, fields[i].bit, L_NEXT, l_skip);
+		fp_stmt(p, BPF_MISC | BPF_TXA, 0);
+
+		if (fields[i].align > 1)
+		{
+			fp_stmt(p, BPF_ALU | BPF_ADD | BPF_K, fields[i].align - 1);
+			fp_stmt(p, BPF_ALU | BPF_AND | BPF_K, ~(fields[i].align - 1));
+		}
+
+		fp_stmt(p, BPF_ALU | BPF_ADD | BPF_K, fields[i].size);
+		fp_stmt(p, BPF_MISC | BPF_TAX, 0);
+		fp_bind(p, l_skip);
+	}
+
+	/* frames without signal information can't pass */
+	fp_stmt(p, BPF_LD | BPF_MEM, 0);
+	fp_jump(p, BPF_JMP | BPF_JSET | BPF_K, 0x20, L_NEXT, L_DROP);
+}
+
+void fp_bssid(struct filter_prog *p)
+{
+	int l_addr1 = fp_label(p), l_addr2 = fp_label(p);
+	int l_addr3 = fp_label(p), l_cmp = fp_label(p);
+
+	/* management frames carry the bssid in addr3, data frames depending
+	 * on the distribution system bits, control frames are not matched */
+	fp_stmt(p, BPF_LD | BPF_B | BPF_IND, 0);
+	fp_stmt(p, BPF_ALU | BPF_AND | BPF_K, 0x0C);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, 0x00, l_addr3, L_NEXT);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, 0x08, L_NEXT, L_DROP);
+
+	fp_stmt(p, BPF_LD | BPF_B | BPF_IND, 1);
+	fp_stmt(p, BPF_ALU | BPF_AND | BPF_K, 0x03);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, 0x00, l_addr3, L_NEXT);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, 0x01, l_addr1, L_NEXT);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K, 0x02, l_addr2, L_DROP);
+
+	fp_bind(p, l_addr1);
+	fp_stmt(p, BPF_LD | BPF_IMM, 4);
+	fp_jump(p, BPF_JMP | BPF_JA, 0, l_cmp, L_NEXT);
+
+	fp_bind(p, l_addr2);
+	fp_stmt(p, BPF_LD | BPF_IMM, 10);
+	fp_jump(p, BPF_JMP | BPF_JA, 0, l_cmp, L_NEXT);
+
+	fp_bind(p, l_addr3);
+	fp_stmt(p, BPF_LD | BPF_IMM, 16);
+
+	fp_bind(p, l_cmp);
+	fp_stmt(p, BPF_ALU | BPF_ADD | BPF_X, 0);
+	fp_stmt(p, BPF_MISC | BPF_TAX, 0);
+	fp_stmt(p, BPF_LD | BPF_W | BPF_IND, 0);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K,
+	        (filter_bssid[0] << 24) | (filter_bssid[1] << 16) |
+	        (filter_bssid[2] << 8) | filter_bssid[3], L_NEXT, L_DROP);
+	fp_stmt(p, BPF_LD | BPF_H | BPF_IND, 4);
+	fp_jump(p, BPF_JMP | BPF_JEQ | BPF_K,
+	        (filter_bssid[4] << 8) | filter_bssid[5], L_NEXT, L_DROP);
+}
+
+/* attach the frame filters, accepted frames are truncated to snaplen */
+int attach_filter(uint32_t snaplen)
+{
+	struct filter_prog p = { .nlabels = L_DROP + 1 };
+	struct sock_fprog prog;
+	int l_rssi;
+
+	if (filter_rssi_set)
+	{
+		l_rssi = fp_label(&p);
+
+		fp_radiotap_signal(&p);
+		fp_stmt(&p, BPF_LD | BPF_B | BPF_IND, 0);
+
+		/* the field is signed, negative values compare above 127 */
+		if (filter_rssi < 0)
+		{
+			fp_jump(&p, BPF_JMP | BPF_JGE | BPF_K, 0x80, L_NEXT, l_rssi);
+			fp_jump(&p, BPF_JMP | BPF_JGE | BPF_K, filter_rssi & 0xFF,
+			        L_NEXT, L_DROP);
+		}
+		else
+		{
+			fp_jump(&p, BPF_JMP | BPF_JGE | BPF_K, 0x80, L_DROP, L_NEXT);
+			fp_jump(&p, BPF_JMP | BPF_JGE | BPF_K, filter_rssi,
+			        L_NEXT, L_DROP);
+		}
+
+		fp_bind(&p, l_rssi);
+	}
+
+	/* X = radiotap it_len, stored little endian */
+	fp_stmt(&p, BPF_LD | BPF_B | BPF_ABS, 3);
+	fp_stmt(&p, BPF_ALU | BPF_LSH | BPF_K, 8);
+	fp_stmt(&p, BPF_MISC | BPF_TAX, 0);
+	fp_stmt(&p, BPF_LD | BPF_B | BPF_ABS, 2);
+	fp_stmt(&p, BPF_ALU | BPF_OR | BPF_X, 0);
+	fp_stmt(&p, BPF_MISC | BPF_TAX, 0);
+
+	/* frame control, frames ending within the header are dropped here */
+	fp_stmt(&p, BPF_LD | BPF_B | BPF_IND, 0);
+	fp_stmt(&p, BPF_ALU | BPF_AND | BPF_K, FRAMETYPE_MASK);
+
+	if (filter_beacon)
+		fp_jump(&p, BPF_JMP | BPF_JEQ | BPF_K, FRAMETYPE_BEACON,
+		        L_DROP, L_NEXT);
+
+	if (filter_data)
+		fp_jump(&p, BPF_JMP | BPF_JEQ | BPF_K, FRAMETYPE_DATA,
+		        L_DROP, L_NEXT);
+
+	if (filter_subtype >= 0)
+		fp_jump(&p, BPF_JMP | BPF_JEQ | BPF_K, filter_subtype,
+		        L_NEXT, L_DROP);
+
+	if (filter_bssid_set)
+		fp_bssid(&p);
+
+	fp_bind(&p, L_PASS);
+	fp_stmt(&p, BPF_RET | BPF_K, snaplen);
+	fp_bind(&p, L_DROP);
+	fp_stmt(&p, BPF_RET | BPF_K, 0);
+
+	if (fp_resolve(&p))
+	{
+		errno = E2BIG;
+		return -1;
+	}
+
+	prog.len    = p.len;
+	prog.filter = p.insn;
+
+	if (setsockopt(capture_sock, SOL_SOCKET, SO_ATTACH_FILTER,
+	               &prog, sizeof(prog)))
+		return -1;
+
+	filter_kernel = 1;
+	return 0;
+}
+
+
+#ifdef TPACKET3_HDRLEN
+/*
+ * TPACKET_V3 receive ring used for streaming: the kernel fills whole blocks
+ * of frames which are handed over in order, each block is written out and
+ * returned at once. Blocks are retired on a timeout and only partially
+ * filled under light traffic, so the ring mode keeps the copying ring which
+ * holds a fixed number of frames.
+ */
+struct mmap_ring {
+	uint8_t *map;
+	uint32_t block_size;
+	uint32_t block_nr;
+	uint32_t cur;            /* next block to be retired by the kernel */
+};
+
+struct tpacket_block_desc * mring_block(struct mmap_ring *m, uint32_t i)
+{
+	return (struct tpacket_block_desc *)
+		(m->map + (i % m->block_nr) * m->block_size);
+}
+
+int mring_init(struct mmap_ring *m, uint32_t size, uint32_t block_size)
+{
+	int ver = TPACKET_V3, err;
+	struct tpacket_req3 req;
+
+	memset(m, 0, sizeof(*m));
+	memset(&req, 0, sizeof(req));
+
+	if (setsockopt(capture_sock, SOL_PACKET, PACKET_VERSION,
+	               &ver, sizeof(ver)))
+		return -1;
+
+	req.tp_block_size = block_size;
+	req.tp_block_nr = size / block_size;
+	req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+	req.tp_retire_blk_tov = 100; /* ms */
+
+	if (req.tp_block_nr < 4)
+		req.tp_block_nr = 4;
+
+	req.tp_frame_nr = (block_size / req.tp_frame_size) * req.tp_block_nr;
+
+	if (setsockopt(capture_sock, SOL_PACKET, PACKET_RX_RING,
+	               &req, sizeof(req)))
+		goto fail;
+
+	m->map = mmap(NULL, req.tp_block_size * req.tp_block_nr,
+	              PROT_READ | PROT_WRITE, MAP_SHARED, capture_sock, 0);
+
+	if (m->map == MAP_FAILED)
+	{
+		err = errno;
+		memset(&req, 0, sizeof(req));
+		setsockopt(capture_sock, SOL_PACKET, PACKET_RX_RING,
+		           &req, sizeof(req));
+		errno = err;
+		goto fail;
+	}
+
+	m->block_size = req.tp_block_size;
+	m->block_nr = req.tp_block_nr;
+
+	return 0;
+
+fail:
+	err = errno;
+	ver = TPACKET_V1;
+	setsockopt(capture_sock, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver));
+	errno = err;
+	return -1;
+}
+
+void mring_free(struct mmap_ring *m)
+{
+	munmap(m->map, m->block_size * m->block_nr);
+	memset(m, 0, sizeof(*m));
+}
+
+void mring_release(struct tpacket_block_desc *b)
+{
+	__sync_synchronize();
+	b->hdr.bh1.block_status = TP_STATUS_KERNEL;
+}
+
+#define mring_foreach_frame(b, h, i) \
+	for (i = 0, h = (struct tpacket3_hdr *) \
+			((uint8_t *)(b) + (b)->hdr.bh1.offset_to_first_pkt); \
+	     i < (b)->hdr.bh1.num_pkts; \
+	     i++, h = (struct tpacket3_hdr *)((uint8_t *)h + h->tp_next_offset))
+
+void mring_write_block(struct tpacket_block_desc *b, FILE *o)
+{
+	struct tpacket3_hdr *h;
+	uint32_t i;
+	uint32_t sec, usec;
+
+	mring_foreach_frame(b, h, i)
+	{
+		frames_captured++;
+
+		if (filter_frame((uint8_t *)h + h->tp_mac, h->tp_snaplen))
+		{
+			frames_filtered++;
+			continue;
+		}
+
+		sec  = h->tp_sec;
+		usec = h->tp_nsec / 1000;
+
+		write_pcap_frame(o, &sec, &usec, h->tp_snaplen, h->tp_len);
+		fwrite((uint8_t *)h + h->tp_mac, 1, h->tp_snaplen, o);
+	}
+}
+
+/* write out all blocks the kernel has retired so far */
+void mring_poll(struct mmap_ring *m, FILE *stream)
+{
+	struct tpacket_block_desc *b;
+
+	while (1)
+	{
+		b = mring_block(m, m->cur);
+
+		if (!(b->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
+
+		__sync_synchronize();
+		mring_write_block(b, stream);
+		mring_release(b);
+		m->cur = (m->cur + 1) % m->block_nr;
+	}
+
+	fflush(stream);
+}
+#endif
+
+
 void msg(const char *fmt, ...)
 {
 	va_list ap;
@@ -267,31 +687,67 @@ void msg(const char *fmt, ...)
 }
 
 
-int main(int argc, char **argv)
+void dump_ring(const char *output, struct ringbuf *ring)
 {
+	FILE *o;
 	int i, n;
-	struct ringbuf *ring;
+	struct ringbuf_entry *e;
+
+	msg("Dumping ring to %s ...\n", output);
+
+	if (!(o = fopen(output, "w")))
+	{
+		msg("Unable to open %s: %s\n",
+			output, strerror(errno));
+		return;
+	}
+
+	write_pcap_header(o);
+
+	/* sig_dump packet buffer */
+	for (i = 0, n = 0; i < ring->len; i++)
+	{
+		if (!(e = ringbuf_get(ring, i)))
+			continue;
+
+		write_pcap_frame(o, &(e->sec), &(e->usec), e->len, e->olen);
+		fwrite((void *)e + sizeof(*e), 1, e->len, o);
+		n++;
+	}
+
+	fclose(o);
+
+	msg(" * %d frames captured\n", frames_captured);
+	if (!filter_kernel)
+		msg(" * %d frames filtered\n", frames_filtered);
+	msg(" * %d frames dumped\n", n);
+}
+
+int main(int argc, char **argv)
+{
+	struct ringbuf *ring = NULL;
 	struct ringbuf_entry *e;
 	struct sockaddr_ll local = {
 		.sll_family   = AF_PACKET,
 		.sll_protocol = htons(ETH_P_ALL)
 	};
 
-	radiotap_hdr_t *rhdr;
+#ifdef TPACKET3_HDRLEN
+	struct mmap_ring mring_buf;
+	struct mmap_ring *mring = NULL;
+	struct pollfd pfd;
+#endif
 
-	uint8_t frametype;
 	uint8_t pktbuf[0xFFFF];
 	ssize_t pktlen;
 
-	FILE *o;
-
 	int opt;
+	char *end;
 
 	uint8_t promisc        = 0;
 	uint8_t streaming      = 0;
 	uint8_t foreground     = 0;
-	uint8_t filter_data    = 0;
-	uint8_t filter_beacon  = 0;
+	uint8_t legacy         = 0;
 	uint8_t header_written = 0;
 
 	uint32_t ringsz   = 1024 * 1024; /* 1 Mbyte ring buffer */
@@ -300,7 +756,7 @@ int main(int argc, char **argv)
 	const char *output = NULL;
 
 
-	while ((opt = getopt(argc, argv, "i:r:c:o:sfhBD")) != -1)
+	while ((opt = getopt(argc, argv, "i:r:c:o:sfhlBDt:b:m:")) != -1)
 	{
 		switch (opt)
 		{
@@ -350,15 +806,51 @@ int main(int argc, char **argv)
 			filter_data = 1;
 			break;
 
+		case 't':
+			filter_subtype = strtoul(optarg, &end, 0);
+			if (*end || filter_subtype > 0xFF ||
+			    (filter_subtype & ~FRAMETYPE_MASK))
+			{
+				msg("Invalid frame type '%s'\n", optarg);
+				return 1;
+			}
+			break;
+
+		case 'b':
+			if (sscanf(optarg, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+			           &filter_bssid[0], &filter_bssid[1], &filter_bssid[2],
+			           &filter_bssid[3], &filter_bssid[4], &filter_bssid[5]) != 6)
+			{
+				msg("Invalid BSSID '%s'\n", optarg);
+				return 1;
+			}
+			filter_bssid_set = 1;
+			break;
+
+		case 'm':
+			filter_rssi = strtol(optarg, &end, 10);
+			if (*end || filter_rssi < -128 || filter_rssi > 127)
+			{
+				msg("Invalid signal level '%s'\n", optarg);
+				return 1;
+			}
+			filter_rssi_set = 1;
+			break;
+
 		case 'f':
 			foreground = 1;
 			break;
 
+		case 'l':
+			legacy = 1;
+			break;
+
 		case 'h':
 			msg(
 				"Usage:\n"
-				"  %s -i {iface} -s [-b] [-d]\n"
-				"  %s -i {iface} -o {file} [-r len] [-c len] [-B] [-D] [-f]\n"
+				"  %s -i {iface} -s [-B] [-D] [-t type] [-b bssid] [-m dBm] [-l]\n"
+				"  %s -i {iface} -o {file} [-r len] [-c len] [-B] [-D]\n"
+				"      [-t type] [-b bssid] [-m dBm] [-f] [-l]\n"
 				"\n"
 				"  -i iface\n"
 				"    Specify interface to use, must be in monitor mode and\n"
@@ -378,8 +870,19 @@ int main(int argc, char **argv)
 				"    Don't store beacon frames in ring, default is keep.\n\n"
 				"  -D\n"
 				"    Don't store data frames in ring, default is keep.\n\n"
+				"  -t type\n"
+				"    Only keep frames with the given frame control type and\n"
+				"    subtype byte, e.g. 0x40 for probe requests.\n\n"
+				"  -b bssid\n"
+				"    Only keep management and data frames of the given BSSID.\n\n"
+				"  -m dBm\n"
+				"    Only keep frames received with at least the given signal\n"
+				"    strength, frames without radiotap signal are dropped.\n\n"
 				"  -f\n"
 				"    Do not daemonize but keep running in foreground.\n\n"
+				"  -l\n"
+				"    Stream frames one by one instead of using a memory\n"
+				"    mapped TPACKET_V3 ring shared with the kernel.\n\n"
 				"  -h\n"
 				"    Display this help.\n\n",
 				argv[0], argv[0], ringsz, pktcap);
@@ -465,8 +968,11 @@ int main(int argc, char **argv)
 				strerror(errno));
 			return 5;
 		}
+		else
+		{
+			msg(" * Using %d bytes ringbuffer with %d slots\n", ringsz, ring->len);
+		}
 
-		msg(" * Using %d bytes ringbuffer with %d slots\n", ringsz, ring->len);
 		msg(" * Truncating frames at %d bytes\n", pktcap);
 		msg(" * Dumping data to file %s\n", output);
 
@@ -475,12 +981,53 @@ int main(int argc, char **argv)
 	else
 	{
 		msg("Monitoring interface %s ...\n", ifname);
+
+#ifdef TPACKET3_HDRLEN
+		if (!legacy && !mring_init(&mring_buf, ringsz, 128 * 1024))
+		{
+			mring = &mring_buf;
+
+			/* blocks are written out in one go */
+			setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
+			msg(" * Using %d bytes TPACKET_V3 ring with %d blocks\n",
+				mring->block_size * mring->block_nr, mring->block_nr);
+		}
+		else if (!legacy)
+		{
+			msg(" * TPACKET_V3 ring unavailable (%s), copying frames\n",
+				strerror(errno));
+		}
+#endif
+
 		msg(" * Streaming data to stdout\n");
 	}
 
+	if (attach_filter(0xFFFF))
+	{
+		if (filter_subtype >= 0 || filter_bssid_set || filter_rssi_set)
+		{
+			msg("Unable to attach socket filter: %s\n", strerror(errno));
+			return 9;
+		}
+
+		msg(" * Filtering frames in userspace\n");
+	}
+
 	msg(" * Beacon frames are %sfiltered\n", filter_beacon ? "" : "not ");
 	msg(" * Data frames are %sfiltered\n", filter_data ? "" : "not ");
 
+	if (filter_subtype >= 0)
+		msg(" * Only frames of type 0x%02x are kept\n", filter_subtype);
+
+	if (filter_bssid_set)
+		msg(" * Only frames of BSSID %02x:%02x:%02x:%02x:%02x:%02x are kept\n",
+			filter_bssid[0], filter_bssid[1], filter_bssid[2],
+			filter_bssid[3], filter_bssid[4], filter_bssid[5]);
+
+	if (filter_rssi_set)
+		msg(" * Only frames of at least %d dBm are kept\n", filter_rssi);
+
 	signal(SIGINT, sig_teardown);
 	signal(SIGTERM, sig_teardown);
 
@@ -499,58 +1046,49 @@ int main(int argc, char **argv)
 			if (ring)
 				ringbuf_free(ring);
 
+#ifdef TPACKET3_HDRLEN
+			if (mring)
+				mring_free(mring);
+#endif
+
 			return 0;
 		}
 		else if (run_dump)
 		{
-			msg("Dumping ring to %s ...\n", output);
-
-			if (!(o = fopen(output, "w")))
-			{
-				msg("Unable to open %s: %s\n",
-					output, strerror(errno));
-			}
-			else
-			{
-				write_pcap_header(o);
-
-				/* sig_dump packet buffer */
-				for (i = 0, n = 0; i < ring->len; i++)
-				{
-					if (!(e = ringbuf_get(ring, i)))
-						continue;
+			dump_ring(output, ring);
+			run_dump = 0;
+		}
 
-					write_pcap_frame(o, &(e->sec), &(e->usec), e->len, e->olen);
-					fwrite((void *)e + sizeof(*e), 1, e->len, o);
-					n++;
-				}
+		if (streaming && !header_written)
+		{
+			write_pcap_header(stdout);
+			header_written = 1;
+		}
 
-				fclose(o);
+#ifdef TPACKET3_HDRLEN
+		if (mring)
+		{
+			mring_poll(mring, stdout);
 
-				msg(" * %d frames captured\n", frames_captured);
-				msg(" * %d frames filtered\n", frames_filtered);
-				msg(" * %d frames dumped\n", n);
-			}
+			pfd.fd = capture_sock;
+			pfd.events = POLLIN | POLLERR;
+			pfd.revents = 0;
 
-			run_dump = 0;
+			/* interrupted by signals to handle shutdown */
+			poll(&pfd, 1, -1);
+			continue;
 		}
+#endif
 
 		pktlen = recvfrom(capture_sock, pktbuf, sizeof(pktbuf), 0, NULL, 0);
-		frames_captured++;
-
-		/* check received frametype, if we should filter it, rewind the ring */
-		rhdr = (radiotap_hdr_t *)pktbuf;
 
-		if (pktlen <= sizeof(radiotap_hdr_t) || le16(rhdr->it_len) >= pktlen)
-		{
-			frames_filtered++;
+		if (pktlen < 0)
 			continue;
-		}
 
-		frametype = *(uint8_t *)(pktbuf + le16(rhdr->it_len));
+		frames_captured++;
 
-		if ((filter_data   && (frametype & FRAMETYPE_MASK) == FRAMETYPE_DATA) ||
-		    (filter_beacon && (frametype & FRAMETYPE_MASK) == FRAMETYPE_BEACON))
+		/* check received frametype, if we should filter it, rewind the ring */
+		if (filter_frame(pktbuf, pktlen))
 		{
 			frames_filtered++;
 			continue;
@@ -558,12 +1096,6 @@ int main(int argc, char **argv)
 
 		if (streaming)
 		{
-			if (!header_written)
-			{
-				write_pcap_header(stdout);
-				header_written = 1;
-			}
-
 			write_pcap_frame(stdout, NULL, NULL, pktlen, pktlen);
 			fwrite(pktbuf, 1, pktlen, stdout);
 			fflush(stdout);
@@ -112,6 +112,23 @@ struct iwinfo_scanlist_entry {
 	uint8_t quality;
 	uint8_t quality_max;
 	struct iwinfo_crypto_entry crypto;
+	uint32_t age;
+};
+
+struct iwinfo_info {
+	int mode;
+	int channel;
+	int frequency;
+	int txpower;
+	int bitrate;
+	int signal;
+	int noise;
+	int quality;
+	int quality_max;
+	char ssid[IWINFO_ESSID_MAX_SIZE+1];
+	char bssid[18];
+	uint8_t crypto_valid;
+	struct iwinfo_crypto_entry crypto;
 };
 
 struct iwinfo_country_entry {
@@ -171,8 +188,10 @@ struct iwinfo_ops {
 	int (*assoclist)(const char *, char *, int *);
 	int (*txpwrlist)(const char *, char *, int *);
 	int (*scanlist)(const char *, char *, int *);
+	int (*scanlist_cached)(const char *, int, char *, int *);
 	int (*freqlist)(const char *, char *, int *);
 	int (*countrylist)(const char *, char *, int *);
+	int (*info)(const char *, struct iwinfo_info *);
 	void (*close)(void);
 };
 
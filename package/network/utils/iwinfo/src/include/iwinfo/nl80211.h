@@ -87,12 +87,14 @@ int nl80211_get_phyname(const char *ifname, char *buf);
 int nl80211_get_assoclist(const char *ifname, char *buf, int *len);
 int nl80211_get_txpwrlist(const char *ifname, char *buf, int *len);
 int nl80211_get_scanlist(const char *ifname, char *buf, int *len);
+int nl80211_get_scanlist_cached(const char *ifname, int max_age, char *buf, int *len);
 int nl80211_get_freqlist(const char *ifname, char *buf, int *len);
 int nl80211_get_countrylist(const char *ifname, char *buf, int *len);
 int nl80211_get_hwmodelist(const char *ifname, int *buf);
 int nl80211_get_mbssid_support(const char *ifname, int *buf);
 int nl80211_get_hardware_id(const char *ifname, char *buf);
 int nl80211_get_hardware_name(const char *ifname, char *buf);
+int nl80211_get_info(const char *ifname, struct iwinfo_info *buf);
 void nl80211_close(void);
 
 static const struct iwinfo_ops nl80211_ops = {
@@ -119,8 +121,10 @@ static const struct iwinfo_ops nl80211_ops = {
 	.assoclist        = nl80211_get_assoclist,
 	.txpwrlist        = nl80211_get_txpwrlist,
 	.scanlist         = nl80211_get_scanlist,
+	.scanlist_cached  = nl80211_get_scanlist_cached,
 	.freqlist         = nl80211_get_freqlist,
 	.countrylist      = nl80211_get_countrylist,
+	.info             = nl80211_get_info,
 	.close            = nl80211_close
 };
 
@@ -523,28 +523,69 @@ static char * print_phyname(const struct iwinfo_ops *iw, const char *ifname)
 }
 
 
-static void print_info(const struct iwinfo_ops *iw, const char *ifname)
+static void print_info_batched(const struct iwinfo_ops *iw, const char *ifname,
+                               struct iwinfo_info *info)
 {
+	int off;
+
+	if (iw->txpower_offset(ifname, &off))
+		off = 0;
+
 	printf("%-9s ESSID: %s\n",
 		ifname,
-		print_ssid(iw, ifname));
+		format_ssid(info->ssid));
 	printf("          Access Point: %s\n",
-		print_bssid(iw, ifname));
+		info->bssid[0] ? info->bssid : "00:00:00:00:00:00");
 	printf("          Mode: %s  Channel: %s (%s)\n",
-		print_mode(iw, ifname),
-		print_channel(iw, ifname),
-		print_frequency(iw, ifname));
+		IWINFO_OPMODE_NAMES[info->mode],
+		format_channel(info->channel),
+		format_frequency(info->frequency));
 	printf("          Tx-Power: %s  Link Quality: %s/%s\n",
-		print_txpower(iw, ifname),
-		print_quality(iw, ifname),
-		print_quality_max(iw, ifname));
+		format_txpower((info->txpower < 0) ? -1 : (info->txpower + off)),
+		format_quality(info->quality),
+		format_quality_max(info->quality_max));
 	printf("          Signal: %s  Noise: %s\n",
-		print_signal(iw, ifname),
-		print_noise(iw, ifname));
+		format_signal(info->signal),
+		format_noise(info->noise));
 	printf("          Bit Rate: %s\n",
-		print_rate(iw, ifname));
+		format_rate(info->bitrate));
 	printf("          Encryption: %s\n",
-		print_encryption(iw, ifname));
+		format_encryption(info->crypto_valid ? &info->crypto : NULL));
+}
+
+static void print_info(const struct iwinfo_ops *iw, const char *ifname)
+{
+	struct iwinfo_info info;
+
+	/* prefer a single batched query if the backend supports it */
+	if (iw->info && !iw->info(ifname, &info))
+	{
+		print_info_batched(iw, ifname, &info);
+	}
+	else
+	{
+		printf("%-9s ESSID: %s\n",
+			ifname,
+			print_ssid(iw, ifname));
+		printf("          Access Point: %s\n",
+			print_bssid(iw, ifname));
+		printf("          Mode: %s  Channel: %s (%s)\n",
+			print_mode(iw, ifname),
+			print_channel(iw, ifname),
+			print_frequency(iw, ifname));
+		printf("          Tx-Power: %s  Link Quality: %s/%s\n",
+			print_txpower(iw, ifname),
+			print_quality(iw, ifname),
+			print_quality_max(iw, ifname));
+		printf("          Signal: %s  Noise: %s\n",
+			print_signal(iw, ifname),
+			print_noise(iw, ifname));
+		printf("          Bit Rate: %s\n",
+			print_rate(iw, ifname));
+		printf("          Encryption: %s\n",
+			print_encryption(iw, ifname));
+	}
+
 	printf("          Type: %s  HW Mode(s): %s\n",
 		print_type(iw, ifname),
 		print_hwmodes(iw, ifname));
@@ -561,13 +602,19 @@ static void print_info(const struct iwinfo_ops *iw, const char *ifname)
 }
 
 
-static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname)
+static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname,
+                           int max_age)
 {
-	int i, x, len;
+	int i, x, len, rv;
 	char buf[IWINFO_BUFSIZE];
 	struct iwinfo_scanlist_entry *e;
 
-	if (iw->scanlist(ifname, buf, &len))
+	if ((max_age >= 0) && iw->scanlist_cached)
+		rv = iw->scanlist_cached(ifname, max_age, buf, &len);
+	else
+		rv = iw->scanlist(ifname, buf, &len);
+
+	if (rv)
 	{
 		printf("Scanning not possible\n\n");
 		return;
@@ -594,8 +641,13 @@ static void print_scanlist(const struct iwinfo_ops *iw, const char *ifname)
 			format_signal(e->signal - 0x100),
 			format_quality(e->quality),
 			format_quality_max(e->quality_max));
-		printf("          Encryption: %s\n\n",
+		printf("          Encryption: %s\n",
 			format_encryption(&e->crypto));
+
+		if ((max_age >= 0) && iw->scanlist_cached)
+			printf("          Last seen: %u s ago\n", e->age);
+
+		printf("\n");
 	}
 }
 
@@ -757,6 +809,7 @@ int main(int argc, char **argv)
 			"Usage:\n"
 			"	iwinfo <device> info\n"
 			"	iwinfo <device> scan\n"
+			"	iwinfo <device> lastscan [<max age>]\n"
 			"	iwinfo <device> txpowerlist\n"
 			"	iwinfo <device> freqlist\n"
 			"	iwinfo <device> assoclist\n"
@@ -807,7 +860,15 @@ int main(int argc, char **argv)
 			break;
 
 		case 's':
-			print_scanlist(iw, argv[1]);
+			print_scanlist(iw, argv[1], -1);
+			break;
+
+		case 'l':
+			/* reuse results up to <max age> seconds old, default 30 */
+			if ((i + 1 < argc) && isdigit(argv[i + 1][0]))
+				print_scanlist(iw, argv[1], atoi(argv[++i]));
+			else
+				print_scanlist(iw, argv[1], 30);
 			break;
 
 		case 't':
@@ -248,6 +248,89 @@ static int iwinfo_L_mode(lua_State *L, int (*func)(const char *, int *))
 	return 1;
 }
 
+/* Wrapper for batched info */
+static int iwinfo_L_info(lua_State *L, int (*func)(const char *, struct iwinfo_info *))
+{
+	struct iwinfo_info info;
+	const char *ifname = luaL_checkstring(L, 1);
+
+	if ((*func)(ifname, &info))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_newtable(L);
+
+	lua_pushstring(L, IWINFO_OPMODE_NAMES[info.mode]);
+	lua_setfield(L, -2, "mode");
+
+	if (info.ssid[0])
+	{
+		lua_pushstring(L, info.ssid);
+		lua_setfield(L, -2, "ssid");
+	}
+
+	if (info.bssid[0])
+	{
+		lua_pushstring(L, info.bssid);
+		lua_setfield(L, -2, "bssid");
+	}
+
+	if (info.channel > 0)
+	{
+		lua_pushnumber(L, info.channel);
+		lua_setfield(L, -2, "channel");
+	}
+
+	if (info.frequency > 0)
+	{
+		lua_pushnumber(L, info.frequency);
+		lua_setfield(L, -2, "frequency");
+	}
+
+	if (info.txpower >= 0)
+	{
+		lua_pushnumber(L, info.txpower);
+		lua_setfield(L, -2, "txpower");
+	}
+
+	if (info.bitrate > 0)
+	{
+		lua_pushnumber(L, info.bitrate);
+		lua_setfield(L, -2, "bitrate");
+	}
+
+	if (info.signal)
+	{
+		lua_pushnumber(L, info.signal);
+		lua_setfield(L, -2, "signal");
+	}
+
+	if (info.noise)
+	{
+		lua_pushnumber(L, info.noise);
+		lua_setfield(L, -2, "noise");
+	}
+
+	if (info.quality >= 0)
+	{
+		lua_pushnumber(L, info.quality);
+		lua_setfield(L, -2, "quality");
+	}
+
+	lua_pushnumber(L, info.quality_max);
+	lua_setfield(L, -2, "quality_max");
+
+	if (info.crypto_valid)
+	{
+		iwinfo_L_cryptotable(L, &info.crypto);
+		lua_setfield(L, -2, "encryption");
+	}
+
+	return 1;
+}
+
 /* Wrapper for assoclist */
 static int iwinfo_L_assoclist(lua_State *L, int (*func)(const char *, char *, int *))
 {
@@ -360,65 +443,95 @@ static int iwinfo_L_txpwrlist(lua_State *L, int (*func)(const char *, char *, in
 }
 
 /* Wrapper for scan list */
-static int iwinfo_L_scanlist(lua_State *L, int (*func)(const char *, char *, int *))
+static void iwinfo_L_scantable(lua_State *L, char *rv, int len, int with_age)
 {
-	int i, x, len;
-	char rv[IWINFO_BUFSIZE];
+	int i, x;
 	char macstr[18];
-	const char *ifname = luaL_checkstring(L, 1);
 	struct iwinfo_scanlist_entry *e;
 
-	lua_newtable(L);
-	memset(rv, 0, sizeof(rv));
-
-	if (!(*func)(ifname, rv, &len))
+	for (i = 0, x = 1; i < len; i += sizeof(struct iwinfo_scanlist_entry), x++)
 	{
-		for (i = 0, x = 1; i < len; i += sizeof(struct iwinfo_scanlist_entry), x++)
-		{
-			e = (struct iwinfo_scanlist_entry *) &rv[i];
+		e = (struct iwinfo_scanlist_entry *) &rv[i];
 
-			lua_newtable(L);
+		lua_newtable(L);
 
-			/* BSSID */
-			sprintf(macstr, "%02X:%02X:%02X:%02X:%02X:%02X",
-				e->mac[0], e->mac[1], e->mac[2],
-				e->mac[3], e->mac[4], e->mac[5]);
+		/* BSSID */
+		sprintf(macstr, "%02X:%02X:%02X:%02X:%02X:%02X",
+			e->mac[0], e->mac[1], e->mac[2],
+			e->mac[3], e->mac[4], e->mac[5]);
 
-			lua_pushstring(L, macstr);
-			lua_setfield(L, -2, "bssid");
+		lua_pushstring(L, macstr);
+		lua_setfield(L, -2, "bssid");
 
-			/* ESSID */
-			if (e->ssid[0])
-			{
-				lua_pushstring(L, (char *) e->ssid);
-				lua_setfield(L, -2, "ssid");
-			}
+		/* ESSID */
+		if (e->ssid[0])
+		{
+			lua_pushstring(L, (char *) e->ssid);
+			lua_setfield(L, -2, "ssid");
+		}
 
-			/* Channel */
-			lua_pushinteger(L, e->channel);
-			lua_setfield(L, -2, "channel");
+		/* Channel */
+		lua_pushinteger(L, e->channel);
+		lua_setfield(L, -2, "channel");
 
-			/* Mode */
-			lua_pushstring(L, IWINFO_OPMODE_NAMES[e->mode]);
-			lua_setfield(L, -2, "mode");
+		/* Mode */
+		lua_pushstring(L, IWINFO_OPMODE_NAMES[e->mode]);
+		lua_setfield(L, -2, "mode");
 
-			/* Quality, Signal */
-			lua_pushinteger(L, e->quality);
-			lua_setfield(L, -2, "quality");
+		/* Quality, Signal */
+		lua_pushinteger(L, e->quality);
+		lua_setfield(L, -2, "quality");
 
-			lua_pushinteger(L, e->quality_max);
-			lua_setfield(L, -2, "quality_max");
+		lua_pushinteger(L, e->quality_max);
+		lua_setfield(L, -2, "quality_max");
 
-			lua_pushnumber(L, (e->signal - 0x100));
-			lua_setfield(L, -2, "signal");
+		lua_pushnumber(L, (e->signal - 0x100));
+		lua_setfield(L, -2, "signal");
 
-			/* Crypto */
-			iwinfo_L_cryptotable(L, &e->crypto);
-			lua_setfield(L, -2, "encryption");
+		/* Crypto */
+		iwinfo_L_cryptotable(L, &e->crypto);
+		lua_setfield(L, -2, "encryption");
 
-			lua_rawseti(L, -2, x);
+		/* Age */
+		if (with_age)
+		{
+			lua_pushinteger(L, e->age);
+			lua_setfield(L, -2, "age");
 		}
+
+		lua_rawseti(L, -2, x);
 	}
+}
+
+static int iwinfo_L_scanlist(lua_State *L, int (*func)(const char *, char *, int *))
+{
+	int len;
+	char rv[IWINFO_BUFSIZE];
+	const char *ifname = luaL_checkstring(L, 1);
+
+	lua_newtable(L);
+	memset(rv, 0, sizeof(rv));
+
+	if (!(*func)(ifname, rv, &len))
+		iwinfo_L_scantable(L, rv, len, 0);
+
+	return 1;
+}
+
+/* Wrapper for scan list reusing recent results */
+static int iwinfo_L_scanlist_cached(lua_State *L,
+	int (*func)(const char *, int, char *, int *))
+{
+	int len;
+	char rv[IWINFO_BUFSIZE];
+	const char *ifname = luaL_checkstring(L, 1);
+	int max_age = luaL_optinteger(L, 2, 30);
+
+	lua_newtable(L);
+	memset(rv, 0, sizeof(rv));
+
+	if (!(*func)(ifname, max_age, rv, &len))
+		iwinfo_L_scantable(L, rv, len, 1);
 
 	return 1;
 }
@@ -694,6 +807,8 @@ LUA_WRAP_STRUCT(nl80211,hwmodelist)
 LUA_WRAP_STRUCT(nl80211,encryption)
 LUA_WRAP_STRUCT(nl80211,mbssid_support)
 LUA_WRAP_STRUCT(nl80211,hardware_id)
+LUA_WRAP_STRUCT(nl80211,info)
+LUA_WRAP_STRUCT(nl80211,scanlist_cached)
 #endif
 
 /* Wext */
@@ -815,6 +930,8 @@ static const luaL_reg R_nl80211[] = {
 	LUA_REG(nl80211,hardware_id),
 	LUA_REG(nl80211,hardware_name),
 	LUA_REG(nl80211,phyname),
+	LUA_REG(nl80211,info),
+	LUA_REG(nl80211,scanlist_cached),
 	{ NULL, NULL }
 };
 #endif
@@ -453,17 +453,13 @@ static char * nl80211_ifname2phy(const char *ifname)
 	return phy[0] ? phy : NULL;
 }
 
-static char * nl80211_hostapd_info(const char *ifname)
+static char * nl80211_hostapd_conf(const char *ifname, int mode)
 {
-	int mode;
 	char *phy;
 	char path[32] = { 0 };
 	static char buf[4096] = { 0 };
 	FILE *conf;
 
-	if (nl80211_get_mode(ifname, &mode))
-		return NULL;
-
 	if ((mode == IWINFO_OPMODE_MASTER || mode == IWINFO_OPMODE_AP_VLAN) &&
 	    (phy = nl80211_ifname2phy(ifname)) != NULL)
 	{
@@ -481,6 +477,16 @@ static char * nl80211_hostapd_info(const char *ifname)
 	return NULL;
 }
 
+static char * nl80211_hostapd_info(const char *ifname)
+{
+	int mode;
+
+	if (nl80211_get_mode(ifname, &mode))
+		return NULL;
+
+	return nl80211_hostapd_conf(ifname, mode);
+}
+
 static inline int nl80211_wpactl_recv(int sock, char *buf, int blen)
 {
 	fd_set rfds;
@@ -823,6 +829,9 @@ static int nl80211_get_ssid_bssid_cb(struct nl_msg *msg, void *arg)
 	case NL80211_BSS_STATUS_AUTHENTICATED:
 	case NL80211_BSS_STATUS_IBSS_JOINED:
 
+		sb->bssid[0] = 1;
+		memcpy(sb->bssid + 1, nla_data(bss[NL80211_BSS_BSSID]), 6);
+
 		if (sb->ssid)
 		{
 			ie = nla_data(bss[NL80211_BSS_INFORMATION_ELEMENTS]);
@@ -840,12 +849,8 @@ static int nl80211_get_ssid_bssid_cb(struct nl_msg *msg, void *arg)
 				ie += ie[1] + 2;
 			}
 		}
-		else
-		{
-			sb->bssid[0] = 1;
-			memcpy(sb->bssid + 1, nla_data(bss[NL80211_BSS_BSSID]), 6);
-			return NL_SKIP;
-		}
+
+		return NL_SKIP;
 
 	default:
 		return NL_SKIP;
@@ -863,6 +868,7 @@ int nl80211_get_ssid(const char *ifname, char *buf)
 	req = nl80211_msg(res ? res : ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP);
 
 	sb.ssid = buf;
+	sb.bssid[0] = 0;
 	*buf = 0;
 
 	if (req)
@@ -1209,32 +1215,31 @@ int nl80211_get_noise(const char *ifname, int *buf)
 	return -1;
 }
 
+static int nl80211_signal2quality(int signal)
+{
+	/* A positive signal level is usually just a quality
+	 * value, pass through as-is */
+	if (signal >= 0)
+		return signal;
+
+	/* The cfg80211 wext compat layer assumes a signal range
+	 * of -110 dBm to -40 dBm, the quality value is derived
+	 * by adding 110 to the signal level */
+	if (signal < -110)
+		signal = -110;
+	else if (signal > -40)
+		signal = -40;
+
+	return (signal + 110);
+}
+
 int nl80211_get_quality(const char *ifname, int *buf)
 {
 	int signal;
 
 	if (!nl80211_get_signal(ifname, &signal))
 	{
-		/* A positive signal level is usually just a quality
-		 * value, pass through as-is */
-		if (signal >= 0)
-		{
-			*buf = signal;
-		}
-
-		/* The cfg80211 wext compat layer assumes a signal range
-		 * of -110 dBm to -40 dBm, the quality value is derived
-		 * by adding 110 to the signal level */
-		else
-		{
-			if (signal < -110)
-				signal = -110;
-			else if (signal > -40)
-				signal = -40;
-
-			*buf = (signal + 110);
-		}
-
+		*buf = nl80211_signal2quality(signal);
 		return 0;
 	}
 
@@ -1250,163 +1255,181 @@ int nl80211_get_quality_max(const char *ifname, int *buf)
 	return 0;
 }
 
-int nl80211_get_encryption(const char *ifname, char *buf)
+static int nl80211_get_encryption_wpactl(char *res,
+                                         struct iwinfo_crypto_entry *c)
 {
-	int i;
-	char k[9];
-	char *val, *res;
-	struct iwinfo_crypto_entry *c = (struct iwinfo_crypto_entry *)buf;
+	char *val;
 
-	/* WPA supplicant */
-	if ((res = nl80211_wpactl_info(ifname, "STATUS", NULL)) &&
-	    (val = nl80211_getval(NULL, res, "pairwise_cipher")))
+	if (!(val = nl80211_getval(NULL, res, "pairwise_cipher")))
+		return -1;
+
+	/* WEP */
+	if (strstr(val, "WEP"))
 	{
-		/* WEP */
-		if (strstr(val, "WEP"))
-		{
-			if (strstr(val, "WEP-40"))
-				c->pair_ciphers |= IWINFO_CIPHER_WEP40;
+		if (strstr(val, "WEP-40"))
+			c->pair_ciphers |= IWINFO_CIPHER_WEP40;
 
-			else if (strstr(val, "WEP-104"))
-				c->pair_ciphers |= IWINFO_CIPHER_WEP104;
+		else if (strstr(val, "WEP-104"))
+			c->pair_ciphers |= IWINFO_CIPHER_WEP104;
 
-			c->enabled       = 1;
-			c->group_ciphers = c->pair_ciphers;
+		c->enabled       = 1;
+		c->group_ciphers = c->pair_ciphers;
 
-			c->auth_suites |= IWINFO_KMGMT_NONE;
-			c->auth_algs   |= IWINFO_AUTH_OPEN; /* XXX: assumption */
-		}
+		c->auth_suites |= IWINFO_KMGMT_NONE;
+		c->auth_algs   |= IWINFO_AUTH_OPEN; /* XXX: assumption */
+	}
 
-		/* WPA */
-		else
+	/* WPA */
+	else
+	{
+		if (strstr(val, "TKIP"))
+			c->pair_ciphers |= IWINFO_CIPHER_TKIP;
+
+		else if (strstr(val, "CCMP"))
+			c->pair_ciphers |= IWINFO_CIPHER_CCMP;
+
+		else if (strstr(val, "NONE"))
+			c->pair_ciphers |= IWINFO_CIPHER_NONE;
+
+		else if (strstr(val, "WEP-40"))
+			c->pair_ciphers |= IWINFO_CIPHER_WEP40;
+
+		else if (strstr(val, "WEP-104"))
+			c->pair_ciphers |= IWINFO_CIPHER_WEP104;
+
+
+		if ((val = nl80211_getval(NULL, res, "group_cipher")))
 		{
 			if (strstr(val, "TKIP"))
-				c->pair_ciphers |= IWINFO_CIPHER_TKIP;
+				c->group_ciphers |= IWINFO_CIPHER_TKIP;
 
 			else if (strstr(val, "CCMP"))
-				c->pair_ciphers |= IWINFO_CIPHER_CCMP;
+				c->group_ciphers |= IWINFO_CIPHER_CCMP;
 
 			else if (strstr(val, "NONE"))
-				c->pair_ciphers |= IWINFO_CIPHER_NONE;
+				c->group_ciphers |= IWINFO_CIPHER_NONE;
 
 			else if (strstr(val, "WEP-40"))
-				c->pair_ciphers |= IWINFO_CIPHER_WEP40;
+				c->group_ciphers |= IWINFO_CIPHER_WEP40;
 
 			else if (strstr(val, "WEP-104"))
-				c->pair_ciphers |= IWINFO_CIPHER_WEP104;
+				c->group_ciphers |= IWINFO_CIPHER_WEP104;
+		}
 
 
-			if ((val = nl80211_getval(NULL, res, "group_cipher")))
-			{
-				if (strstr(val, "TKIP"))
-					c->group_ciphers |= IWINFO_CIPHER_TKIP;
+		if ((val = nl80211_getval(NULL, res, "key_mgmt")))
+		{
+			if (strstr(val, "WPA2"))
+				c->wpa_version = 2;
 
-				else if (strstr(val, "CCMP"))
-					c->group_ciphers |= IWINFO_CIPHER_CCMP;
+			else if (strstr(val, "WPA"))
+				c->wpa_version = 1;
 
-				else if (strstr(val, "NONE"))
-					c->group_ciphers |= IWINFO_CIPHER_NONE;
 
-				else if (strstr(val, "WEP-40"))
-					c->group_ciphers |= IWINFO_CIPHER_WEP40;
+			if (strstr(val, "PSK"))
+				c->auth_suites |= IWINFO_KMGMT_PSK;
 
-				else if (strstr(val, "WEP-104"))
-					c->group_ciphers |= IWINFO_CIPHER_WEP104;
-			}
+			else if (strstr(val, "EAP") || strstr(val, "802.1X"))
+				c->auth_suites |= IWINFO_KMGMT_8021x;
 
+			else if (strstr(val, "NONE"))
+				c->auth_suites |= IWINFO_KMGMT_NONE;
+		}
 
-			if ((val = nl80211_getval(NULL, res, "key_mgmt")))
-			{
-				if (strstr(val, "WPA2"))
-					c->wpa_version = 2;
+		c->enabled = (c->wpa_version && c->auth_suites) ? 1 : 0;
+	}
 
-				else if (strstr(val, "WPA"))
-					c->wpa_version = 1;
+	return 0;
+}
 
+static void nl80211_get_encryption_hostapd(const char *ifname, char *res,
+                                           struct iwinfo_crypto_entry *c)
+{
+	int i;
+	char k[9];
+	char *val;
 
-				if (strstr(val, "PSK"))
-					c->auth_suites |= IWINFO_KMGMT_PSK;
+	if ((val = nl80211_getval(ifname, res, "wpa")) != NULL)
+		c->wpa_version = atoi(val);
 
-				else if (strstr(val, "EAP") || strstr(val, "802.1X"))
-					c->auth_suites |= IWINFO_KMGMT_8021x;
+	val = nl80211_getval(ifname, res, "wpa_key_mgmt");
 
-				else if (strstr(val, "NONE"))
-					c->auth_suites |= IWINFO_KMGMT_NONE;
-			}
+	if (!val || strstr(val, "PSK"))
+		c->auth_suites |= IWINFO_KMGMT_PSK;
 
-			c->enabled = (c->wpa_version && c->auth_suites) ? 1 : 0;
-		}
+	if (val && strstr(val, "EAP"))
+		c->auth_suites |= IWINFO_KMGMT_8021x;
 
-		return 0;
-	}
+	if (val && strstr(val, "NONE"))
+		c->auth_suites |= IWINFO_KMGMT_NONE;
 
-	/* Hostapd */
-	else if ((res = nl80211_hostapd_info(ifname)))
+	if ((val = nl80211_getval(ifname, res, "wpa_pairwise")) != NULL)
 	{
-		if ((val = nl80211_getval(ifname, res, "wpa")) != NULL)
-			c->wpa_version = atoi(val);
-
-		val = nl80211_getval(ifname, res, "wpa_key_mgmt");
+		if (strstr(val, "TKIP"))
+			c->pair_ciphers |= IWINFO_CIPHER_TKIP;
 
-		if (!val || strstr(val, "PSK"))
-			c->auth_suites |= IWINFO_KMGMT_PSK;
+		if (strstr(val, "CCMP"))
+			c->pair_ciphers |= IWINFO_CIPHER_CCMP;
 
-		if (val && strstr(val, "EAP"))
-			c->auth_suites |= IWINFO_KMGMT_8021x;
+		if (strstr(val, "NONE"))
+			c->pair_ciphers |= IWINFO_CIPHER_NONE;
+	}
 
-		if (val && strstr(val, "NONE"))
-			c->auth_suites |= IWINFO_KMGMT_NONE;
+	if ((val = nl80211_getval(ifname, res, "auth_algs")) != NULL)
+	{
+		switch(atoi(val)) {
+			case 1:
+				c->auth_algs |= IWINFO_AUTH_OPEN;
+				break;
 
-		if ((val = nl80211_getval(ifname, res, "wpa_pairwise")) != NULL)
-		{
-			if (strstr(val, "TKIP"))
-				c->pair_ciphers |= IWINFO_CIPHER_TKIP;
+			case 2:
+				c->auth_algs |= IWINFO_AUTH_SHARED;
+				break;
 
-			if (strstr(val, "CCMP"))
-				c->pair_ciphers |= IWINFO_CIPHER_CCMP;
+			case 3:
+				c->auth_algs |= IWINFO_AUTH_OPEN;
+				c->auth_algs |= IWINFO_AUTH_SHARED;
+				break;
 
-			if (strstr(val, "NONE"))
-				c->pair_ciphers |= IWINFO_CIPHER_NONE;
+			default:
+				break;
 		}
 
-		if ((val = nl80211_getval(ifname, res, "auth_algs")) != NULL)
+		for (i = 0; i < 4; i++)
 		{
-			switch(atoi(val)) {
-				case 1:
-					c->auth_algs |= IWINFO_AUTH_OPEN;
-					break;
-
-				case 2:
-					c->auth_algs |= IWINFO_AUTH_SHARED;
-					break;
-
-				case 3:
-					c->auth_algs |= IWINFO_AUTH_OPEN;
-					c->auth_algs |= IWINFO_AUTH_SHARED;
-					break;
-
-				default:
-					break;
-			}
+			snprintf(k, sizeof(k), "wep_key%d", i);
 
-			for (i = 0; i < 4; i++)
+			if ((val = nl80211_getval(ifname, res, k)))
 			{
-				snprintf(k, sizeof(k), "wep_key%d", i);
+				if ((strlen(val) == 5) || (strlen(val) == 10))
+					c->pair_ciphers |= IWINFO_CIPHER_WEP40;
 
-				if ((val = nl80211_getval(ifname, res, k)))
-				{
-					if ((strlen(val) == 5) || (strlen(val) == 10))
-						c->pair_ciphers |= IWINFO_CIPHER_WEP40;
-
-					else if ((strlen(val) == 13) || (strlen(val) == 26))
-						c->pair_ciphers |= IWINFO_CIPHER_WEP104;
-				}
+				else if ((strlen(val) == 13) || (strlen(val) == 26))
+					c->pair_ciphers |= IWINFO_CIPHER_WEP104;
 			}
 		}
+	}
 
-		c->group_ciphers = c->pair_ciphers;
-		c->enabled = (c->wpa_version || c->pair_ciphers) ? 1 : 0;
+	c->group_ciphers = c->pair_ciphers;
+	c->enabled = (c->wpa_version || c->pair_ciphers) ? 1 : 0;
+}
 
+int nl80211_get_encryption(const char *ifname, char *buf)
+{
+	char *res;
+	struct iwinfo_crypto_entry *c = (struct iwinfo_crypto_entry *)buf;
+
+	/* WPA supplicant */
+	if ((res = nl80211_wpactl_info(ifname, "STATUS", NULL)) &&
+	    !nl80211_get_encryption_wpactl(res, c))
+	{
+		return 0;
+	}
+
+	/* Hostapd */
+	else if ((res = nl80211_hostapd_info(ifname)))
+	{
+		nl80211_get_encryption_hostapd(ifname, res, c);
 		return 0;
 	}
 
@@ -1825,6 +1848,9 @@ static int nl80211_get_scanlist_cb(struct nl_msg *msg, void *arg)
 		sl->e->quality_max = 70;
 	}
 
+	if (bss[NL80211_BSS_SEEN_MS_AGO])
+		sl->e->age = nla_get_u32(bss[NL80211_BSS_SEEN_MS_AGO]) / 1000;
+
 	if (sl->e->crypto.enabled && !sl->e->crypto.wpa_version)
 	{
 		sl->e->crypto.auth_algs    = IWINFO_AUTH_OPEN | IWINFO_AUTH_SHARED;
@@ -1837,29 +1863,36 @@ static int nl80211_get_scanlist_cb(struct nl_msg *msg, void *arg)
 	return NL_SKIP;
 }
 
-static int nl80211_get_scanlist_nl(const char *ifname, char *buf, int *len)
+static int nl80211_get_scanlist_dump(const char *ifname, char *buf, int *len)
 {
 	struct nl80211_msg_conveyor *req;
 	struct nl80211_scanlist sl = { .e = (struct iwinfo_scanlist_entry *)buf };
 
-	req = nl80211_msg(ifname, NL80211_CMD_TRIGGER_SCAN, 0);
+	req = nl80211_msg(ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP);
 	if (req)
 	{
-		nl80211_send(req, NULL, NULL);
+		nl80211_send(req, nl80211_get_scanlist_cb, &sl);
 		nl80211_free(req);
 	}
 
-	nl80211_wait("nl80211", "scan", NL80211_CMD_NEW_SCAN_RESULTS);
+	*len = sl.len * sizeof(struct iwinfo_scanlist_entry);
+	return *len ? 0 : -1;
+}
 
-	req = nl80211_msg(ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP);
+static int nl80211_get_scanlist_nl(const char *ifname, char *buf, int *len)
+{
+	struct nl80211_msg_conveyor *req;
+
+	req = nl80211_msg(ifname, NL80211_CMD_TRIGGER_SCAN, 0);
 	if (req)
 	{
-		nl80211_send(req, nl80211_get_scanlist_cb, &sl);
+		nl80211_send(req, NULL, NULL);
 		nl80211_free(req);
 	}
 
-	*len = sl.len * sizeof(struct iwinfo_scanlist_entry);
-	return *len ? 0 : -1;
+	nl80211_wait("nl80211", "scan", NL80211_CMD_NEW_SCAN_RESULTS);
+
+	return nl80211_get_scanlist_dump(ifname, buf, len);
 }
 
 int nl80211_get_scanlist(const char *ifname, char *buf, int *len)
@@ -2032,6 +2065,43 @@ int nl80211_get_scanlist(const char *ifname, char *buf, int *len)
 	return -1;
 }
 
+int nl80211_get_scanlist_cached(const char *ifname, int max_age,
+                                char *buf, int *len)
+{
+	int i, n, count;
+	char *res;
+	struct iwinfo_scanlist_entry *e;
+
+	/* Read the BSS table of an existing interface, never spawn one for it */
+	res = nl80211_phy2ifname(ifname);
+
+	if (!nl80211_get_scanlist_dump(res ? res : ifname, buf, len))
+	{
+		/* age out each entry on its own, keep the ones seen recently */
+		e = (struct iwinfo_scanlist_entry *)buf;
+		count = *len / sizeof(*e);
+
+		for (i = 0, n = 0; i < count; i++)
+		{
+			if ((max_age < 0) || (e[i].age > (uint32_t)max_age))
+				continue;
+
+			if (n != i)
+				memcpy(&e[n], &e[i], sizeof(*e));
+
+			n++;
+		}
+
+		*len = n * sizeof(*e);
+
+		if (n > 0)
+			return 0;
+	}
+
+	/* Stale or no results, do a full scan */
+	return nl80211_get_scanlist(ifname, buf, len);
+}
+
 static int nl80211_get_freqlist_cb(struct nl_msg *msg, void *arg)
 {
 	int bands_remain, freqs_remain;
@@ -2363,3 +2433,135 @@ int nl80211_get_frequency_offset(const char *ifname, int *buf)
 	*buf = hw->frequency_offset;
 	return 0;
 }
+
+
+struct nl80211_info_scan {
+	struct iwinfo_info *info;
+	struct nl80211_ssid_bssid sb;
+};
+
+static int nl80211_get_info_cb(struct nl_msg *msg, void *arg)
+{
+	struct iwinfo_info *info = arg;
+	struct nlattr **tb;
+
+	nl80211_get_mode_cb(msg, &info->mode);
+	nl80211_get_frequency_info_cb(msg, &info->frequency);
+
+	tb = nl80211_parse(msg);
+
+	if (tb[NL80211_ATTR_SSID])
+		memcpy(info->ssid, nla_data(tb[NL80211_ATTR_SSID]),
+		       min(nla_len(tb[NL80211_ATTR_SSID]), IWINFO_ESSID_MAX_SIZE));
+
+	return NL_SKIP;
+}
+
+static int nl80211_get_info_scan_cb(struct nl_msg *msg, void *arg)
+{
+	struct nl80211_info_scan *is = arg;
+
+	if (!is->info->frequency)
+		nl80211_get_frequency_scan_cb(msg, &is->info->frequency);
+
+	return nl80211_get_ssid_bssid_cb(msg, &is->sb);
+}
+
+int nl80211_get_info(const char *ifname, struct iwinfo_info *info)
+{
+	int8_t noise = 0;
+	char *res, *val, *conf = NULL;
+	struct nl80211_msg_conveyor *req;
+	struct nl80211_rssi_rate rr;
+	struct nl80211_info_scan is = { .info = info };
+
+	memset(info, 0, sizeof(*info));
+	info->mode = IWINFO_OPMODE_UNKNOWN;
+	info->txpower = -1;
+	info->quality = -1;
+	info->quality_max = 70;
+
+	/* mode, frequency and (on newer kernels) ssid in one request */
+	res = nl80211_phy2ifname(ifname);
+	req = nl80211_msg(res ? res : ifname, NL80211_CMD_GET_INTERFACE, 0);
+	if (req)
+	{
+		nl80211_send(req, nl80211_get_info_cb, info);
+		nl80211_free(req);
+	}
+
+	/* access points are described by the hostapd config, everything
+	 * else by the associated entry of the scan results */
+	if (info->mode == IWINFO_OPMODE_MASTER ||
+	    info->mode == IWINFO_OPMODE_AP_VLAN)
+	{
+		conf = nl80211_hostapd_conf(ifname, info->mode);
+	}
+	else
+	{
+		res = nl80211_phy2ifname(ifname);
+		req = nl80211_msg(res ? res : ifname, NL80211_CMD_GET_SCAN, NLM_F_DUMP);
+		if (req)
+		{
+			is.sb.ssid = info->ssid[0] ? NULL : (unsigned char *)info->ssid;
+			nl80211_send(req, nl80211_get_info_scan_cb, &is);
+			nl80211_free(req);
+		}
+	}
+
+	if (conf)
+	{
+		if (!info->ssid[0] && (val = nl80211_getval(ifname, conf, "ssid")))
+			strncpy(info->ssid, val, IWINFO_ESSID_MAX_SIZE);
+
+		if (!is.sb.bssid[0] && (val = nl80211_getval(ifname, conf, "bssid")))
+			strncpy(info->bssid, val, sizeof(info->bssid) - 1);
+
+		if (!info->frequency && (val = nl80211_getval(NULL, conf, "channel")))
+			info->frequency = nl80211_channel2freq(atoi(val),
+				nl80211_getval(NULL, conf, "hw_mode"));
+	}
+
+	if (is.sb.bssid[0])
+		snprintf(info->bssid, sizeof(info->bssid),
+		         "%02X:%02X:%02X:%02X:%02X:%02X",
+		         is.sb.bssid[1], is.sb.bssid[2], is.sb.bssid[3],
+		         is.sb.bssid[4], is.sb.bssid[5], is.sb.bssid[6]);
+
+	if (info->frequency)
+		info->channel = nl80211_freq2channel(info->frequency);
+
+	/* signal and bitrate from the station dump */
+	nl80211_fill_signal(ifname, &rr);
+	info->signal = rr.rssi;
+	info->bitrate = rr.rate * 100;
+
+	if (info->signal)
+		info->quality = nl80211_signal2quality(info->signal);
+
+	/* noise from the survey dump */
+	req = nl80211_msg(ifname, NL80211_CMD_GET_SURVEY, NLM_F_DUMP);
+	if (req)
+	{
+		nl80211_send(req, nl80211_get_noise_cb, &noise);
+		nl80211_free(req);
+		info->noise = noise;
+	}
+
+	if (wext_get_txpower(ifname, &info->txpower))
+		info->txpower = -1;
+
+	/* encryption, at most one control socket query */
+	if (conf)
+	{
+		nl80211_get_encryption_hostapd(ifname, conf, &info->crypto);
+		info->crypto_valid = 1;
+	}
+	else if ((res = nl80211_wpactl_info(ifname, "STATUS", NULL)) &&
+	         !nl80211_get_encryption_wpactl(res, &info->crypto))
+	{
+		info->crypto_valid = 1;
+	}
+
+	return (info->mode == IWINFO_OPMODE_UNKNOWN) ? -1 : 0;
+}
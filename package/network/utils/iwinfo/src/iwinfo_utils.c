@@ -127,46 +127,153 @@ void iwinfo_close(void)
 	ioctl_socket = -1;
 }
 
-struct iwinfo_hardware_entry * iwinfo_hardware(struct iwinfo_hardware_id *id)
+struct iwinfo_hardware_index {
+	struct iwinfo_hardware_entry entry;
+	int line;
+};
+
+static struct iwinfo_hardware_index *hw_index = NULL;
+static int hw_index_len = 0;
+static time_t hw_index_mtime = 0;
+
+static int iwinfo_hardware_cmp(const struct iwinfo_hardware_entry *a,
+                               const struct iwinfo_hardware_entry *b)
+{
+	if (a->vendor_id != b->vendor_id)
+		return (a->vendor_id < b->vendor_id) ? -1 : 1;
+
+	if (a->device_id != b->device_id)
+		return (a->device_id < b->device_id) ? -1 : 1;
+
+	if (a->subsystem_vendor_id != b->subsystem_vendor_id)
+		return (a->subsystem_vendor_id < b->subsystem_vendor_id) ? -1 : 1;
+
+	if (a->subsystem_device_id != b->subsystem_device_id)
+		return (a->subsystem_device_id < b->subsystem_device_id) ? -1 : 1;
+
+	return 0;
+}
+
+static int iwinfo_hardware_sort(const void *a, const void *b)
+{
+	const struct iwinfo_hardware_index *x = a, *y = b;
+	int rv = iwinfo_hardware_cmp(&x->entry, &y->entry);
+
+	return rv ? rv : (x->line - y->line);
+}
+
+static int iwinfo_hardware_load(void)
 {
 	FILE *db;
+	struct stat s;
 	char buf[256] = { 0 };
-	static struct iwinfo_hardware_entry e, *rv = NULL;
+	struct iwinfo_hardware_index *tmp;
+	struct iwinfo_hardware_entry *e;
+	int size = 0, line = 0;
+
+	if (stat(IWINFO_HARDWARE_FILE, &s))
+		return -1;
+
+	if (hw_index && (s.st_mtime == hw_index_mtime))
+		return 0;
 
 	if (!(db = fopen(IWINFO_HARDWARE_FILE, "r")))
-		return NULL;
+		return -1;
+
+	free(hw_index);
+	hw_index = NULL;
+	hw_index_len = 0;
 
 	while (fgets(buf, sizeof(buf) - 1, db) != NULL)
 	{
-		memset(&e, 0, sizeof(e));
+		if (hw_index_len == size)
+		{
+			size = size ? (size * 2) : 64;
+			tmp = realloc(hw_index, size * sizeof(*hw_index));
+
+			if (!tmp)
+				break;
+
+			hw_index = tmp;
+		}
+
+		e = &hw_index[hw_index_len].entry;
+		memset(e, 0, sizeof(*e));
 
 		if (sscanf(buf, "%hx %hx %hx %hx %hd %hd \"%63[^\"]\" \"%63[^\"]\"",
-			       &e.vendor_id, &e.device_id,
-			       &e.subsystem_vendor_id, &e.subsystem_device_id,
-			       &e.txpower_offset, &e.frequency_offset,
-			       e.vendor_name, e.device_name) < 8)
+			       &e->vendor_id, &e->device_id,
+			       &e->subsystem_vendor_id, &e->subsystem_device_id,
+			       &e->txpower_offset, &e->frequency_offset,
+			       e->vendor_name, e->device_name) < 8)
 			continue;
 
-		if ((e.vendor_id != 0xffff) && (e.vendor_id != id->vendor_id))
-			continue;
+		hw_index[hw_index_len++].line = line++;
+	}
 
-		if ((e.device_id != 0xffff) && (e.device_id != id->device_id))
-			continue;
+	fclose(db);
 
-		if ((e.subsystem_vendor_id != 0xffff) &&
-			(e.subsystem_vendor_id != id->subsystem_vendor_id))
-			continue;
+	/* entries with equal ids stay in file order, so the first one wins */
+	qsort(hw_index, hw_index_len, sizeof(*hw_index), iwinfo_hardware_sort);
+	hw_index_mtime = s.st_mtime;
 
-		if ((e.subsystem_device_id != 0xffff) &&
-			(e.subsystem_device_id != id->subsystem_device_id))
-			continue;
+	return 0;
+}
 
-		rv = &e;
-		break;
+static struct iwinfo_hardware_index *
+iwinfo_hardware_find(const struct iwinfo_hardware_entry *key)
+{
+	int lo = 0, hi = hw_index_len, mid;
+
+	/* lower bound, the first entry with the given ids */
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+
+		if (iwinfo_hardware_cmp(&hw_index[mid].entry, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	fclose(db);
-	return rv;
+	if ((lo < hw_index_len) && !iwinfo_hardware_cmp(&hw_index[lo].entry, key))
+		return &hw_index[lo];
+
+	return NULL;
+}
+
+struct iwinfo_hardware_entry * iwinfo_hardware(struct iwinfo_hardware_id *id)
+{
+	static struct iwinfo_hardware_entry e;
+	struct iwinfo_hardware_entry key;
+	struct iwinfo_hardware_index *hit, *rv = NULL;
+	int i;
+
+	if (iwinfo_hardware_load())
+		return NULL;
+
+	/*
+	 * Each id field may be matched exactly or by a 0xffff wildcard in the
+	 * database, look up every combination and keep the match which comes
+	 * first in the file.
+	 */
+	for (i = 0; i < 16; i++)
+	{
+		key.vendor_id = (i & 1) ? 0xffff : id->vendor_id;
+		key.device_id = (i & 2) ? 0xffff : id->device_id;
+		key.subsystem_vendor_id = (i & 4) ? 0xffff : id->subsystem_vendor_id;
+		key.subsystem_device_id = (i & 8) ? 0xffff : id->subsystem_device_id;
+
+		hit = iwinfo_hardware_find(&key);
+
+		if (hit && (!rv || (hit->line < rv->line)))
+			rv = hit;
+	}
+
+	if (!rv)
+		return NULL;
+
+	e = rv->entry;
+	return &e;
 }
 
 int iwinfo_hardware_id_from_mtd(struct iwinfo_hardware_id *id)
@@ -57,6 +57,7 @@ struct op {
 
 static bool quiet = false;
 static bool printed = false;
+static bool stream = false;
 
 static struct cidr *stack = NULL;
 
@@ -662,7 +663,13 @@ static struct cidr * cidr_parse(const char *op, const char *s, int af_hint)
 				op,
 				(af_hint == AF_INET) ? "ipv4" : "ipv6",
 				(af_hint != AF_INET) ? "ipv4" : "ipv6");
-		exit(4);
+
+		/* a bad line must not end the whole stream */
+		if (!stream)
+			exit(4);
+
+		free(a);
+		return NULL;
 	}
 
 	return a;
@@ -694,6 +701,199 @@ static bool cidr_quiet(struct cidr *a)
 }
 
 
+/*
+ * Prefix sets are kept in one binary radix trie per address family. Each
+ * node stores the full masked key and its length, nodes without the
+ * terminal flag are only glue for branches. Keys are in network byte order
+ * so ipv4 uses the first four bytes of the key.
+ */
+struct trie_node {
+	uint8_t key[16];
+	uint8_t len;
+	bool terminal;
+	struct trie_node *child[2];
+};
+
+static struct trie_node *trie[2] = { NULL, NULL };
+
+#define trie_root(family) (&trie[(family) == AF_INET6])
+
+static uint8_t * cidr_key(struct cidr *a)
+{
+	return (a->family == AF_INET) ? (uint8_t *)&a->addr.v4
+	                              : (uint8_t *)&a->addr.v6;
+}
+
+static int key_bit(const uint8_t *key, int i)
+{
+	return (key[i / 8] >> (7 - (i % 8))) & 1;
+}
+
+static int key_common(const uint8_t *a, const uint8_t *b, int max)
+{
+	int i = 0;
+
+	while ((i + 8 <= max) && (a[i / 8] == b[i / 8]))
+		i += 8;
+
+	while ((i < max) && (key_bit(a, i) == key_bit(b, i)))
+		i++;
+
+	return i;
+}
+
+static struct trie_node * trie_node(const uint8_t *key, int len, bool terminal)
+{
+	int i;
+	struct trie_node *n = calloc(1, sizeof(*n));
+
+	if (!n)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(255);
+	}
+
+	for (i = 0; i < len / 8; i++)
+		n->key[i] = key[i];
+
+	if (len % 8)
+		n->key[i] = key[i] & ~((1 << (8 - (len % 8))) - 1);
+
+	n->len = len;
+	n->terminal = terminal;
+
+	return n;
+}
+
+static void trie_insert(struct cidr *a)
+{
+	int common;
+	uint8_t *key = cidr_key(a);
+	struct trie_node **slot = trie_root(a->family);
+	struct trie_node *n, *glue;
+
+	while ((n = *slot) != NULL)
+	{
+		common = key_common(key, n->key, (a->prefix < n->len) ? a->prefix
+		                                                     : n->len);
+
+		if (common < n->len)
+		{
+			/* new prefix is above n or branches off before it */
+			if (common == a->prefix)
+			{
+				glue = trie_node(key, common, true);
+			}
+			else
+			{
+				glue = trie_node(key, common, false);
+				glue->child[key_bit(key, common)] =
+					trie_node(key, a->prefix, true);
+			}
+
+			glue->child[key_bit(n->key, common)] = n;
+			*slot = glue;
+			return;
+		}
+
+		if (n->len == a->prefix)
+		{
+			n->terminal = true;
+			return;
+		}
+
+		slot = &n->child[key_bit(key, n->len)];
+	}
+
+	*slot = trie_node(key, a->prefix, true);
+}
+
+/* longest set prefix covering the given address or prefix */
+static struct trie_node * trie_lookup(struct cidr *a)
+{
+	uint8_t *key = cidr_key(a);
+	struct trie_node *n = *trie_root(a->family);
+	struct trie_node *best = NULL;
+
+	while (n && (n->len <= a->prefix) &&
+	       (key_common(key, n->key, n->len) == n->len))
+	{
+		if (n->terminal)
+			best = n;
+
+		if (n->len == a->prefix)
+			break;
+
+		n = n->child[key_bit(key, n->len)];
+	}
+
+	return best;
+}
+
+static void trie_free(struct trie_node *n)
+{
+	if (n)
+	{
+		trie_free(n->child[0]);
+		trie_free(n->child[1]);
+		free(n);
+	}
+}
+
+/* drop covered prefixes and join siblings into their parent */
+static void trie_merge(struct trie_node *n)
+{
+	struct trie_node *l, *r;
+
+	if (!n)
+		return;
+
+	if (!n->terminal)
+	{
+		trie_merge(n->child[0]);
+		trie_merge(n->child[1]);
+
+		l = n->child[0];
+		r = n->child[1];
+
+		if (!l || !r || !l->terminal || !r->terminal ||
+		    (l->len != n->len + 1) || (r->len != n->len + 1))
+			return;
+
+		n->terminal = true;
+	}
+
+	trie_free(n->child[0]);
+	trie_free(n->child[1]);
+	n->child[0] = n->child[1] = NULL;
+}
+
+static void trie_print_node(struct trie_node *n, int family)
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	if (!inet_ntop(family, n->key, buf, sizeof(buf)))
+		return;
+
+	if (n->len < ((family == AF_INET) ? 32 : 128))
+		printf("%s/%u\n", buf, n->len);
+	else
+		printf("%s\n", buf);
+}
+
+static void trie_print(struct trie_node *n, int family)
+{
+	if (!n)
+		return;
+
+	if (n->terminal)
+		trie_print_node(n, family);
+
+	trie_print(n->child[0], family);
+	trie_print(n->child[1], family);
+}
+
+
 struct op ops[] = {
 	{ .name = "add",
 	  .desc = "Add argument to base address",
@@ -819,6 +1019,20 @@ static void usage(const char *prog)
 	}
 
 	fprintf(stderr,
+	        "Stream and set usage:\n\n"
+	        "  %s - [operation [argument] ...]\n"
+	        "    Read one calculation per line from stdin, the given operations are\n"
+	        "    appended to each line. Exits with the highest status of all lines.\n\n"
+	        "  %s aggregate\n"
+	        "    Read prefixes from stdin and print the minimal set of prefixes\n"
+	        "    covering the same addresses.\n\n"
+	        "  %s match {prefix file}\n"
+	        "    Print '1' for each address or prefix read from stdin which is\n"
+	        "    covered by one of the prefixes in the file or '0' if not.\n\n"
+	        "  %s lookup {prefix file}\n"
+	        "    Print the longest prefix in the file covering each address or\n"
+	        "    prefix read from stdin or '-' if none.\n\n"
+	        "  Empty lines and '#' comments in the input are skipped.\n\n"
 	        "Examples:\n\n"
 	        " Calculate a DHCP range:\n\n"
 	        "  $ %s 192.168.1.1/255.255.255.0 network add 100 print add 150 print\n"
@@ -827,7 +1041,7 @@ static void usage(const char *prog)
 			" Count number of prefixes:\n\n"
 			"  $ %s 2001:0DB8:FDEF::/48 howmany ::/64\n"
 			"  65536\n\n",
-	        prog, prog);
+	        prog, prog, prog, prog, prog, prog);
 
 	exit(1);
 }
@@ -879,12 +1093,14 @@ static bool runop(char ***arg, int *status)
 							(a->family == AF_INET) ? "ipv4" : "ipv6");
 
 					*status = 5;
+					free(b);
 					return false;
 				}
 
 				*status = !((a->family == AF_INET) ? ops[i].f4.a2(a, b)
 				                                   : ops[i].f6.a2(a, b));
 
+				free(b);
 				return true;
 			}
 			else
@@ -913,39 +1129,228 @@ static bool runop(char ***arg, int *status)
 	return false;
 }
 
-int main(int argc, char **argv)
+static int calc(char **arg)
 {
 	int status = 0;
-	char **arg = argv+2;
 	struct cidr *a;
 
-	if (argc < 3)
-		usage(argv[0]);
+	quiet = false;
+	printed = false;
 
-	a = strchr(argv[1], ':') ? cidr_parse6(argv[1]) : cidr_parse4(argv[1]);
+	a = strchr(*arg, ':') ? cidr_parse6(*arg) : cidr_parse4(*arg);
 
 	if (!a)
-		usage(argv[0]);
+		return -1;
 
 	cidr_push(a);
+	arg++;
 
 	while (runop(&arg, &status));
 
-	if (*arg)
+	/* a status above 1 is an error already reported by runop() */
+	if ((status < 2) && *arg)
 	{
 		fprintf(stderr, "unknown operation '%s'\n", *arg);
-		exit(6);
+		status = 6;
+	}
+
+	if (status < 2)
+	{
+		if (!printed && stack)
+		{
+			if (stack->family == AF_INET)
+				cidr_print4(stack);
+			else
+				cidr_print6(stack);
+		}
+
+		qprintf("\n");
+	}
+	else if (stream)
+	{
+		/* keep the output aligned with the input */
+		qprintf(printed ? " -\n" : "-\n");
+	}
+
+	while (cidr_pop(stack));
+
+	return status;
+}
+
+/* strip comments and surrounding whitespace, NULL for empty lines */
+static char * line_trim(char *s)
+{
+	char *e;
+
+	s += strspn(s, " \t");
+	e = s + strcspn(s, "#\r\n");
+
+	while ((e > s) && ((e[-1] == ' ') || (e[-1] == '\t')))
+		e--;
+
+	*e = 0;
+
+	return *s ? s : NULL;
+}
+
+static struct cidr * line_parse(char *s)
+{
+	struct cidr *a = strchr(s, ':') ? cidr_parse6(s) : cidr_parse4(s);
+
+	if (!a)
+		fprintf(stderr, "invalid address '%s'\n", s);
+
+	return a;
+}
+
+static int calc_stream(char **ops)
+{
+	char line[512], *s, **args;
+	int i, n, rv, status = 0;
+
+	for (n = 0; ops[n]; n++);
+
+	if (!(args = calloc(n + 64, sizeof(*args))))
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(255);
+	}
+
+	stream = true;
+
+	while (fgets(line, sizeof(line), stdin))
+	{
+		if (!(s = line_trim(line)))
+			continue;
+
+		for (i = 0, s = strtok(s, " \t"); s && (i < 63);
+		     s = strtok(NULL, " \t"))
+			args[i++] = s;
+
+		memcpy(args + i, ops, (n + 1) * sizeof(*args));
+
+		if ((rv = calc(args)) < 0)
+		{
+			fprintf(stderr, "invalid address '%s'\n", args[0]);
+			printf("-\n");
+			rv = 3;
+		}
+
+		if (rv > status)
+			status = rv;
+	}
+
+	free(args);
+
+	return status;
+}
+
+static int set_load(FILE *f)
+{
+	char line[256], *s;
+	struct cidr *a;
+	int status = 0;
+
+	while (fgets(line, sizeof(line), f))
+	{
+		if (!(s = line_trim(line)))
+			continue;
+
+		if (!(a = line_parse(s)))
+		{
+			status = 3;
+			continue;
+		}
+
+		trie_insert(a);
+		free(a);
 	}
 
-	if (!printed && (status < 2))
+	return status;
+}
+
+static int set_aggregate(void)
+{
+	int status = set_load(stdin);
+
+	trie_merge(trie[0]);
+	trie_merge(trie[1]);
+
+	trie_print(trie[0], AF_INET);
+	trie_print(trie[1], AF_INET6);
+
+	return status;
+}
+
+static int set_match(const char *file, bool longest)
+{
+	FILE *f;
+	char line[256], *s;
+	struct cidr *a;
+	struct trie_node *n;
+	int status;
+
+	if (!(f = fopen(file, "r")))
 	{
-		if (stack->family == AF_INET)
-			cidr_print4(stack);
+		fprintf(stderr, "unable to open '%s'\n", file);
+		return 7;
+	}
+
+	status = set_load(f);
+	fclose(f);
+
+	while (fgets(line, sizeof(line), stdin))
+	{
+		if (!(s = line_trim(line)))
+			continue;
+
+		/* keep the output aligned with the input */
+		if (!(a = line_parse(s)))
+		{
+			printf(longest ? "-\n" : "0\n");
+			status = 3;
+			continue;
+		}
+
+		n = trie_lookup(a);
+
+		if (!longest)
+			printf("%d\n", !!n);
+		else if (n)
+			trie_print_node(n, a->family);
 		else
-			cidr_print6(stack);
+			printf("-\n");
+
+		if (!n && (status < 1))
+			status = 1;
+
+		free(a);
 	}
 
-	qprintf("\n");
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	int status;
+
+	if ((argc >= 2) && !strcmp(argv[1], "-"))
+		exit(calc_stream(argv + 2));
+
+	if ((argc == 2) && !strcmp(argv[1], "aggregate"))
+		exit(set_aggregate());
+
+	if ((argc == 3) && !strcmp(argv[1], "match"))
+		exit(set_match(argv[2], false));
+
+	if ((argc == 3) && !strcmp(argv[1], "lookup"))
+		exit(set_match(argv[2], true));
+
+	if (argc < 3)
+		usage(argv[0]);
+
+	if ((status = calc(argv + 1)) < 0)
+		usage(argv[0]);
 
 	exit(status);
 }
@@ -0,0 +1,111 @@
+/*
+ * Host check and benchmark for the slice-by-8 crc32() against the byte
+ * wise loop over crc32_table it replaced.
+ *
+ * Build and run on the build host with: make crc32-test && ./crc32-test
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "crc32.h"
+
+#define BUF_SIZE	(64 * 1024)
+#define ROUNDS		100000
+#define BENCH_SIZE	(16 * 1024 * 1024)
+
+static uint32_t
+crc32_bytewise(uint32_t val, const void *ss, int len)
+{
+	const unsigned char *s = ss;
+
+	while (--len >= 0)
+		val = crc32_table[(val ^ *s++) & 0xff] ^ (val >> 8);
+
+	return val;
+}
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+check(unsigned char *buf)
+{
+	uint32_t seed, a, b;
+	int i, off, len;
+
+	/* a well known check value */
+	if (crc32buf("123456789", 9) != 0x340bc6d9) {
+		fprintf(stderr, "check value mismatch: %08x\n",
+			crc32buf("123456789", 9));
+		return 1;
+	}
+
+	for (i = 0; i < ROUNDS; i++) {
+		off = rand() % 16;
+		len = (i < 64) ? i : rand() % (BUF_SIZE - off);
+		seed = (i & 1) ? 0xffffffff : (uint32_t) rand();
+
+		a = crc32(seed, buf + off, len);
+		b = crc32_bytewise(seed, buf + off, len);
+		if (a != b) {
+			fprintf(stderr, "mismatch at offset %d, length %d, "
+				"seed %08x: %08x != %08x\n", off, len, seed, a, b);
+			return 1;
+		}
+	}
+
+	printf("%d random lengths and alignments match\n", ROUNDS);
+	return 0;
+}
+
+static void
+bench(const char *name, uint32_t (*fn)(uint32_t, const void *, int),
+      unsigned char *buf)
+{
+	volatile uint32_t val = 0xffffffff;
+	double start, t;
+	int i;
+
+	start = now();
+	for (i = 0; i < BENCH_SIZE / BUF_SIZE; i++)
+		val = fn(val, buf, BUF_SIZE);
+	t = now() - start;
+
+	printf("%-10s %8.1f MB/s\n", name, BENCH_SIZE / t / (1024 * 1024));
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *buf;
+	int i;
+
+	buf = malloc(BUF_SIZE + 16);
+	if (!buf)
+		return 1;
+
+	srand(1);
+	for (i = 0; i < BUF_SIZE + 16; i++)
+		buf[i] = rand();
+
+	if (check(buf))
+		return 1;
+
+	bench("bytewise", crc32_bytewise, buf);
+	bench("slice-by-8", crc32, buf);
+
+	free(buf);
+	return 0;
+}
@@ -93,3 +93,58 @@ const uint32_t crc32_table[256] = {
 	0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
 	0x2d02ef8dL
 };
+
+/*
+ * Slice-by-8 tables: crc32_slice[0] is crc32_table, crc32_slice[n][i] is
+ * the CRC of byte i followed by n zero bytes. They are derived from
+ * crc32_table on first use.
+ */
+static uint32_t crc32_slice[8][256];
+static int crc32_slice_ready;
+
+static void
+crc32_slice_init(void)
+{
+	uint32_t c;
+	int i, n;
+
+	for (i = 0; i < 256; i++) {
+		c = crc32_table[i];
+		crc32_slice[0][i] = c;
+		for (n = 1; n < 8; n++) {
+			c = crc32_table[c & 0xff] ^ (c >> 8);
+			crc32_slice[n][i] = c;
+		}
+	}
+	crc32_slice_ready = 1;
+}
+
+uint32_t
+crc32(uint32_t val, const void *ss, int len)
+{
+	const unsigned char *s = ss;
+	uint32_t a;
+
+	if (!crc32_slice_ready)
+		crc32_slice_init();
+
+	/* byte loads keep this independent of host endianness and alignment */
+	while (len >= 8) {
+		a = val ^ (s[0] | (s[1] << 8) | (s[2] << 16) | ((uint32_t) s[3] << 24));
+		val = crc32_slice[7][a & 0xff] ^
+		      crc32_slice[6][(a >> 8) & 0xff] ^
+		      crc32_slice[5][(a >> 16) & 0xff] ^
+		      crc32_slice[4][a >> 24] ^
+		      crc32_slice[3][s[4]] ^
+		      crc32_slice[2][s[5]] ^
+		      crc32_slice[1][s[6]] ^
+		      crc32_slice[0][s[7]];
+		s += 8;
+		len -= 8;
+	}
+
+	while (--len >= 0)
+		val = crc32_table[(val ^ *s++) & 0xff] ^ (val >> 8);
+
+	return val;
+}
@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
 #include <fcntl.h>
@@ -50,11 +51,16 @@
 #define JFFS2_DEFAULT_DIR	"" /* directory name without /, empty means root dir */
 
 static char *buf = NULL;
+static char *cmpbuf = NULL;
 static char *imagefile = NULL;
 static char *jffs2file = NULL, *jffs2dir = JFFS2_DEFAULT_DIR;
 static int buflen = 0;
 int quiet;
 int no_erase;
+int skip_unchanged;
+int pipelined;
+int inline_verify;
+int show_stats;
 int mtdsize = 0;
 int erasesize = 0;
 int jffs2_skip_bytes=0;
@@ -148,6 +154,22 @@ int mtd_write_buffer(int fd, const char *buf, int offset, int length)
 	return 0;
 }
 
+/* compare data against the flash contents at the given offset */
+static int
+mtd_block_matches(int fd, off_t pos, const char *data, int length)
+{
+	if (!cmpbuf)
+		cmpbuf = malloc(erasesize);
+
+	if (!cmpbuf || pos < 0 || length > erasesize)
+		return 0;
+
+	if (pread(fd, cmpbuf, length, pos) != length)
+		return 0;
+
+	return !memcmp(cmpbuf, data, length);
+}
+
 
 static int
 image_check(int imagefd, const char *mtd)
@@ -329,6 +351,133 @@ out:
 	return ret;
 }
 
+/*
+ * Background image reader: fills a ring of two eraseblocks from the image
+ * while the main thread is busy erasing and writing flash.
+ */
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char *data;
+	int size;
+	int head;
+	int fill;
+	int eof;
+	int error;
+	int fd;
+} image_pipe = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *
+image_reader(void *arg)
+{
+	int tail, len;
+	ssize_t r;
+
+	pthread_mutex_lock(&image_pipe.lock);
+	while (!image_pipe.eof) {
+		while (image_pipe.fill == image_pipe.size)
+			pthread_cond_wait(&image_pipe.cond, &image_pipe.lock);
+
+		tail = (image_pipe.head + image_pipe.fill) % image_pipe.size;
+		len = image_pipe.size - image_pipe.fill;
+		if (len > image_pipe.size - tail)
+			len = image_pipe.size - tail;
+		pthread_mutex_unlock(&image_pipe.lock);
+
+		r = read(image_pipe.fd, image_pipe.data + tail, len);
+
+		pthread_mutex_lock(&image_pipe.lock);
+		if (r < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+
+			image_pipe.error = errno;
+			image_pipe.eof = 1;
+		} else if (r == 0) {
+			image_pipe.eof = 1;
+		} else {
+			image_pipe.fill += r;
+		}
+		pthread_cond_broadcast(&image_pipe.cond);
+	}
+	pthread_mutex_unlock(&image_pipe.lock);
+
+	return NULL;
+}
+
+static int
+image_pipe_start(int imagefd)
+{
+	image_pipe.size = 2 * erasesize;
+	image_pipe.data = malloc(image_pipe.size);
+	if (!image_pipe.data)
+		return -1;
+
+	image_pipe.fd = imagefd;
+	if (pthread_create(&image_pipe.thread, NULL, image_reader, NULL)) {
+		free(image_pipe.data);
+		image_pipe.data = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+image_pipe_stop(void)
+{
+	if (!image_pipe.data)
+		return;
+
+	pthread_join(image_pipe.thread, NULL);
+	free(image_pipe.data);
+	image_pipe.data = NULL;
+}
+
+static ssize_t
+image_read(int imagefd, char *data, int length)
+{
+	int len;
+
+	if (!image_pipe.data)
+		return read(imagefd, data, length);
+
+	pthread_mutex_lock(&image_pipe.lock);
+	while (!image_pipe.fill && !image_pipe.eof)
+		pthread_cond_wait(&image_pipe.cond, &image_pipe.lock);
+
+	if (!image_pipe.fill) {
+		pthread_mutex_unlock(&image_pipe.lock);
+		if (!image_pipe.error)
+			return 0;
+
+		errno = image_pipe.error;
+		return -1;
+	}
+
+	len = image_pipe.fill;
+	if (len > image_pipe.size - image_pipe.head)
+		len = image_pipe.size - image_pipe.head;
+	if (len > length)
+		len = length;
+	pthread_mutex_unlock(&image_pipe.lock);
+
+	/* the reader never touches filled data, so copy without the lock */
+	memcpy(data, image_pipe.data + image_pipe.head, len);
+
+	pthread_mutex_lock(&image_pipe.lock);
+	image_pipe.head = (image_pipe.head + len) % image_pipe.size;
+	image_pipe.fill -= len;
+	pthread_cond_broadcast(&image_pipe.cond);
+	pthread_mutex_unlock(&image_pipe.lock);
+
+	return len;
+}
+
 static void
 indicate_writing(const char *mtd)
 {
@@ -350,6 +499,12 @@ mtd_write(int imagefd, const char *mtd, char *fis_layout, size_t part_offset)
 	uint32_t offset = 0;
 	int jffs2_replaced = 0;
 	int skip_bad_blocks = 0;
+	int unchanged = 0;
+	size_t written = 0;
+	struct timespec start, end;
+	uint32_t image_md5[4];
+	md5_ctx_t image_ctx;
+	off_t pos;
 
 #ifdef FIS_SUPPORT
 	static struct fis_part new_parts[MAX_ARGS];
@@ -413,6 +568,15 @@ next:
 
 	r = 0;
 
+	/* the trx check may already have consumed the start of the image */
+	md5_begin(&image_ctx);
+	if (inline_verify && buflen > 0)
+		md5_hash(buf, buflen, &image_ctx);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (pipelined && image_pipe_start(imagefd) < 0)
+		fprintf(stderr, "Failed to start image reader, reading synchronously\n");
+
 resume:
 	next = strchr(mtd, ':');
 	if (next) {
@@ -436,7 +600,7 @@ resume:
 	for (;;) {
 		/* buffer may contain data already (from trx check or last mtd partition write attempt) */
 		while (buflen < erasesize) {
-			r = read(imagefd, buf + buflen, erasesize - buflen);
+			r = image_read(imagefd, buf + buflen, erasesize - buflen);
 			if (r < 0) {
 				if ((errno == EINTR) || (errno == EAGAIN))
 					continue;
@@ -449,6 +613,9 @@ resume:
 			if (r == 0)
 				break;
 
+			if (inline_verify)
+				md5_hash(buf + buflen, r, &image_ctx);
+
 			buflen += r;
 		}
 
@@ -495,6 +662,24 @@ resume:
 			mtd_parse_jffs2data(buf, jffs2dir);
 		}
 
+		/* leave the eraseblock alone if it already holds this data */
+		if (skip_unchanged && !offset && !part_offset && buflen == erasesize &&
+		    (no_erase || (w == e - skip_bad_blocks && !mtd_block_is_bad(fd, e))) &&
+		    mtd_block_matches(fd, lseek(fd, 0, SEEK_CUR), buf, buflen)) {
+			if (!quiet)
+				fprintf(stderr, "\b\b\b[s]");
+
+			lseek(fd, buflen, SEEK_CUR);
+			if (!no_erase)
+				e += erasesize;
+			w += buflen;
+			written += buflen;
+			unchanged++;
+
+			buflen = 0;
+			continue;
+		}
+
 		/* need to erase the next block before writing data to it */
 		if(!no_erase)
 		{
@@ -540,6 +725,7 @@ resume:
 		if (!quiet)
 			fprintf(stderr, "\b\b\b[w]");
 
+		pos = lseek(fd, 0, SEEK_CUR);
 		if ((result = write(fd, buf + offset, buflen)) < buflen) {
 			if (result < 0) {
 				fprintf(stderr, "Error writing image.\n");
@@ -549,12 +735,21 @@ resume:
 				exit(1);
 			}
 		}
+
+		if (inline_verify && !mtd_block_matches(fd, pos, buf + offset, buflen)) {
+			fprintf(stderr, "\nVerification failed at 0x%08llx on %s\n",
+				(unsigned long long) pos, mtd);
+			exit(1);
+		}
 		w += buflen;
+		written += buflen;
 
 		buflen = 0;
 		offset = 0;
 	}
 
+	image_pipe_stop();
+
 	if (jffs2_replaced && trx_fixup) {
 		trx_fixup(fd, mtd);
 	}
@@ -566,6 +761,27 @@ done:
 	if (quiet < 2)
 		fprintf(stderr, "\n");
 
+	if (skip_unchanged && quiet < 2)
+		fprintf(stderr, "Skipped %d unchanged eraseblocks\n", unchanged);
+
+	/* the blocks were compared on the way, this is the digest of the image */
+	if (inline_verify) {
+		md5_end(image_md5, &image_ctx);
+		if (quiet < 2)
+			fprintf(stderr, "%08x%08x%08x%08x - %s\n",
+				image_md5[0], image_md5[1], image_md5[2], image_md5[3], imagefile);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (show_stats) {
+		double t = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+
+		if (t > 0)
+			fprintf(stderr, "Wrote %zu bytes in %.2f s (%.2f MB/s)\n",
+				written, t, written / t / (1024 * 1024));
+	}
+
 #ifdef FIS_SUPPORT
 	if (fis_layout) {
 		if (fis_remap(old_parts, n_old, new_parts, n_new) < 0)
@@ -601,7 +817,13 @@ static void usage(void)
 	"        -q                      quiet mode (once: no [w] on writing,\n"
 	"                                           twice: no status messages)\n"
 	"        -n                      write without first erasing the blocks\n"
+	"        -b                      read the image in a background thread while\n"
+	"                                erasing/writing the previous block\n"
+	"        -c                      compare each eraseblock with the image and skip\n"
+	"                                erasing/writing it if it is unchanged\n"
 	"        -r                      reboot after successful command\n"
+	"        -v                      read back and compare every block while writing\n"
+	"        -t                      print the write throughput when done\n"
 	"        -f                      force write without trx checks\n"
 	"        -e <device>             erase <device> before executing the command\n"
 	"        -d <name>               directory for jffs2write, defaults to \"tmp\"\n"
@@ -660,12 +882,16 @@ int main (int argc, char **argv)
 	buflen = 0;
 	quiet = 0;
 	no_erase = 0;
+	skip_unchanged = 0;
+	pipelined = 0;
+	inline_verify = 0;
+	show_stats = 0;
 
 	while ((ch = getopt(argc, argv,
 #ifdef FIS_SUPPORT
 			"F:"
 #endif
-			"frnqe:d:s:j:p:o:")) != -1)
+			"frnqbcvte:d:s:j:p:o:")) != -1)
 		switch (ch) {
 			case 'f':
 				force = 1;
@@ -676,6 +902,18 @@ int main (int argc, char **argv)
 			case 'n':
 				no_erase = 1;
 				break;
+			case 'b':
+				pipelined = 1;
+				break;
+			case 'c':
+				skip_unchanged = 1;
+				break;
+			case 'v':
+				inline_verify = 1;
+				break;
+			case 't':
+				show_stats = 1;
+				break;
 			case 'j':
 				jffs2file = optarg;
 				break;
@@ -154,6 +154,10 @@ int main( int argc, const char *argv[] )
 
 	if( nvram != NULL && argc > 1 )
 	{
+		/* Regenerate the image once for all changes on the command line */
+		if( write )
+			nvram_begin(nvram);
+
 		for( i = 1; i < argc; i++ )
 		{
 			if( !strcmp(argv[i], "show") )
@@ -182,6 +186,10 @@ int main( int argc, const char *argv[] )
 
 						case 's':
 							stat = do_set(nvram, argv[i]);
+
+							/* Further pairs: set a=b c=d ... */
+							while( !stat && (i+1) < argc && strchr(argv[i+1], '=') )
+								stat = do_set(nvram, argv[++i]);
 							break;
 					}
 					done++;
@@ -207,7 +215,7 @@ int main( int argc, const char *argv[] )
 		}
 
 		if( write )
-			stat = nvram_commit(nvram);
+			stat = nvram_commit_batch(nvram);
 
 		nvram_close(nvram);
 
@@ -234,7 +242,7 @@ int main( int argc, const char *argv[] )
 			"	nvram show\n"
 			"	nvram info\n"
 			"	nvram get variable\n"
-			"	nvram set variable=value [set ...]\n"
+			"	nvram set variable=value [variable=value ...] [set ...]\n"
 			"	nvram unset variable [unset ...]\n"
 			"	nvram commit\n"
 		);
@@ -46,6 +46,7 @@ static void _nvram_free(nvram_handle_t *h)
 	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
 		for (t = h->nvram_hash[i]; t; t = next) {
 			next = t->next;
+			free(t->value);
 			free(t);
 		}
 		h->nvram_hash[i] = NULL;
@@ -54,6 +55,7 @@ static void _nvram_free(nvram_handle_t *h)
 	/* Free dead table */
 	for (t = h->nvram_dead; t; t = next) {
 		next = t->next;
+		free(t->value);
 		free(t);
 	}
 
@@ -91,28 +93,12 @@ static nvram_tuple_t * _nvram_realloc( nvram_handle_t *h, nvram_tuple_t *t,
 	return t;
 }
 
-/* (Re)initialize the hash table. */
-static int _nvram_rehash(nvram_handle_t *h)
+/* Set special SDRAM parameters missing from the tuples. */
+static void _nvram_sdram_params(nvram_handle_t *h)
 {
 	nvram_header_t *header = nvram_header(h);
-	char buf[] = "0xXXXXXXXX", *name, *value, *eq;
-
-	/* (Re)initialize hash table */
-	_nvram_free(h);
-
-	/* Parse and set "name=value\0 ... \0\0" */
-	name = (char *) &header[1];
+	char buf[] = "0xXXXXXXXX";
 
-	for (; *name; name = value + strlen(value) + 1) {
-		if (!(eq = strchr(name, '=')))
-			break;
-		*eq = '\0';
-		value = eq + 1;
-		nvram_set(h, name, value);
-		*eq = '=';
-	}
-
-	/* Set special SDRAM parameters */
 	if (!nvram_get(h, "sdram_init")) {
 		sprintf(buf, "0x%04X", (uint16_t)(header->crc_ver_init >> 16));
 		nvram_set(h, "sdram_init", buf);
@@ -130,6 +116,30 @@ static int _nvram_rehash(nvram_handle_t *h)
 		sprintf(buf, "0x%08X", header->config_ncdl);
 		nvram_set(h, "sdram_ncdl", buf);
 	}
+}
+
+/* (Re)initialize the hash table. */
+static int _nvram_rehash(nvram_handle_t *h)
+{
+	nvram_header_t *header = nvram_header(h);
+	char *name, *value, *eq;
+
+	/* (Re)initialize hash table */
+	_nvram_free(h);
+
+	/* Parse and set "name=value\0 ... \0\0" */
+	name = (char *) &header[1];
+
+	for (; *name; name = value + strlen(value) + 1) {
+		if (!(eq = strchr(name, '=')))
+			break;
+		*eq = '\0';
+		value = eq + 1;
+		nvram_set(h, name, value);
+		*eq = '=';
+	}
+
+	_nvram_sdram_params(h);
 
 	return 0;
 }
@@ -255,16 +265,23 @@ nvram_tuple_t * nvram_getall(nvram_handle_t *h)
 }
 
 /* Regenerate NVRAM. */
-int nvram_commit(nvram_handle_t *h)
+static int _nvram_commit(nvram_handle_t *h)
 {
-	nvram_header_t *header = nvram_header(h);
+	nvram_header_t *header;
 	char *init, *config, *refresh, *ncdl;
-	char *ptr, *end;
+	char *image, *ptr, *end;
 	int i;
-	nvram_tuple_t *t;
+	nvram_tuple_t *t, **prev;
 	nvram_header_t tmp;
 	uint8_t crc;
 
+	/* Build the new image aside so an unchanged one is not written */
+	if (!(image = malloc(NVRAM_SPACE)))
+		return -12; /* -ENOMEM */
+
+	header = (nvram_header_t *) image;
+	memset(header, 0, sizeof(nvram_header_t));
+
 	/* Regenerate header */
 	header->magic = NVRAM_MAGIC;
 	header->crc_ver_init = (NVRAM_VERSION << 8);
@@ -284,19 +301,25 @@ int nvram_commit(nvram_handle_t *h)
 	}
 
 	/* Clear data area */
-	ptr = (char *) header + sizeof(nvram_header_t);
+	ptr = image + sizeof(nvram_header_t);
 	memset(ptr, 0xFF, NVRAM_SPACE - sizeof(nvram_header_t));
 	memset(&tmp, 0, sizeof(nvram_header_t));
 
 	/* Leave space for a double NUL at the end */
-	end = (char *) header + NVRAM_SPACE - 2;
+	end = image + NVRAM_SPACE - 2;
 
-	/* Write out all tuples */
+	/* Write out all tuples, the ones which do not fit are dropped from
+	 * the hash table as well so it keeps matching the image */
 	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
-		for (t = h->nvram_hash[i]; t; t = t->next) {
-			if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end)
-				break;
+		for (prev = &h->nvram_hash[i], t = *prev; t; t = *prev) {
+			if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end) {
+				*prev = t->next;
+				t->next = h->nvram_dead;
+				h->nvram_dead = t;
+				continue;
+			}
 			ptr += sprintf(ptr, "%s=%s", t->name, t->value) + 1;
+			prev = &t->next;
 		}
 	}
 
@@ -304,13 +327,13 @@ int nvram_commit(nvram_handle_t *h)
 	*ptr = '\0';
 	ptr++;
 
-	if( (int)ptr % 4 )
-		memset(ptr, 0, 4 - ((int)ptr % 4));
+	if( (h->offset + (ptr - image)) % 4 )
+		memset(ptr, 0, 4 - ((h->offset + (ptr - image)) % 4));
 
 	ptr++;
 
 	/* Set new length */
-	header->len = NVRAM_ROUNDUP(ptr - (char *) header, 4);
+	header->len = NVRAM_ROUNDUP(ptr - image, 4);
 
 	/* Little-endian CRC8 over the last 11 bytes of the header */
 	tmp.crc_ver_init   = header->crc_ver_init;
@@ -320,18 +343,58 @@ int nvram_commit(nvram_handle_t *h)
 		sizeof(nvram_header_t) - NVRAM_CRC_START_POSITION, 0xff);
 
 	/* Continue CRC8 over data bytes */
-	crc = hndcrc8((unsigned char *) &header[0] + sizeof(nvram_header_t),
+	crc = hndcrc8((unsigned char *) image + sizeof(nvram_header_t),
 		header->len - sizeof(nvram_header_t), crc);
 
 	/* Set new CRC8 */
 	header->crc_ver_init |= crc;
 
-	/* Write out */
-	msync(h->mmap, h->length, MS_SYNC);
-	fsync(h->fd);
+	/* Write out, unless the image did not change */
+	if (memcmp(nvram_header(h), image, NVRAM_SPACE)) {
+		memcpy(nvram_header(h), image, NVRAM_SPACE);
+		msync(h->mmap, h->length, MS_SYNC);
+		fsync(h->fd);
+	}
+
+	free(image);
+
+	/* The hash table already reflects the image, only release the
+	 * tuples which were replaced or unset in the meantime */
+	for (t = h->nvram_dead; t; t = h->nvram_dead) {
+		h->nvram_dead = t->next;
+		free(t->value);
+		free(t);
+	}
+
+	_nvram_sdram_params(h);
+
+	return 0;
+}
+
+/* Regenerate NVRAM, deferred while a batch is open. */
+int nvram_commit(nvram_handle_t *h)
+{
+	if (h->batch)
+		return 0;
+
+	return _nvram_commit(h);
+}
+
+/* Start a batch, nvram_commit() is deferred until nvram_commit_batch(). */
+int nvram_begin(nvram_handle_t *h)
+{
+	h->batch++;
+
+	return 0;
+}
+
+/* End a batch and regenerate NVRAM once. */
+int nvram_commit_batch(nvram_handle_t *h)
+{
+	if (h->batch > 0 && --h->batch > 0)
+		return 0;
 
-	/* Reinitialize hash table */
-	return _nvram_rehash(h);
+	return _nvram_commit(h);
 }
 
 /* Open NVRAM and obtain a handle. */
@@ -520,7 +583,29 @@ int nvram_to_staging(void)
 	return stat;
 }
 
-/* Copy staging file to NVRAM device. */
+/* Check whether the NVRAM device already holds the given contents. */
+static int nvram_matches(const char *mtd, const char *buf, size_t len)
+{
+	int fdmtd, match = 0;
+	char *cur;
+
+	if( (cur = malloc(len)) != NULL )
+	{
+		if( (fdmtd = open(mtd, O_RDONLY)) > -1 )
+		{
+			if( read(fdmtd, cur, len) == len )
+				match = !memcmp(cur, buf, len);
+
+			close(fdmtd);
+		}
+
+		free(cur);
+	}
+
+	return match;
+}
+
+/* Copy staging file to NVRAM device, unless the contents are unchanged. */
 int staging_to_nvram(void)
 {
 	int fdmtd, fdstg, stat;
@@ -535,7 +620,11 @@ int staging_to_nvram(void)
 		{
 			if( read(fdstg, buf, sizeof(buf)) == sizeof(buf) )
 			{
-				if( (fdmtd = open(mtd, O_WRONLY | O_SYNC)) > -1 )
+				if( nvram_matches(mtd, buf, sizeof(buf)) )
+				{
+					stat = 0;
+				}
+				else if( (fdmtd = open(mtd, O_WRONLY | O_SYNC)) > -1 )
 				{
 					write(fdmtd, buf, sizeof(buf));
 					fsync(fdmtd);
@@ -50,6 +50,7 @@ struct nvram_handle {
 	unsigned int offset;
 	struct nvram_tuple *nvram_hash[257];
 	struct nvram_tuple *nvram_dead;
+	int batch;
 };
 
 typedef struct nvram_handle nvram_handle_t;
@@ -75,6 +76,12 @@ nvram_tuple_t * nvram_getall(nvram_handle_t *h);
 /* Regenerate NVRAM. */
 int nvram_commit(nvram_handle_t *h);
 
+/* Start a batch, nvram_commit() is deferred until nvram_commit_batch(). */
+int nvram_begin(nvram_handle_t *h);
+
+/* End a batch and regenerate NVRAM once. */
+int nvram_commit_batch(nvram_handle_t *h);
+
 /* Open NVRAM and obtain a handle. */
 nvram_handle_t * nvram_open(const char *file, int rdonly);
 
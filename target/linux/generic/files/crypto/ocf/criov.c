@@ -146,6 +146,10 @@ EXPORT_SYMBOL(cuio_getptr);
 static void
 skb_copy_bits_back(struct sk_buff *skb, int offset, caddr_t cp, int len)
 {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,14)
+	/* also handles the frag list */
+	skb_store_bits(skb, offset, cp, len);
+#else
 	int i;
 	if (offset < skb_headlen(skb)) {
 		memcpy(skb->data + offset, cp, min_t(int, skb_headlen(skb), len));
@@ -163,6 +167,7 @@ skb_copy_bits_back(struct sk_buff *skb, int offset, caddr_t cp, int len)
 		}
 		offset -= skb_shinfo(skb)->frags[i].size;
 	}
+#endif
 }
 
 void
@@ -74,6 +74,7 @@ __FBSDID("$FreeBSD: src/sys/opencrypto/crypto.c,v 1.16 2005/01/07 02:29:16 imp E
 #include <linux/wait.h>
 #include <linux/sched.h>
 #include <linux/spinlock.h>
+#include <linux/cache.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,4)
 #include <linux/kthread.h>
 #endif
@@ -143,25 +144,70 @@ struct cryptocap {
 	int		cc_qblocked;		/* (q) symmetric q blocked */
 	int		cc_kqblocked;		/* (q) asymmetric q blocked */
 
-	int		cc_unqblocked;		/* (q) symmetric q blocked */
+	int		cc_qgen;		/* (q) symmetric q unblock count */
 	int		cc_unkqblocked;		/* (q) asymmetric q blocked */
 };
 static struct cryptocap *crypto_drivers = NULL;
 static int crypto_drivers_num = 0;
 
 /*
- * There are two queues for crypto requests; one for symmetric (e.g.
- * cipher) operations and one for asymmetric (e.g. MOD)operations.
- * A single mutex is used to lock access to both queues.  We could
- * have one per-queue but having one simplifies handling of block/unblock
- * operations.
+ * Symmetric (e.g. cipher) requests are queued per CPU.  Each CPU runs a
+ * dispatch thread which takes batches of requests from its own queue and,
+ * when that has nothing it can submit, steals from the queues of the other
+ * CPUs.  Completed requests are put on the return queue of the CPU that
+ * completed them and handed back by that CPU's return thread.
+ *
+ * (c) - protected by CRYPTO_CQ_LOCK()
+ * (r) - protected by CRYPTO_CQ_RETQ_LOCK()
+ */
+struct crypto_queue {
+	spinlock_t		cq_lock;
+	struct list_head	cq_q;		/* (c) crypto request queue */
+	int			cq_len;		/* (c) requests on cq_q */
+	int			cq_blocked;	/* (c) none can be submitted */
+	wait_queue_head_t	cq_wait;
+
+	spinlock_t		cq_ret_lock;
+	struct list_head	cq_ret_q;	/* (r) callback queue */
+	wait_queue_head_t	cq_ret_wait;
+} ____cacheline_aligned_in_smp;
+
+#ifndef CONFIG_NR_CPUS
+#define CONFIG_NR_CPUS 1
+#endif
+
+static struct crypto_queue crypto_queues[CONFIG_NR_CPUS];
+
+#define	CRYPTO_CQ_LOCK(cq) \
+			({ \
+				spin_lock_irqsave(&(cq)->cq_lock, q_flags); \
+			 	dprintk("%s,%d: CQ_LOCK()\n", __FILE__, __LINE__); \
+			 })
+#define	CRYPTO_CQ_UNLOCK(cq) \
+			({ \
+			 	dprintk("%s,%d: CQ_UNLOCK()\n", __FILE__, __LINE__); \
+				spin_unlock_irqrestore(&(cq)->cq_lock, q_flags); \
+			 })
+#define	CRYPTO_CQ_RETQ_LOCK(cq) \
+			({ \
+				spin_lock_irqsave(&(cq)->cq_ret_lock, r_flags); \
+				dprintk("%s,%d: CQ_RETQ_LOCK\n", __FILE__, __LINE__); \
+			 })
+#define	CRYPTO_CQ_RETQ_UNLOCK(cq) \
+			({ \
+			 	dprintk("%s,%d: CQ_RETQ_UNLOCK\n", __FILE__, __LINE__); \
+				spin_unlock_irqrestore(&(cq)->cq_ret_lock, r_flags); \
+			 })
+
+/*
+ * Asymmetric (e.g. MOD) operations are rare and slow, they share a single
+ * queue.  Its lock also protects the block state of the drivers.
  */
-static LIST_HEAD(crp_q);		/* crypto request queue */
 static LIST_HEAD(crp_kq);		/* asym request queue */
 
 static spinlock_t crypto_q_lock;
 
-int crypto_all_qblocked = 0;  /* protect with Q_LOCK */
+int crypto_all_qblocked = 0;  /* hint, all queued requests are blocked */
 module_param(crypto_all_qblocked, int, 0444);
 MODULE_PARM_DESC(crypto_all_qblocked, "Are all crypto queues blocked");
 
@@ -181,15 +227,11 @@ MODULE_PARM_DESC(crypto_all_kqblocked, "Are all asym crypto queues blocked");
 			 })
 
 /*
- * There are two queues for processing completed crypto requests; one
- * for the symmetric and one for the asymmetric ops.  We only need one
- * but have two to avoid type futzing (cryptop vs. cryptkop).  A single
- * mutex is used to lock access to both queues.  Note that this lock
- * must be separate from the lock on request queues to insure driver
- * callbacks don't generate lock order reversals.
+ * Completed asymmetric ops are returned through a single queue.  Note
+ * that the return queue locks must be separate from the locks on request
+ * queues to insure driver callbacks don't generate lock order reversals.
  */
-static LIST_HEAD(crp_ret_q);		/* callback queues */
-static LIST_HEAD(crp_ret_kq);
+static LIST_HEAD(crp_ret_kq);		/* asym callback queue */
 
 static spinlock_t crypto_ret_q_lock;
 #define	CRYPTO_RETQ_LOCK() \
@@ -202,7 +244,6 @@ static spinlock_t crypto_ret_q_lock;
 			 	dprintk("%s,%d: RETQ_UNLOCK\n", __FILE__, __LINE__); \
 				spin_unlock_irqrestore(&crypto_ret_q_lock, r_flags); \
 			 })
-#define	CRYPTO_RETQ_EMPTY()	(list_empty(&crp_ret_q) && list_empty(&crp_ret_kq))
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,20)
 static kmem_cache_t *cryptop_zone;
@@ -229,8 +270,8 @@ EXPORT_SYMBOL(crypto_debug);
  * slow,  printing anything will just kill us
  */
 
-static int crypto_q_cnt = 0;
-module_param(crypto_q_cnt, int, 0444);
+static atomic_t crypto_q_cnt = ATOMIC_INIT(0);
+module_param_named(crypto_q_cnt, crypto_q_cnt.counter, int, 0444);
 MODULE_PARM_DESC(crypto_q_cnt,
 		"Current number of outstanding crypto requests");
 
@@ -272,14 +313,18 @@ module_param(crypto_max_loopcount, int, 0644);
 MODULE_PARM_DESC(crypto_max_loopcount,
 	   "Maximum number of crypto ops to do before yielding to other processes");
 
-#ifndef CONFIG_NR_CPUS
-#define CONFIG_NR_CPUS 1
-#endif
+/*
+ * Maximum number of requests for the same driver the crypto thread takes
+ * from a queue at once.  All but the last one are passed to the driver
+ * with CRYPTO_HINT_MORE so it can defer kicking the hardware.
+ */
+static int crypto_max_batch = 16;
+module_param(crypto_max_batch, int, 0644);
+MODULE_PARM_DESC(crypto_max_batch,
+	   "Maximum number of crypto ops to submit to a driver in one batch");
 
 static struct task_struct *cryptoproc[CONFIG_NR_CPUS];
 static struct task_struct *cryptoretproc[CONFIG_NR_CPUS];
-static DECLARE_WAIT_QUEUE_HEAD(cryptoproc_wait);
-static DECLARE_WAIT_QUEUE_HEAD(cryptoretproc_wait);
 
 static	int crypto_proc(void *arg);
 static	int crypto_ret_proc(void *arg);
@@ -764,6 +809,60 @@ crypto_unregister_all(u_int32_t driverid)
 	return err;
 }
 
+/*
+ * Wake the crypto thread of a CPU.  If that thread is already busy (or
+ * there is none for the CPU) wake the next one as well so it can steal
+ * the queued work.
+ */
+static void
+crypto_wakeup(int cpu, int busy)
+{
+	int next = -1, c;
+
+	if (cryptoproc[cpu] != NULL)
+		wake_up_interruptible(&crypto_queues[cpu].cq_wait);
+	if (!busy && cryptoproc[cpu] != NULL)
+		return;
+
+	ocf_for_each_cpu(c) {
+		if (c == cpu || cryptoproc[c] == NULL)
+			continue;
+		if (next < 0)
+			next = c;		/* wrap around */
+		if (c > cpu) {
+			next = c;
+			break;
+		}
+	}
+	if (next >= 0)
+		wake_up_interruptible(&crypto_queues[next].cq_wait);
+}
+
+static void
+crypto_wakeup_all(void)
+{
+	int cpu;
+
+	ocf_for_each_cpu(cpu)
+		if (cryptoproc[cpu] != NULL)
+			wake_up_interruptible(&crypto_queues[cpu].cq_wait);
+}
+
+/*
+ * A driver returned ERESTART for a request, mark it ``blocked'' for
+ * cryptop's unless it was unblocked since the request was handed to it.
+ */
+static void
+crypto_block(struct cryptocap *cap, int gen)
+{
+	unsigned long q_flags;
+
+	CRYPTO_Q_LOCK();
+	if (cap->cc_qgen == gen)
+		cap->cc_qblocked = 1;
+	CRYPTO_Q_UNLOCK();
+}
+
 /*
  * Clear blockage on a driver.  The what parameter indicates whether
  * the driver is now ready for cryptop's and/or cryptokop's.
@@ -771,8 +870,9 @@ crypto_unregister_all(u_int32_t driverid)
 int
 crypto_unblock(u_int32_t driverid, int what)
 {
+	struct crypto_queue *cq;
 	struct cryptocap *cap;
-	int err;
+	int err, cpu;
 	unsigned long q_flags;
 
 	CRYPTO_Q_LOCK();
@@ -780,7 +880,7 @@ crypto_unblock(u_int32_t driverid, int what)
 	if (cap != NULL) {
 		if (what & CRYPTO_SYMQ) {
 			cap->cc_qblocked = 0;
-			cap->cc_unqblocked = 0;
+			cap->cc_qgen++;
 			crypto_all_qblocked = 0;
 		}
 		if (what & CRYPTO_ASYMQ) {
@@ -788,36 +888,44 @@ crypto_unblock(u_int32_t driverid, int what)
 			cap->cc_unkqblocked = 0;
 			crypto_all_kqblocked = 0;
 		}
-		wake_up_interruptible(&cryptoproc_wait);
 		err = 0;
 	} else
 		err = EINVAL;
 	CRYPTO_Q_UNLOCK(); //DAVIDM should this be a driver lock
 
+	if (err == 0) {
+		ocf_for_each_cpu(cpu) {
+			cq = &crypto_queues[cpu];
+			CRYPTO_CQ_LOCK(cq);
+			cq->cq_blocked = 0;
+			CRYPTO_CQ_UNLOCK(cq);
+		}
+		crypto_wakeup_all();
+	}
 	return err;
 }
 
 /*
- * Add a crypto request to a queue, to be processed by the kernel thread.
+ * Add a crypto request to the queue of the current CPU, to be processed
+ * by the kernel thread.
  */
 int
 crypto_dispatch(struct cryptop *crp)
 {
+	struct crypto_queue *cq;
 	struct cryptocap *cap;
-	int result = -1;
+	int result = -1, cpu, busy, gen;
 	unsigned long q_flags;
 
 	dprintk("%s()\n", __FUNCTION__);
 
 	cryptostats.cs_ops++;
 
-	CRYPTO_Q_LOCK();
-	if (crypto_q_cnt >= crypto_q_max) {
+	if (atomic_inc_return(&crypto_q_cnt) > crypto_q_max) {
+		atomic_dec(&crypto_q_cnt);
 		cryptostats.cs_drops++;
-		CRYPTO_Q_UNLOCK();
 		return ENOMEM;
 	}
-	crypto_q_cnt++;
 
 	/* make sure we are starting a fresh run on this crp. */
 	crp->crp_flags &= ~CRYPTO_F_DONE;
@@ -834,36 +942,36 @@ crypto_dispatch(struct cryptop *crp)
 		KASSERT(cap != NULL, ("%s: Driver disappeared.", __func__));
 		if (!cap->cc_qblocked) {
 			crypto_all_qblocked = 0;
-			crypto_drivers[hid].cc_unqblocked = 1;
-			CRYPTO_Q_UNLOCK();
+			gen = cap->cc_qgen;
 			result = crypto_invoke(cap, crp, 0);
-			CRYPTO_Q_LOCK();
 			if (result == ERESTART)
-				if (crypto_drivers[hid].cc_unqblocked)
-					crypto_drivers[hid].cc_qblocked = 1;
-			crypto_drivers[hid].cc_unqblocked = 0;
+				crypto_block(cap, gen);
 		}
 	}
+	if (result != -1 && result != ERESTART)
+		return result;
+
+	cpu = ocf_this_cpu();
+	cq = &crypto_queues[cpu];
+	CRYPTO_CQ_LOCK(cq);
 	if (result == ERESTART) {
 		/*
-		 * The driver ran out of resources, mark the
-		 * driver ``blocked'' for cryptop's and put
-		 * the request back in the queue.  It would
-		 * best to put the request back where we got
-		 * it but that's hard so for now we put it
-		 * at the front.  This should be ok; putting
-		 * it at the end does not work.
+		 * The driver ran out of resources, put the request back
+		 * in the queue.  It would best to put the request back
+		 * where we got it but that's hard so for now we put it
+		 * at the front.  This should be ok; putting it at the end
+		 * does not work.
 		 */
-		list_add(&crp->crp_next, &crp_q);
+		list_add(&crp->crp_next, &cq->cq_q);
 		cryptostats.cs_blocks++;
-		result = 0;
-	} else if (result == -1) {
-		TAILQ_INSERT_TAIL(&crp_q, crp, crp_next);
-		result = 0;
-	}
-	wake_up_interruptible(&cryptoproc_wait);
-	CRYPTO_Q_UNLOCK();
-	return result;
+	} else
+		list_add_tail(&crp->crp_next, &cq->cq_q);
+	busy = cq->cq_len++;
+	cq->cq_blocked = 0;
+	CRYPTO_CQ_UNLOCK(cq);
+
+	crypto_wakeup(cpu, busy);
+	return 0;
 }
 
 /*
@@ -882,8 +990,8 @@ crypto_kdispatch(struct cryptkop *krp)
 	if (error == ERESTART) {
 		CRYPTO_Q_LOCK();
 		TAILQ_INSERT_TAIL(&crp_kq, krp, krp_next);
-		wake_up_interruptible(&cryptoproc_wait);
 		CRYPTO_Q_UNLOCK();
+		crypto_wakeup(ocf_this_cpu(), 0);
 		error = 0;
 	}
 	return error;
@@ -1084,23 +1192,28 @@ crypto_freereq(struct cryptop *crp)
 
 #ifdef DIAGNOSTIC
 	{
+		struct crypto_queue *cq;
 		struct cryptop *crp2;
-		unsigned long q_flags;
-
-		CRYPTO_Q_LOCK();
-		TAILQ_FOREACH(crp2, &crp_q, crp_next) {
-			KASSERT(crp2 != crp,
-			    ("Freeing cryptop from the crypto queue (%p).",
-			    crp));
-		}
-		CRYPTO_Q_UNLOCK();
-		CRYPTO_RETQ_LOCK();
-		TAILQ_FOREACH(crp2, &crp_ret_q, crp_next) {
-			KASSERT(crp2 != crp,
-			    ("Freeing cryptop from the return queue (%p).",
-			    crp));
+		unsigned long q_flags, r_flags;
+		int cpu;
+
+		ocf_for_each_cpu(cpu) {
+			cq = &crypto_queues[cpu];
+			CRYPTO_CQ_LOCK(cq);
+			TAILQ_FOREACH(crp2, &cq->cq_q, crp_next) {
+				KASSERT(crp2 != crp,
+				    ("Freeing cryptop from the crypto queue (%p).",
+				    crp));
+			}
+			CRYPTO_CQ_UNLOCK(cq);
+			CRYPTO_CQ_RETQ_LOCK(cq);
+			TAILQ_FOREACH(crp2, &cq->cq_ret_q, crp_next) {
+				KASSERT(crp2 != crp,
+				    ("Freeing cryptop from the return queue (%p).",
+				    crp));
+			}
+			CRYPTO_CQ_RETQ_UNLOCK(cq);
 		}
-		CRYPTO_RETQ_UNLOCK();
 	}
 #endif
 
@@ -1140,19 +1253,16 @@ crypto_getreq(int num)
 }
 
 /*
- * Invoke the callback on behalf of the driver.
+ * Account for a completed request and do the callback right away if that
+ * is allowed.  Returns non-zero if the callback is left to the thread.
  */
-void
-crypto_done(struct cryptop *crp)
+static int
+crypto_done_one(struct cryptop *crp)
 {
-	unsigned long q_flags;
-
 	dprintk("%s()\n", __FUNCTION__);
 	if ((crp->crp_flags & CRYPTO_F_DONE) == 0) {
 		crp->crp_flags |= CRYPTO_F_DONE;
-		CRYPTO_Q_LOCK();
-		crypto_q_cnt--;
-		CRYPTO_Q_UNLOCK();
+		atomic_dec(&crypto_q_cnt);
 	} else
 		printk("crypto: crypto_done op already done, flags 0x%x",
 				crp->crp_flags);
@@ -1174,16 +1284,61 @@ crypto_done(struct cryptop *crp)
 		 * /dev/crypto callback method just does a wakeup).
 		 */
 		crp->crp_callback(crp);
-	} else {
-		unsigned long r_flags;
-		/*
-		 * Normal case; queue the callback for the thread.
-		 */
-		CRYPTO_RETQ_LOCK();
-		wake_up_interruptible(&cryptoretproc_wait);/* shared wait channel */
-		TAILQ_INSERT_TAIL(&crp_ret_q, crp, crp_next);
-		CRYPTO_RETQ_UNLOCK();
+		return 0;
 	}
+	return 1;
+}
+
+/*
+ * Queue callbacks for the return thread of this CPU, it is only woken
+ * when its queue was empty.
+ */
+static void
+crypto_ret_queue(struct list_head *list)
+{
+	struct crypto_queue *cq = &crypto_queues[ocf_this_cpu()];
+	unsigned long r_flags;
+	int wake;
+
+	CRYPTO_CQ_RETQ_LOCK(cq);
+	wake = list_empty(&cq->cq_ret_q);
+	list_splice(list, cq->cq_ret_q.prev);
+	CRYPTO_CQ_RETQ_UNLOCK(cq);
+	if (wake)
+		wake_up_interruptible(&cq->cq_ret_wait);
+}
+
+/*
+ * Invoke the callback on behalf of the driver.
+ */
+void
+crypto_done(struct cryptop *crp)
+{
+	LIST_HEAD(list);
+
+	if (crypto_done_one(crp)) {
+		list_add(&crp->crp_next, &list);
+		crypto_ret_queue(&list);
+	}
+}
+
+/*
+ * Complete a batch of requests linked through crp_next, the callbacks
+ * which are left to the thread are queued with a single wakeup.
+ */
+void
+crypto_done_list(struct list_head *list)
+{
+	struct cryptop *crp, *tmp;
+	LIST_HEAD(ret);
+
+	list_for_each_entry_safe(crp, tmp, list, crp_next) {
+		list_del(&crp->crp_next);
+		if (crypto_done_one(crp))
+			list_add_tail(&crp->crp_next, &ret);
+	}
+	if (!list_empty(&ret))
+		crypto_ret_queue(&ret);
 }
 
 /*
@@ -1230,9 +1385,9 @@ crypto_kdone(struct cryptkop *krp)
 		 * Normal case; queue the callback for the thread.
 		 */
 		CRYPTO_RETQ_LOCK();
-		wake_up_interruptible(&cryptoretproc_wait);/* shared wait channel */
 		TAILQ_INSERT_TAIL(&crp_ret_kq, krp, krp_next);
 		CRYPTO_RETQ_UNLOCK();
+		wake_up_interruptible(&crypto_queues[ocf_this_cpu()].cq_ret_wait);
 	}
 }
 
@@ -1260,40 +1415,26 @@ crypto_getfeat(int *featp)
 }
 
 /*
- * Crypto thread, dispatches crypto requests.
+ * Take a batch of requests for one driver off a queue.  The batch starts
+ * with the first request whose driver is not blocked and holds at most
+ * crypto_max_batch requests; it ends early at a request which is not
+ * marked CRYPTO_F_BATCH.  Requests for other drivers stay queued.
  */
 static int
-crypto_proc(void *arg)
+crypto_take(struct crypto_queue *cq, struct list_head *batch, int *queued)
 {
-	struct cryptop *crp, *submit;
-	struct cryptkop *krp, *krpp;
+	struct cryptop *crp, *tmp;
 	struct cryptocap *cap;
-	u_int32_t hid;
-	int result, hint;
+	u_int32_t hid, bhid = 0;
 	unsigned long q_flags;
-	int loopcount = 0;
-
-	set_current_state(TASK_INTERRUPTIBLE);
-
-	CRYPTO_Q_LOCK();
-	for (;;) {
-		/*
-		 * we need to make sure we don't get into a busy loop with nothing
-		 * to do,  the two crypto_all_*blocked vars help us find out when
-		 * we are all full and can do nothing on any driver or Q.  If so we
-		 * wait for an unblock.
-		 */
-		crypto_all_qblocked  = !list_empty(&crp_q);
-
-		/*
-		 * Find the first element in the queue that can be
-		 * processed and look-ahead to see if multiple ops
-		 * are ready for the same driver.
-		 */
-		submit = NULL;
-		hint = 0;
-		list_for_each_entry(crp, &crp_q, crp_next) {
-			hid = CRYPTO_SESID2HID(crp->crp_sid);
+	int n = 0;
+
+	CRYPTO_CQ_LOCK(cq);
+	if (!list_empty(&cq->cq_q))
+		*queued = 1;
+	list_for_each_entry_safe(crp, tmp, &cq->cq_q, crp_next) {
+		hid = CRYPTO_SESID2HID(crp->crp_sid);
+		if (n == 0) {
 			cap = crypto_checkdriver(hid);
 			/*
 			 * Driver cannot disappear when there is an active
@@ -1302,67 +1443,144 @@ crypto_proc(void *arg)
 			KASSERT(cap != NULL, ("%s:%u Driver disappeared.",
 			    __func__, __LINE__));
 			if (cap == NULL || cap->cc_dev == NULL) {
-				/* Op needs to be migrated, process it. */
-				if (submit == NULL)
-					submit = crp;
+				/* Op needs to be migrated, process it alone. */
+				list_move_tail(&crp->crp_next, batch);
+				cq->cq_len--;
+				n++;
 				break;
 			}
-			if (!cap->cc_qblocked) {
-				if (submit != NULL) {
-					/*
-					 * We stop on finding another op,
-					 * regardless whether its for the same
-					 * driver or not.  We could keep
-					 * searching the queue but it might be
-					 * better to just use a per-driver
-					 * queue instead.
-					 */
-					if (CRYPTO_SESID2HID(submit->crp_sid) == hid)
-						hint = CRYPTO_HINT_MORE;
+			if (cap->cc_qblocked)
+				continue;
+			bhid = hid;
+		} else if (hid != bhid)
+			continue;
+
+		list_move_tail(&crp->crp_next, batch);
+		cq->cq_len--;
+		if (++n >= crypto_max_batch ||
+				(crp->crp_flags & CRYPTO_F_BATCH) == 0)
+			break;
+	}
+	cq->cq_blocked = (n == 0 && !list_empty(&cq->cq_q));
+	CRYPTO_CQ_UNLOCK(cq);
+	return n;
+}
+
+/*
+ * Hand a batch of requests to its driver.  If the driver runs out of
+ * resources the rest of the batch goes back to the front of the queue it
+ * was taken from.
+ */
+static void
+crypto_submit(struct crypto_queue *cq, struct list_head *batch)
+{
+	struct cryptop *crp;
+	struct cryptocap *cap;
+	struct list_head *p;
+	unsigned long q_flags;
+	int hint, gen, n;
+
+	while (!list_empty(batch)) {
+		crp = list_entry(batch->next, struct cryptop, crp_next);
+		list_del(&crp->crp_next);
+		hint = list_empty(batch) ? 0 : CRYPTO_HINT_MORE;
+
+		cap = crypto_checkdriver(CRYPTO_SESID2HID(crp->crp_sid));
+		KASSERT(cap != NULL, ("%s:%u Driver disappeared.",
+		    __func__, __LINE__));
+		gen = cap->cc_qgen;
+		if (crypto_invoke(cap, crp, hint) != ERESTART)
+			continue;
+
+		/*
+		 * The driver ran out of resources, mark the driver
+		 * ``blocked'' for cryptop's and put the requests back
+		 * at the front of the queue in their original order.
+		 */
+		crypto_block(cap, gen);
+		list_add(&crp->crp_next, batch);
+		n = 0;
+		list_for_each(p, batch)
+			n++;
+		CRYPTO_CQ_LOCK(cq);
+		list_splice(batch, &cq->cq_q);
+		cq->cq_len += n;
+		CRYPTO_CQ_UNLOCK(cq);
+		INIT_LIST_HEAD(batch);
+		cryptostats.cs_blocks++;
+	}
+}
+
+/*
+ * Is there anything a crypto thread could submit?
+ */
+static int
+crypto_proc_ready(void)
+{
+	struct crypto_queue *cq;
+	int cpu;
+
+	ocf_for_each_cpu(cpu) {
+		cq = &crypto_queues[cpu];
+		if (cq->cq_len && !cq->cq_blocked)
+			return 1;
+	}
+	return !(list_empty(&crp_kq) || crypto_all_kqblocked);
+}
+
+/*
+ * Crypto thread, dispatches crypto requests.
+ */
+static int
+crypto_proc(void *arg)
+{
+	int cpu = (int) (unsigned long) arg;
+	struct crypto_queue *cq = &crypto_queues[cpu], *src;
+	struct cryptkop *krp, *krpp;
+	struct cryptocap *cap;
+	LIST_HEAD(batch);
+	int result, queued, n, c;
+	unsigned long q_flags;
+	int loopcount = 0;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (;;) {
+		/*
+		 * Work on our own queue first and steal from the queues of
+		 * the other CPUs when it holds nothing we can submit.
+		 */
+		queued = 0;
+		src = cq;
+		n = crypto_take(cq, &batch, &queued);
+		if (n == 0) {
+			ocf_for_each_cpu(c) {
+				src = &crypto_queues[c];
+				if (c == cpu || src->cq_len == 0 || src->cq_blocked)
+					continue;
+				n = crypto_take(src, &batch, &queued);
+				if (n)
 					break;
-				} else {
-					submit = crp;
-					if ((submit->crp_flags & CRYPTO_F_BATCH) == 0)
-						break;
-					/* keep scanning for more are q'd */
-				}
-			}
-		}
-		if (submit != NULL) {
-			hid = CRYPTO_SESID2HID(submit->crp_sid);
-			crypto_all_qblocked = 0;
-			list_del(&submit->crp_next);
-			crypto_drivers[hid].cc_unqblocked = 1;
-			cap = crypto_checkdriver(hid);
-			CRYPTO_Q_UNLOCK();
-			KASSERT(cap != NULL, ("%s:%u Driver disappeared.",
-			    __func__, __LINE__));
-			result = crypto_invoke(cap, submit, hint);
-			CRYPTO_Q_LOCK();
-			if (result == ERESTART) {
-				/*
-				 * The driver ran out of resources, mark the
-				 * driver ``blocked'' for cryptop's and put
-				 * the request back in the queue.  It would
-				 * best to put the request back where we got
-				 * it but that's hard so for now we put it
-				 * at the front.  This should be ok; putting
-				 * it at the end does not work.
-				 */
-				/* XXX validate sid again? */
-				list_add(&submit->crp_next, &crp_q);
-				cryptostats.cs_blocks++;
-				if (crypto_drivers[hid].cc_unqblocked)
-					crypto_drivers[hid].cc_qblocked=0;
-				crypto_drivers[hid].cc_unqblocked=0;
 			}
-			crypto_drivers[hid].cc_unqblocked = 0;
 		}
 
-		crypto_all_kqblocked = !list_empty(&crp_kq);
+		/*
+		 * we need to make sure we don't get into a busy loop with nothing
+		 * to do,  the crypto_all_*blocked vars help us find out when
+		 * we are all full and can do nothing on any driver or Q.  If so we
+		 * wait for an unblock.
+		 */
+		crypto_all_qblocked = (n == 0 && queued);
+		if (n)
+			crypto_submit(src, &batch);
 
 		/* As above, but for key ops */
 		krp = NULL;
+		if (list_empty(&crp_kq))
+			goto idle;
+
+		CRYPTO_Q_LOCK();
+		crypto_all_kqblocked = !list_empty(&crp_kq);
 		list_for_each_entry(krpp, &crp_kq, krp_next) {
 			cap = crypto_checkdriver(krpp->krp_hid);
 			if (cap == NULL || cap->cc_dev == NULL) {
@@ -1407,8 +1625,10 @@ crypto_proc(void *arg)
 			} else
 				crypto_drivers[krp->krp_hid].cc_kqblocked = 0;
 		}
+		CRYPTO_Q_UNLOCK();
 
-		if (submit == NULL && krp == NULL) {
+idle:
+		if (n == 0 && krp == NULL) {
 			/*
 			 * Nothing more to be processed.  Sleep until we're
 			 * woken because there are more ops to process.
@@ -1421,16 +1641,13 @@ crypto_proc(void *arg)
 			 * out of order if dispatched to different devices
 			 * and some become blocked while others do not.
 			 */
-			dprintk("%s - sleeping (qe=%d qb=%d kqe=%d kqb=%d)\n",
+			dprintk("%s - sleeping (ql=%d qb=%d kqe=%d kqb=%d)\n",
 					__FUNCTION__,
-					list_empty(&crp_q), crypto_all_qblocked,
+					cq->cq_len, crypto_all_qblocked,
 					list_empty(&crp_kq), crypto_all_kqblocked);
 			loopcount = 0;
-			CRYPTO_Q_UNLOCK();
-			wait_event_interruptible(cryptoproc_wait,
-					!(list_empty(&crp_q) || crypto_all_qblocked) ||
-					!(list_empty(&crp_kq) || crypto_all_kqblocked) ||
-					kthread_should_stop());
+			wait_event_interruptible(cq->cq_wait,
+					crypto_proc_ready() || kthread_should_stop());
 			if (signal_pending (current)) {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,0)
 				spin_lock_irq(&current->sigmask_lock);
@@ -1440,7 +1657,6 @@ crypto_proc(void *arg)
 				spin_unlock_irq(&current->sigmask_lock);
 #endif
 			}
-			CRYPTO_Q_LOCK();
 			dprintk("%s - awake\n", __FUNCTION__);
 			if (kthread_should_stop())
 				break;
@@ -1451,13 +1667,10 @@ crypto_proc(void *arg)
 			 * been using the CPU exclusively for a while.
 			 */
 			loopcount = 0;
-			CRYPTO_Q_UNLOCK();
 			schedule();
-			CRYPTO_Q_LOCK();
 		}
-		loopcount++;
+		loopcount += n ? n : 1;
 	}
-	CRYPTO_Q_UNLOCK();
 	return 0;
 }
 
@@ -1465,50 +1678,54 @@ crypto_proc(void *arg)
  * Crypto returns thread, does callbacks for processed crypto requests.
  * Callbacks are done here, rather than in the crypto drivers, because
  * callbacks typically are expensive and would slow interrupt handling.
+ * All requests completed on this CPU are taken off the queue at once.
  */
 static int
 crypto_ret_proc(void *arg)
 {
-	struct cryptop *crpt;
+	int cpu = (int) (unsigned long) arg;
+	struct crypto_queue *cq = &crypto_queues[cpu];
+	struct cryptop *crpt, *tmp;
 	struct cryptkop *krpt;
+	LIST_HEAD(done);
 	unsigned long  r_flags;
 
 	set_current_state(TASK_INTERRUPTIBLE);
 
-	CRYPTO_RETQ_LOCK();
 	for (;;) {
 		/* Harvest return q's for completed ops */
-		crpt = NULL;
-		if (!list_empty(&crp_ret_q))
-			crpt = list_entry(crp_ret_q.next, typeof(*crpt), crp_next);
-		if (crpt != NULL)
-			list_del(&crpt->crp_next);
+		CRYPTO_CQ_RETQ_LOCK(cq);
+		list_splice_init(&cq->cq_ret_q, &done);
+		CRYPTO_CQ_RETQ_UNLOCK(cq);
 
 		krpt = NULL;
-		if (!list_empty(&crp_ret_kq))
-			krpt = list_entry(crp_ret_kq.next, typeof(*krpt), krp_next);
-		if (krpt != NULL)
-			list_del(&krpt->krp_next);
-
-		if (crpt != NULL || krpt != NULL) {
+		if (!list_empty(&crp_ret_kq)) {
+			CRYPTO_RETQ_LOCK();
+			if (!list_empty(&crp_ret_kq))
+				krpt = list_entry(crp_ret_kq.next, typeof(*krpt), krp_next);
+			if (krpt != NULL)
+				list_del(&krpt->krp_next);
 			CRYPTO_RETQ_UNLOCK();
+		}
+
+		if (!list_empty(&done) || krpt != NULL) {
 			/*
 			 * Run callbacks unlocked.
 			 */
-			if (crpt != NULL)
+			list_for_each_entry_safe(crpt, tmp, &done, crp_next) {
+				list_del(&crpt->crp_next);
 				crpt->crp_callback(crpt);
+			}
 			if (krpt != NULL)
 				krpt->krp_callback(krpt);
-			CRYPTO_RETQ_LOCK();
 		} else {
 			/*
 			 * Nothing more to be processed.  Sleep until we're
 			 * woken because there are more returns to process.
 			 */
 			dprintk("%s - sleeping\n", __FUNCTION__);
-			CRYPTO_RETQ_UNLOCK();
-			wait_event_interruptible(cryptoretproc_wait,
-					!list_empty(&crp_ret_q) ||
+			wait_event_interruptible(cq->cq_ret_wait,
+					!list_empty(&cq->cq_ret_q) ||
 					!list_empty(&crp_ret_kq) ||
 					kthread_should_stop());
 			if (signal_pending (current)) {
@@ -1520,7 +1737,6 @@ crypto_ret_proc(void *arg)
 				spin_unlock_irq(&current->sigmask_lock);
 #endif
 			}
-			CRYPTO_RETQ_LOCK();
 			dprintk("%s - awake\n", __FUNCTION__);
 			if (kthread_should_stop()) {
 				dprintk("%s - EXITING!\n", __FUNCTION__);
@@ -1529,7 +1745,6 @@ crypto_ret_proc(void *arg)
 			cryptostats.cs_rets++;
 		}
 	}
-	CRYPTO_RETQ_UNLOCK();
 	return 0;
 }
 
@@ -1565,7 +1780,9 @@ db_show_drivers(void)
 
 DB_SHOW_COMMAND(crypto, db_show_crypto)
 {
+	struct crypto_queue *cq;
 	struct cryptop *crp;
+	int cpu;
 
 	db_show_drivers();
 	db_printf("\n");
@@ -1573,21 +1790,27 @@ DB_SHOW_COMMAND(crypto, db_show_crypto)
 	db_printf("%4s %8s %4s %4s %4s %4s %8s %8s\n",
 	    "HID", "Caps", "Ilen", "Olen", "Etype", "Flags",
 	    "Desc", "Callback");
-	TAILQ_FOREACH(crp, &crp_q, crp_next) {
-		db_printf("%4u %08x %4u %4u %4u %04x %8p %8p\n"
-		    , (int) CRYPTO_SESID2HID(crp->crp_sid)
-		    , (int) CRYPTO_SESID2CAPS(crp->crp_sid)
-		    , crp->crp_ilen, crp->crp_olen
-		    , crp->crp_etype
-		    , crp->crp_flags
-		    , crp->crp_desc
-		    , crp->crp_callback
-		);
+	ocf_for_each_cpu(cpu) {
+		cq = &crypto_queues[cpu];
+		TAILQ_FOREACH(crp, &cq->cq_q, crp_next) {
+			db_printf("%4u %08x %4u %4u %4u %04x %8p %8p\n"
+			    , (int) CRYPTO_SESID2HID(crp->crp_sid)
+			    , (int) CRYPTO_SESID2CAPS(crp->crp_sid)
+			    , crp->crp_ilen, crp->crp_olen
+			    , crp->crp_etype
+			    , crp->crp_flags
+			    , crp->crp_desc
+			    , crp->crp_callback
+			);
+		}
 	}
-	if (!TAILQ_EMPTY(&crp_ret_q)) {
+	ocf_for_each_cpu(cpu) {
+		cq = &crypto_queues[cpu];
+		if (TAILQ_EMPTY(&cq->cq_ret_q))
+			continue;
 		db_printf("\n%4s %4s %4s %8s\n",
 		    "HID", "Etype", "Flags", "Callback");
-		TAILQ_FOREACH(crp, &crp_ret_q, crp_next) {
+		TAILQ_FOREACH(crp, &cq->cq_ret_q, crp_next) {
 			db_printf("%4u %4u %04x %8p\n"
 			    , (int) CRYPTO_SESID2HID(crp->crp_sid)
 			    , crp->crp_etype
@@ -1616,7 +1839,7 @@ DB_SHOW_COMMAND(kcrypto, db_show_kcrypto)
 		    , krp->krp_callback
 		);
 	}
-	if (!TAILQ_EMPTY(&crp_ret_q)) {
+	if (!TAILQ_EMPTY(&crp_ret_kq)) {
 		db_printf("%4s %5s %8s %4s %8s\n",
 		    "Op", "Status", "CRID", "HID", "Callback");
 		TAILQ_FOREACH(krp, &crp_ret_kq, krp_next) {
@@ -1679,6 +1902,17 @@ crypto_init(void)
 
 	memset(crypto_drivers, 0, crypto_drivers_num * sizeof(struct cryptocap));
 
+	for (cpu = 0; cpu < CONFIG_NR_CPUS; cpu++) {
+		struct crypto_queue *cq = &crypto_queues[cpu];
+
+		spin_lock_init(&cq->cq_lock);
+		INIT_LIST_HEAD(&cq->cq_q);
+		init_waitqueue_head(&cq->cq_wait);
+		spin_lock_init(&cq->cq_ret_lock);
+		INIT_LIST_HEAD(&cq->cq_ret_q);
+		init_waitqueue_head(&cq->cq_ret_wait);
+	}
+
 	ocf_for_each_cpu(cpu) {
 		cryptoproc[cpu] = kthread_create(crypto_proc, (void *) cpu,
 									"ocf_%d", (int) cpu);
@@ -1751,6 +1985,7 @@ EXPORT_SYMBOL(crypto_kdispatch);
 EXPORT_SYMBOL(crypto_freereq);
 EXPORT_SYMBOL(crypto_getreq);
 EXPORT_SYMBOL(crypto_done);
+EXPORT_SYMBOL(crypto_done_list);
 EXPORT_SYMBOL(crypto_kdone);
 EXPORT_SYMBOL(crypto_getfeat);
 EXPORT_SYMBOL(crypto_userasymcrypto);
@@ -58,6 +58,7 @@ __FBSDID("$FreeBSD: src/sys/opencrypto/cryptodev.c,v 1.34 2007/05/09 19:37:02 gn
 #include <linux/file.h>
 #include <linux/mount.h>
 #include <linux/miscdevice.h>
+#include <linux/poll.h>
 #include <asm/uaccess.h>
 
 #include <cryptodev.h>
@@ -70,6 +71,11 @@ int cryptodev_debug = 0;
 module_param(cryptodev_debug, int, 0644);
 MODULE_PARM_DESC(cryptodev_debug, "Enable cryptodev debug");
 
+static int cryptodev_max_async = 256;
+module_param(cryptodev_max_async, int, 0644);
+MODULE_PARM_DESC(cryptodev_max_async,
+	"Max async ops queued on one open of /dev/crypto");
+
 struct csession_info {
 	u_int16_t	blocksize;
 	u_int16_t	minkey, maxkey;
@@ -94,7 +100,6 @@ struct csession {
 
 	caddr_t		key;
 	int		keylen;
-	u_char		tmp_iv[EALG_MAX_BLOCK_LEN];
 
 	caddr_t		mackey;
 	int		mackeylen;
@@ -104,11 +109,34 @@ struct csession {
 	struct iovec	iovec;
 	struct uio	uio;
 	int		error;
+
+	int		aops;		/* async ops not yet fetched */
 };
 
 struct fcrypt {
 	struct list_head	csessions;
 	int		sesn;
+
+	spinlock_t	lock;		/* protects the async state below */
+	wait_queue_head_t waitq;
+	struct list_head	done;	/* finished async ops */
+	int		queued;		/* async ops not yet fetched */
+	int		inflight;	/* async ops not yet finished */
+};
+
+/*
+ * An op queued by CIOCASYNCCRYPT, it is kept on fcr->done from its
+ * completion until CIOCASYNCFETCH hands it back.
+ */
+struct cryptodev_aop {
+	struct list_head	list;
+	struct fcrypt	*fcr;
+	struct csession	*cse;
+	int		authsize;	/* of cse, it may be gone by the fetch */
+	struct crypt_aop aop;
+	struct cryptop	*crp;
+	struct iovec	iovec;
+	struct uio	uio;
 };
 
 static struct csession *csefind(struct fcrypt *, u_int);
@@ -123,6 +151,7 @@ static	int cryptodev_key(struct crypt_kop *);
 static	int cryptodev_find(struct crypt_find_op *);
 
 static int cryptodev_cb(void *);
+static int cryptodev_async_cb(struct cryptop *);
 static int cryptodev_open(struct inode *inode, struct file *filp);
 
 /*
@@ -162,8 +191,14 @@ checkcrid(int crid)
 	return 0;
 }
 
+/*
+ * Build the OCF request for a crypt_op.  The user data is copied into a
+ * kernel buffer described by uio; on success the caller owns both the
+ * request and that buffer, on failure they have already been released.
+ */
 static int
-cryptodev_op(struct csession *cse, struct crypt_op *cop)
+cryptodev_prep(struct csession *cse, struct crypt_op *cop, struct uio *uio,
+	struct cryptop **crpp)
 {
 	struct cryptop *crp = NULL;
 	struct cryptodesc *crde = NULL, *crda = NULL;
@@ -181,24 +216,21 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		return (EINVAL);
 	}
 
-	cse->uio.uio_iov = &cse->iovec;
-	cse->uio.uio_iovcnt = 1;
-	cse->uio.uio_offset = 0;
+	uio->uio_offset = 0;
 #if 0
-	cse->uio.uio_resid = cop->len;
-	cse->uio.uio_segflg = UIO_SYSSPACE;
-	cse->uio.uio_rw = UIO_WRITE;
-	cse->uio.uio_td = td;
+	uio->uio_resid = cop->len;
+	uio->uio_segflg = UIO_SYSSPACE;
+	uio->uio_rw = UIO_WRITE;
+	uio->uio_td = td;
 #endif
-	cse->uio.uio_iov[0].iov_len = cop->len;
+	uio->uio_iov[0].iov_len = cop->len;
 	if (cse->info.authsize)
-		cse->uio.uio_iov[0].iov_len += cse->info.authsize;
-	cse->uio.uio_iov[0].iov_base = kmalloc(cse->uio.uio_iov[0].iov_len,
-			GFP_KERNEL);
+		uio->uio_iov[0].iov_len += cse->info.authsize;
+	uio->uio_iov[0].iov_base = kmalloc(uio->uio_iov[0].iov_len, GFP_KERNEL);
 
-	if (cse->uio.uio_iov[0].iov_base == NULL) {
+	if (uio->uio_iov[0].iov_base == NULL) {
 		dprintk("%s: iov_base kmalloc(%d) failed\n", __FUNCTION__,
-				(int)cse->uio.uio_iov[0].iov_len);
+				(int)uio->uio_iov[0].iov_len);
 		return (ENOMEM);
 	}
 
@@ -227,7 +259,7 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		goto bail;
 	}
 
-	if ((error = copy_from_user(cse->uio.uio_iov[0].iov_base, cop->src,
+	if ((error = copy_from_user(uio->uio_iov[0].iov_base, cop->src,
 					cop->len))) {
 		dprintk("%s: bad copy\n", __FUNCTION__);
 		goto bail;
@@ -256,13 +288,10 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crde->crd_klen = cse->keylen * 8;
 	}
 
-	crp->crp_ilen = cse->uio.uio_iov[0].iov_len;
-	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM
-		       | (cop->flags & COP_F_BATCH);
-	crp->crp_buf = (caddr_t)&cse->uio;
-	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_cb;
+	crp->crp_ilen = uio->uio_iov[0].iov_len;
+	crp->crp_flags = CRYPTO_F_IOV | (cop->flags & COP_F_BATCH);
+	crp->crp_buf = (caddr_t)uio;
 	crp->crp_sid = cse->sid;
-	crp->crp_opaque = (void *)cse;
 
 	if (cop->iv) {
 		if (crde == NULL) {
@@ -275,12 +304,15 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 			dprintk("%s arc4 with IV\n", __FUNCTION__);
 			goto bail;
 		}
-		if ((error = copy_from_user(cse->tmp_iv, cop->iv,
+		/*
+		 * NB: straight into the descriptor, async ops on the same
+		 * session may be prepared concurrently.
+		 */
+		if ((error = copy_from_user(crde->crd_iv, cop->iv,
 						cse->info.blocksize))) {
 			dprintk("%s bad iv copy\n", __FUNCTION__);
 			goto bail;
 		}
-		memcpy(crde->crd_iv, cse->tmp_iv, cse->info.blocksize);
 		crde->crd_flags |= CRD_F_IV_EXPLICIT | CRD_F_IV_PRESENT;
 		crde->crd_skip = 0;
 	} else if (cse->cipher == CRYPTO_ARC4) { /* XXX use flag? */
@@ -297,6 +329,58 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		goto bail;
 	}
 
+	*crpp = crp;
+	return (0);
+
+bail:
+	if (crp)
+		crypto_freereq(crp);
+	kfree(uio->uio_iov[0].iov_base);
+	uio->uio_iov[0].iov_base = NULL;
+	return (error);
+}
+
+/*
+ * Copy the result of a finished request back to the user's buffers.
+ */
+static int
+cryptodev_copyout(struct crypt_op *cop, struct uio *uio, int authsize)
+{
+	int error = 0;
+
+	if (cop->dst && (error = copy_to_user(cop->dst,
+					uio->uio_iov[0].iov_base, cop->len))) {
+		dprintk("%s bad dst copy\n", __FUNCTION__);
+		return (error);
+	}
+
+	if (cop->mac &&
+			(error=copy_to_user(cop->mac,
+				(caddr_t)uio->uio_iov[0].iov_base + cop->len,
+				authsize))) {
+		dprintk("%s bad mac copy\n", __FUNCTION__);
+		return (error);
+	}
+	return (0);
+}
+
+static int
+cryptodev_op(struct csession *cse, struct crypt_op *cop)
+{
+	struct cryptop *crp = NULL;
+	int error = 0;
+
+	dprintk("%s()\n", __FUNCTION__);
+	cse->uio.uio_iov = &cse->iovec;
+	cse->uio.uio_iovcnt = 1;
+	error = cryptodev_prep(cse, cop, &cse->uio, &crp);
+	if (error)
+		return (error);
+
+	crp->crp_flags |= CRYPTO_F_CBIMM;
+	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_cb;
+	crp->crp_opaque = (void *)cse;
+
 	/*
 	 * Let the dispatch run unlocked, then, interlock against the
 	 * callback before checking if the operation completed and going
@@ -343,25 +427,11 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		goto bail;
 	}
 
-	if (cop->dst && (error = copy_to_user(cop->dst,
-					cse->uio.uio_iov[0].iov_base, cop->len))) {
-		dprintk("%s bad dst copy\n", __FUNCTION__);
-		goto bail;
-	}
-
-	if (cop->mac &&
-			(error=copy_to_user(cop->mac,
-				(caddr_t)cse->uio.uio_iov[0].iov_base + cop->len,
-				cse->info.authsize))) {
-		dprintk("%s bad mac copy\n", __FUNCTION__);
-		goto bail;
-	}
+	error = cryptodev_copyout(cop, &cse->uio, cse->info.authsize);
 
 bail:
-	if (crp)
-		crypto_freereq(crp);
-	if (cse->uio.uio_iov[0].iov_base)
-		kfree(cse->uio.uio_iov[0].iov_base);
+	crypto_freereq(crp);
+	kfree(cse->uio.uio_iov[0].iov_base);
 
 	return (error);
 }
@@ -393,6 +463,202 @@ cryptodev_cb(void *op)
 	return (0);
 }
 
+static void
+cryptodev_async_done(struct cryptodev_aop *aop, int inflight)
+{
+	struct fcrypt *fcr = aop->fcr;
+	unsigned long flags;
+	int wake;
+
+	/*
+	 * Readers only sleep while the done list is empty and release only
+	 * waits for the last op in flight, so most completions of a batch
+	 * need no wakeup at all.  The wakeup is done under the lock as
+	 * release may free fcr as soon as we drop it.
+	 */
+	spin_lock_irqsave(&fcr->lock, flags);
+	wake = list_empty(&fcr->done);
+	list_add_tail(&aop->list, &fcr->done);
+	if (inflight && --fcr->inflight == 0)
+		wake = 1;
+	if (wake)
+		wake_up(&fcr->waitq);
+	spin_unlock_irqrestore(&fcr->lock, flags);
+}
+
+static int
+cryptodev_async_cb(struct cryptop *crp)
+{
+	struct cryptodev_aop *aop = (struct cryptodev_aop *)crp->crp_opaque;
+
+	int error;
+
+	dprintk("%s()\n", __FUNCTION__);
+	if (crp->crp_etype == EAGAIN) {
+		crp->crp_flags &= ~CRYPTO_F_DONE;
+		error = crypto_dispatch(crp);
+		if (error == 0)
+			return (0);
+		/* nobody calls us back for this op, finish it here */
+		aop->aop.status = error;
+		cryptodev_async_done(aop, 1);
+		return (error);
+	}
+	aop->aop.status = crp->crp_etype;
+	cryptodev_async_done(aop, 1);
+	return (0);
+}
+
+static void
+cryptodev_aop_free(struct cryptodev_aop *aop)
+{
+	if (aop->crp)
+		crypto_freereq(aop->crp);
+	if (aop->iovec.iov_base)
+		kfree(aop->iovec.iov_base);
+	kfree(aop);
+}
+
+/*
+ * Queue the ops of a CIOCASYNCCRYPT.  All of them are marked for
+ * batching so the crypto threads hand them to the driver in runs.  An
+ * op that cannot be prepared is put straight on the done list with its
+ * error, we only stop early when out of room or memory.
+ */
+static int
+cryptodev_submit(struct fcrypt *fcr, struct crypt_mop *mop)
+{
+	struct cryptodev_aop *aop;
+	struct csession *cse;
+	int error = 0;
+	u_int n;
+
+	dprintk("%s(%u)\n", __FUNCTION__, mop->count);
+	for (n = 0; n < mop->count; n++) {
+		spin_lock_irq(&fcr->lock);
+		if (fcr->queued >= cryptodev_max_async) {
+			spin_unlock_irq(&fcr->lock);
+			error = EAGAIN;
+			break;
+		}
+		fcr->queued++;
+		spin_unlock_irq(&fcr->lock);
+
+		aop = (struct cryptodev_aop *) kmalloc(sizeof(*aop), GFP_KERNEL);
+		if (aop)
+			memset(aop, 0, sizeof(*aop));
+		if (aop == NULL ||
+				copy_from_user(&aop->aop, &mop->ops[n], sizeof(aop->aop))) {
+			dprintk("%s: op %u %s\n", __FUNCTION__, n,
+					aop ? "bad copy" : "kmalloc failed");
+			error = aop ? EFAULT : ENOMEM;
+			if (aop)
+				kfree(aop);
+			spin_lock_irq(&fcr->lock);
+			fcr->queued--;
+			spin_unlock_irq(&fcr->lock);
+			break;
+		}
+		INIT_LIST_HEAD(&aop->list);
+		aop->fcr = fcr;
+		aop->uio.uio_iov = &aop->iovec;
+		aop->uio.uio_iovcnt = 1;
+
+		cse = csefind(fcr, aop->aop.cop.ses);
+		if (cse == NULL) {
+			dprintk("%s: op %u bad session\n", __FUNCTION__, n);
+			aop->aop.status = EINVAL;
+		} else
+			aop->aop.status = cryptodev_prep(cse, &aop->aop.cop,
+					&aop->uio, &aop->crp);
+		if (aop->aop.status) {
+			cryptodev_async_done(aop, 0);
+			continue;
+		}
+
+		aop->cse = cse;
+		aop->authsize = cse->info.authsize;
+		aop->crp->crp_flags |= CRYPTO_F_BATCH | CRYPTO_F_CBIMM;
+		aop->crp->crp_callback = cryptodev_async_cb;
+		aop->crp->crp_opaque = (void *)aop;
+
+		spin_lock_irq(&fcr->lock);
+		cse->aops++;
+		fcr->inflight++;
+		spin_unlock_irq(&fcr->lock);
+
+		/* NB: once dispatched the op may complete and be fetched */
+		error = crypto_dispatch(aop->crp);
+		if (error) {
+			dprintk("%s: op %u error in crypto_dispatch\n", __FUNCTION__, n);
+			aop->aop.status = error;
+			error = 0;
+			cryptodev_async_done(aop, 1);
+		}
+	}
+
+	mop->count = n;
+	return (n ? 0 : error);
+}
+
+static int
+cryptodev_async_ready(struct fcrypt *fcr)
+{
+	return (!list_empty(&fcr->done) || fcr->inflight == 0);
+}
+
+/*
+ * Hand back up to mop->count finished ops.  The results are copied to
+ * the user's buffers here as the completions run in driver context.
+ */
+static int
+cryptodev_fetch(struct fcrypt *fcr, struct crypt_mop *mop, int nonblock)
+{
+	struct cryptodev_aop *aop, *tmp;
+	LIST_HEAD(done);
+	int error = 0;
+	u_int n = 0;
+
+	dprintk("%s(%u)\n", __FUNCTION__, mop->count);
+	if (!nonblock && mop->count &&
+			wait_event_interruptible(fcr->waitq, cryptodev_async_ready(fcr)))
+		return (EINTR);
+
+	spin_lock_irq(&fcr->lock);
+	while (n < mop->count && !list_empty(&fcr->done)) {
+		aop = list_entry(fcr->done.next, struct cryptodev_aop, list);
+		list_move_tail(&aop->list, &done);
+		fcr->queued--;
+		n++;
+	}
+	spin_unlock_irq(&fcr->lock);
+
+	n = 0;
+	list_for_each_entry_safe(aop, tmp, &done, list) {
+		if (aop->aop.status == 0)
+			aop->aop.status = cryptodev_copyout(&aop->aop.cop, &aop->uio,
+					aop->authsize);
+		/* NB: on a fault the remaining results are lost */
+		if (!error &&
+				copy_to_user(&mop->ops[n], &aop->aop, sizeof(aop->aop))) {
+			dprintk("%s: op %u bad return copy\n", __FUNCTION__, n);
+			error = EFAULT;
+		}
+		n++;
+		list_del(&aop->list);
+		/* CIOCFSESSION may free the session once its last op is out */
+		if (aop->cse) {
+			spin_lock_irq(&fcr->lock);
+			aop->cse->aops--;
+			spin_unlock_irq(&fcr->lock);
+		}
+		cryptodev_aop_free(aop);
+	}
+
+	mop->count = n;
+	return (error);
+}
+
 static int
 cryptodevkey_cb(void *op)
 {
@@ -632,6 +898,7 @@ cryptodev_ioctl(
 	struct crypt_op cop;
 	struct crypt_kop kop;
 	struct crypt_find_op fop;
+	struct crypt_mop mop;
 	u_int64_t sid;
 	u_int32_t ses = 0;
 	int feat, fd, error = 0, crid;
@@ -878,6 +1145,14 @@ bail:
 			dprintk("%s(CIOCFSESSION) - Fail %d\n", __FUNCTION__, error);
 			break;
 		}
+		spin_lock_irq(&fcr->lock);
+		error = cse->aops ? EBUSY : 0;
+		spin_unlock_irq(&fcr->lock);
+		if (error) {
+			dprintk("%s(CIOCFSESSION) - %d async ops\n", __FUNCTION__,
+					cse->aops);
+			break;
+		}
 		csedelete(fcr, cse);
 		error = csefree(cse);
 		break;
@@ -901,6 +1176,25 @@ bail:
 			goto bail;
 		}
 		break;
+	case CIOCASYNCCRYPT:
+	case CIOCASYNCFETCH:
+		dprintk("%s(%s)\n", __FUNCTION__, cmd == CIOCASYNCCRYPT ?
+				"CIOCASYNCCRYPT" : "CIOCASYNCFETCH");
+		if (copy_from_user(&mop, (void*)arg, sizeof(mop))) {
+			dprintk("%s(CIOCASYNC) - bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			break;
+		}
+		if (cmd == CIOCASYNCCRYPT)
+			error = cryptodev_submit(fcr, &mop);
+		else
+			error = cryptodev_fetch(fcr, &mop,
+					(filp->f_flags & O_NONBLOCK) != 0);
+		if (copy_to_user((void*)arg, &mop, sizeof(mop))) {
+			dprintk("%s(CIOCASYNC) - bad return copy\n", __FUNCTION__);
+			error = EFAULT;
+		}
+		break;
 	case CIOCKEY:
 	case CIOCKEY2:
 		dprintk("%s(CIOCKEY)\n", __FUNCTION__);
@@ -996,6 +1290,9 @@ cryptodev_open(struct inode *inode, struct file *filp)
 	memset(fcr, 0, sizeof(*fcr));
 
 	INIT_LIST_HEAD(&fcr->csessions);
+	spin_lock_init(&fcr->lock);
+	init_waitqueue_head(&fcr->waitq);
+	INIT_LIST_HEAD(&fcr->done);
 	filp->private_data = fcr;
 	return(0);
 }
@@ -1005,6 +1302,7 @@ cryptodev_release(struct inode *inode, struct file *filp)
 {
 	struct fcrypt *fcr = filp->private_data;
 	struct csession *cse, *tmp;
+	struct cryptodev_aop *aop, *atmp;
 
 	dprintk("%s()\n", __FUNCTION__);
 	if (!filp) {
@@ -1012,6 +1310,18 @@ cryptodev_release(struct inode *inode, struct file *filp)
 		return(0);
 	}
 
+	/*
+	 * async ops still in a driver use their session, wait for them,
+	 * the lock makes sure the last completion is done with fcr.
+	 */
+	wait_event(fcr->waitq, fcr->inflight == 0);
+	spin_lock_irq(&fcr->lock);
+	spin_unlock_irq(&fcr->lock);
+	list_for_each_entry_safe(aop, atmp, &fcr->done, list) {
+		list_del(&aop->list);
+		cryptodev_aop_free(aop);
+	}
+
 	list_for_each_entry_safe(cse, tmp, &fcr->csessions, list) {
 		list_del(&cse->list);
 		(void)csefree(cse);
@@ -1021,10 +1331,23 @@ cryptodev_release(struct inode *inode, struct file *filp)
 	return(0);
 }
 
+static unsigned int
+cryptodev_poll(struct file *filp, poll_table *wait)
+{
+	struct fcrypt *fcr = filp->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(filp, &fcr->waitq, wait);
+	if (!list_empty(&fcr->done))
+		mask |= POLLIN | POLLRDNORM;
+	return (mask);
+}
+
 static struct file_operations cryptodev_fops = {
 	.owner = THIS_MODULE,
 	.open = cryptodev_open,
 	.release = cryptodev_release,
+	.poll = cryptodev_poll,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,36)
 	.ioctl = cryptodev_ioctl,
 #endif
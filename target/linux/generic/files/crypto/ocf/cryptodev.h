@@ -216,6 +216,26 @@ struct crypt_op {
 	caddr_t		iv;
 };
 
+/*
+ * Asynchronous submission.  CIOCASYNCCRYPT queues each crypt_aop of
+ * the array and returns without waiting; the number actually queued
+ * is returned in count.  Every queued op is handed back exactly once
+ * by CIOCASYNCFETCH, which fills in at most count finished ops (their
+ * dst and mac buffers already written) and blocks for the first one
+ * unless the descriptor is non-blocking.  poll() reports POLLIN while
+ * finished ops are waiting to be fetched.
+ */
+struct crypt_aop {
+	struct crypt_op	cop;
+	void		*opaque;	/* caller's tag, returned untouched */
+	int		status;		/* returns: errno of this op */
+};
+
+struct crypt_mop {
+	u_int		count;		/* number of ops (rw) */
+	struct crypt_aop *ops;
+};
+
 /*
  * Parameters for looking up a crypto driver/device by
  * device name or by id.  The latter are returned for
@@ -273,6 +293,8 @@ struct crypt_kop {
 #define CIOCGSESSION2	_IOWR('c', 106, struct session2_op)
 #define CIOCKEY2	_IOWR('c', 107, struct crypt_kop)
 #define CIOCFINDDEV	_IOWR('c', 108, struct crypt_find_op)
+#define CIOCASYNCCRYPT	_IOWR('c', 109, struct crypt_mop)
+#define CIOCASYNCFETCH	_IOWR('c', 110, struct crypt_mop)
 
 struct cryptotstat {
 	struct timespec	acc;		/* total accumulated time */
@@ -441,6 +463,7 @@ extern	int crypto_kdispatch(struct cryptkop *);
 #define CRYPTO_ASYMQ	0x2
 extern	int crypto_unblock(u_int32_t, int);
 extern	void crypto_done(struct cryptop *crp);
+extern	void crypto_done_list(struct list_head *list);
 extern	void crypto_kdone(struct cryptkop *);
 extern	int crypto_getfeat(int *);
 
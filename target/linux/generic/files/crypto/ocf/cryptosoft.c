@@ -113,8 +113,22 @@ struct swcr_req {
 	unsigned char		 iv[EALG_MAX_BLOCK_LEN];
 	char				 result[HASH_MAX_LEN];
 	void				*crypto_req;
+	char				*bounce;
+	atomic_t			 state;
 };
 
+/*
+ * swcr_req.state: requests that complete before swcr_process() returns are
+ * handed back to it and finished in batches, the others complete alone.
+ */
+#define SWCR_REQ_SUBMIT		0
+#define SWCR_REQ_DONE		1
+#define SWCR_REQ_ASYNC		2
+
+static LIST_HEAD(swcr_done_q);
+static spinlock_t swcr_done_lock;
+static int swcr_done_flush;	/* unregistering, don't hold requests back */
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,20)
 static kmem_cache_t *swcr_req_cache;
 #else
@@ -263,6 +277,42 @@ module_param(swcr_no_ablk, int, 0644);
 MODULE_PARM_DESC(swcr_no_ablk,
                 "Do not use async blk ciphers even if available");
 
+/*
+ * requests complete on several CPUs at once,  so keep the scatterlist
+ * counters atomic and only expose a read-only snapshot of them
+ */
+static atomic_long_t swcr_sg_direct = ATOMIC_LONG_INIT(0);
+static atomic_long_t swcr_sg_copy = ATOMIC_LONG_INIT(0);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,36)
+static int swcr_param_set_ro(const char *val, const struct kernel_param *kp)
+#else
+static int swcr_param_set_ro(const char *val, struct kernel_param *kp)
+#endif
+{
+	return -EPERM;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,36)
+static int swcr_param_get_count(char *buf, const struct kernel_param *kp)
+#else
+static int swcr_param_get_count(char *buf, struct kernel_param *kp)
+#endif
+{
+	return sprintf(buf, "%lu",
+			(unsigned long) atomic_long_read((atomic_long_t *) kp->arg));
+}
+
+module_param_call(swcr_sg_direct, swcr_param_set_ro, swcr_param_get_count,
+		&swcr_sg_direct, 0444);
+MODULE_PARM_DESC(swcr_sg_direct,
+                "Read-Only count of skb/uio buffers mapped straight into a scatterlist");
+
+module_param_call(swcr_sg_copy, swcr_param_set_ro, swcr_param_get_count,
+		&swcr_sg_copy, 0444);
+MODULE_PARM_DESC(swcr_sg_copy,
+                "Read-Only count of buffers that had to be copied");
+
 static struct swcr_data **swcr_sessions = NULL;
 static u_int32_t swcr_sesnum = 0;
 
@@ -623,6 +673,16 @@ static void swcr_process_req_complete(struct swcr_req *req)
 {
 	dprintk("%s()\n", __FUNCTION__);
 
+	if (req->bounce) {
+		/* ciphers worked in place on the copy, hashes only read it */
+		if (req->crp->crp_etype == 0 &&
+				(req->sw->sw_type & (SW_TYPE_CIPHER | SW_TYPE_BLKCIPHER)))
+			crypto_copyback(req->crp->crp_flags, req->crp->crp_buf,
+					req->crd->crd_skip, req->crd->crd_len, req->bounce);
+		kfree(req->bounce);
+		req->bounce = NULL;
+	}
+
 	if (req->sw->sw_type & SW_TYPE_INUSE) {
 		unsigned long flags;
 		spin_lock_irqsave(&req->sw->sw_tfm_lock, flags);
@@ -665,6 +725,10 @@ static void swcr_process_req_complete(struct swcr_req *req)
 	}
 
 done:
+	/* still within swcr_process(), it completes the request */
+	if (atomic_cmpxchg(&req->state, SWCR_REQ_SUBMIT, SWCR_REQ_DONE) ==
+			SWCR_REQ_SUBMIT)
+		return;
 	dprintk("%s crypto_done %p\n", __FUNCTION__, req);
 	crypto_done(req->crp);
 	kmem_cache_free(swcr_req_cache, req);
@@ -687,6 +751,80 @@ static void swcr_process_callback(struct crypto_async_request *creq, int err)
 }
 #endif /* defined(HAVE_ABLKCIPHER) || defined(HAVE_AHASH) */
 
+/*
+ * Map the part of an skb within skip/len into the scatterlist, starting
+ * at entry sg_num.  The head, the page frags and the skbs on the frag
+ * list are all used in place.  Returns the next free entry or -1 if the
+ * skb has more pieces than the scatterlist can hold.
+ */
+static int swcr_sg_skb(struct scatterlist *sg, int sg_num,
+		struct sk_buff *skb, int *skip, int *len)
+{
+	struct sk_buff *frag;
+	int i, n;
+
+	if (*len <= 0)
+		return sg_num;
+
+	if (*skip < skb_headlen(skb)) {
+		if (sg_num >= SCATTERLIST_MAX)
+			return -1;
+		n = min_t(int, skb_headlen(skb) - *skip, *len);
+		sg_set_page(&sg[sg_num++], virt_to_page(skb->data + *skip), n,
+				offset_in_page(skb->data + *skip));
+		*len -= n;
+		*skip = 0;
+	} else
+		*skip -= skb_headlen(skb);
+
+	for (i = 0; *len > 0 && i < skb_shinfo(skb)->nr_frags; i++) {
+		skb_frag_t *f = &skb_shinfo(skb)->frags[i];
+
+		if (*skip < f->size) {
+			if (sg_num >= SCATTERLIST_MAX)
+				return -1;
+			n = min_t(int, f->size - *skip, *len);
+			sg_set_page(&sg[sg_num++], skb_frag_page(f), n,
+					f->page_offset + *skip);
+			*len -= n;
+			*skip = 0;
+		} else
+			*skip -= f->size;
+	}
+
+	for (frag = skb_shinfo(skb)->frag_list; *len > 0 && frag;
+			frag = frag->next) {
+		sg_num = swcr_sg_skb(sg, sg_num, frag, skip, len);
+		if (sg_num < 0)
+			return -1;
+	}
+	return sg_num;
+}
+
+/*
+ * As above for each iovec of a uio.
+ */
+static int swcr_sg_uio(struct scatterlist *sg, struct uio *uiop,
+		int *skip, int *len)
+{
+	int i, n, sg_num = 0;
+
+	for (i = 0; *len > 0 && i < uiop->uio_iovcnt; i++) {
+		struct iovec *iov = &uiop->uio_iov[i];
+
+		if (*skip < iov->iov_len) {
+			if (sg_num >= SCATTERLIST_MAX)
+				return -1;
+			n = min_t(int, iov->iov_len - *skip, *len);
+			sg_set_page(&sg[sg_num++], virt_to_page(iov->iov_base + *skip),
+					n, offset_in_page(iov->iov_base + *skip));
+			*len -= n;
+			*skip = 0;
+		} else
+			*skip -= iov->iov_len;
+	}
+	return sg_num;
+}
 
 static void swcr_process_req(struct swcr_req *req)
 {
@@ -695,7 +833,7 @@ static void swcr_process_req(struct swcr_req *req)
 	struct cryptodesc *crd = req->crd;
 	struct sk_buff *skb = (struct sk_buff *) crp->crp_buf;
 	struct uio *uiop = (struct uio *) crp->crp_buf;
-	int sg_num, sg_len, skip;
+	int sg_num, sg_len, skip, sg_mapped = 0;
 
 	dprintk("%s()\n", __FUNCTION__);
 
@@ -750,62 +888,15 @@ static void swcr_process_req(struct swcr_req *req)
 	 */
 	memset(req->sg, 0, sizeof(req->sg));
 	sg_init_table(req->sg, SCATTERLIST_MAX);
+	sg_len = crd->crd_len;
 	if (crp->crp_flags & CRYPTO_F_SKBUF) {
-		int i, len;
-
-		sg_num = 0;
-		sg_len = 0;
-
-		if (skip < skb_headlen(skb)) {
-			len = skb_headlen(skb) - skip;
-			if (len + sg_len > crd->crd_len)
-				len = crd->crd_len - sg_len;
-			sg_set_page(&req->sg[sg_num],
-				virt_to_page(skb->data + skip), len,
-				offset_in_page(skb->data + skip));
-			sg_len += len;
-			sg_num++;
-			skip = 0;
-		} else
-			skip -= skb_headlen(skb);
-
-		for (i = 0; sg_len < crd->crd_len &&
-					i < skb_shinfo(skb)->nr_frags &&
-					sg_num < SCATTERLIST_MAX; i++) {
-			if (skip < skb_shinfo(skb)->frags[i].size) {
-				len = skb_shinfo(skb)->frags[i].size - skip;
-				if (len + sg_len > crd->crd_len)
-					len = crd->crd_len - sg_len;
-				sg_set_page(&req->sg[sg_num],
-					skb_frag_page(&skb_shinfo(skb)->frags[i]),
-					len,
-					skb_shinfo(skb)->frags[i].page_offset + skip);
-				sg_len += len;
-				sg_num++;
-				skip = 0;
-			} else
-				skip -= skb_shinfo(skb)->frags[i].size;
-		}
+		sg_num = swcr_sg_skb(req->sg, 0, skb, &skip, &sg_len);
+		sg_len = crd->crd_len - sg_len;
+		sg_mapped = 1;
 	} else if (crp->crp_flags & CRYPTO_F_IOV) {
-		int len;
-
-		sg_len = 0;
-		for (sg_num = 0; sg_len < crd->crd_len &&
-				sg_num < uiop->uio_iovcnt &&
-				sg_num < SCATTERLIST_MAX; sg_num++) {
-			if (skip <= uiop->uio_iov[sg_num].iov_len) {
-				len = uiop->uio_iov[sg_num].iov_len - skip;
-				if (len + sg_len > crd->crd_len)
-					len = crd->crd_len - sg_len;
-				sg_set_page(&req->sg[sg_num],
-					virt_to_page(uiop->uio_iov[sg_num].iov_base+skip),
-					len,
-					offset_in_page(uiop->uio_iov[sg_num].iov_base+skip));
-				sg_len += len;
-				skip = 0;
-			} else 
-				skip -= uiop->uio_iov[sg_num].iov_len;
-		}
+		sg_num = swcr_sg_uio(req->sg, uiop, &skip, &sg_len);
+		sg_len = crd->crd_len - sg_len;
+		sg_mapped = 1;
 	} else {
 		sg_len = (crp->crp_ilen - skip);
 		if (sg_len > crd->crd_len)
@@ -814,6 +905,35 @@ static void swcr_process_req(struct swcr_req *req)
 			sg_len, offset_in_page(crp->crp_buf + skip));
 		sg_num = 1;
 	}
+
+	if (sg_num < 0) {
+		/*
+		 * too many pieces to map,  work on a linear copy instead which
+		 * swcr_process_req_complete copies back
+		 */
+		req->bounce = kmalloc(crd->crd_len, GFP_ATOMIC);
+		if (!req->bounce) {
+			crp->crp_etype = ENOMEM;
+			dprintk("%s,%d: ENOMEM bounce %d\n", __FILE__, __LINE__,
+					crd->crd_len);
+			goto done;
+		}
+		crypto_copydata(crp->crp_flags, crp->crp_buf, crd->crd_skip,
+				crd->crd_len, req->bounce);
+		sg_init_table(req->sg, SCATTERLIST_MAX);
+		sg_set_buf(&req->sg[0], req->bounce, crd->crd_len);
+		sg_len = crd->crd_len;
+		sg_num = 1;
+		sg_mapped = 0;
+		atomic_long_inc(&swcr_sg_copy);
+	}
+	/*
+	 * a linear buffer is not interesting here,  and the compression path
+	 * copies a multi-chunk list itself and counts it as a copy below
+	 */
+	if (sg_mapped && !((sw->sw_type & SW_TYPE_ALG_AMASK) == SW_TYPE_COMP &&
+			sg_num > 1))
+		atomic_long_inc(&swcr_sg_direct);
 	if (sg_num > 0)
 		sg_mark_end(&req->sg[sg_num-1]);
 
@@ -1097,6 +1217,7 @@ static void swcr_process_req(struct swcr_req *req)
 		if (sg_num > 1) {
 			int blk;
 
+			atomic_long_inc(&swcr_sg_copy);
 			ibuf = obuf;
 			for (blk = 0; blk < sg_num; blk++) {
 				memcpy(obuf, sg_virt(&req->sg[blk]),
@@ -1154,6 +1275,30 @@ done:
 }
 
 
+/*
+ * Queue a finished request, the queue is completed with a single
+ * crypto_done_list() once the last request of a batch has been handed
+ * over, i.e. one without CRYPTO_HINT_MORE.  While the driver is being
+ * unregistered the rest of a batch may never reach us, so everything is
+ * completed straight away then.
+ */
+static void
+swcr_done(struct cryptop *crp, int hint)
+{
+	LIST_HEAD(list);
+	unsigned long flags;
+
+	spin_lock_irqsave(&swcr_done_lock, flags);
+	if (crp)
+		list_add_tail(&crp->crp_next, &swcr_done_q);
+	if ((hint & CRYPTO_HINT_MORE) == 0 || swcr_done_flush)
+		list_splice_init(&swcr_done_q, &list);
+	spin_unlock_irqrestore(&swcr_done_lock, flags);
+
+	if (!list_empty(&list))
+		crypto_done_list(&list);
+}
+
 /*
  * Process a crypto request.
  */
@@ -1186,26 +1331,6 @@ swcr_process(device_t dev, struct cryptop *crp, int hint)
 		goto done;
 	}
 
-	/*
-	 * do some error checking outside of the loop for SKB and IOV processing
-	 * this leaves us with valid skb or uiop pointers for later
-	 */
-	if (crp->crp_flags & CRYPTO_F_SKBUF) {
-		struct sk_buff *skb = (struct sk_buff *) crp->crp_buf;
-		if (skb_shinfo(skb)->nr_frags >= SCATTERLIST_MAX) {
-			printk("%s,%d: %d nr_frags > SCATTERLIST_MAX", __FILE__, __LINE__,
-					skb_shinfo(skb)->nr_frags);
-			goto done;
-		}
-	} else if (crp->crp_flags & CRYPTO_F_IOV) {
-		struct uio *uiop = (struct uio *) crp->crp_buf;
-		if (uiop->uio_iovcnt > SCATTERLIST_MAX) {
-			printk("%s,%d: %d uio_iovcnt > SCATTERLIST_MAX", __FILE__, __LINE__,
-					uiop->uio_iovcnt);
-			goto done;
-		}
-	}
-
 	/*
 	 * setup a new request ready for queuing
 	 */
@@ -1220,14 +1345,23 @@ swcr_process(device_t dev, struct cryptop *crp, int hint)
 	req->sw_head = swcr_sessions[lid];
 	req->crp = crp;
 	req->crd = crp->crp_desc;
+	atomic_set(&req->state, SWCR_REQ_SUBMIT);
 
 	swcr_process_req(req);
+
+	/* an async completion will call crypto_done() itself */
+	if (atomic_cmpxchg(&req->state, SWCR_REQ_SUBMIT, SWCR_REQ_ASYNC) ==
+			SWCR_REQ_SUBMIT)
+		crp = NULL;
+	else
+		kmem_cache_free(swcr_req_cache, req);
+	swcr_done(crp, hint);
 	return 0;
 
 done:
-	crypto_done(crp);
 	if (req)
 		kmem_cache_free(swcr_req_cache, req);
+	swcr_done(crp, hint);
 	return 0;
 }
 
@@ -1240,6 +1374,7 @@ cryptosoft_init(void)
 
 	dprintk("%s(%p)\n", __FUNCTION__, cryptosoft_init);
 
+	spin_lock_init(&swcr_done_lock);
 	swcr_req_cache = kmem_cache_create("cryptosoft_req",
 				sizeof(struct swcr_req), 0, SLAB_HWCACHE_ALIGN, NULL
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,23)
@@ -1308,7 +1443,15 @@ cryptosoft_init(void)
 static void
 cryptosoft_exit(void)
 {
+	unsigned long flags;
+
 	dprintk("%s()\n", __FUNCTION__);
+	/* stop batching and complete whatever a batch left behind */
+	spin_lock_irqsave(&swcr_done_lock, flags);
+	swcr_done_flush = 1;
+	spin_unlock_irqrestore(&swcr_done_lock, flags);
+	swcr_done(NULL, 0);
+
 	crypto_unregister_all(swcr_id);
 	swcr_id = -1;
 	kmem_cache_destroy(swcr_req_cache);
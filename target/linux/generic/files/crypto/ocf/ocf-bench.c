@@ -1,5 +1,7 @@
 /*
  * A loadable module that benchmarks the OCF crypto speed from kernel space.
+ * Built outside of the kernel it is instead a program that benchmarks the
+ * same requests from userspace through /dev/crypto.
  *
  * Copyright (C) 2004-2010 David McCullough <david_mccullough@mcafee.com>
  *
@@ -30,6 +32,8 @@
  */
 
 
+#ifdef __KERNEL__
+
 #include <linux/version.h>
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,38) && !defined(AUTOCONF_INCLUDED)
 #include <linux/config.h>
@@ -42,6 +46,10 @@
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
+#include <linux/vmalloc.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <asm/div64.h>
 #include <cryptodev.h>
 
 #ifdef I_HAVE_AN_XSCALE_WITH_INTEL_SDK
@@ -65,11 +73,19 @@
 #endif
 
 /*
- * the number of simultaneously active requests
+ * the most sizes or queue lengths that can be given
  */
-static int request_q_len = 40;
-module_param(request_q_len, int, 0);
-MODULE_PARM_DESC(request_q_len, "Number of outstanding requests");
+#define BENCH_MAX_RUNS	16
+
+/*
+ * the number of simultaneously active requests, each one given is
+ * benchmarked in turn
+ */
+static int request_q_len;
+static int bench_q_lens[BENCH_MAX_RUNS] = { 40 };
+static int bench_nq_lens = 1;
+module_param_array_named(request_q_len, bench_q_lens, int, &bench_nq_lens, 0);
+MODULE_PARM_DESC(request_q_len, "Number of outstanding requests (list)");
 
 /*
  * how many requests we want to have processed
@@ -79,11 +95,28 @@ module_param(request_num, int, 0);
 MODULE_PARM_DESC(request_num, "run for at least this many requests");
 
 /*
- * the size of each request
+ * the size of each request, each one given is benchmarked in turn
  */
-static int request_size = 1488;
-module_param(request_size, int, 0);
-MODULE_PARM_DESC(request_size, "size of each request");
+static int request_size;
+static int bench_sizes[BENCH_MAX_RUNS] = { 1488 };
+static int bench_nsizes = 1;
+module_param_array_named(request_size, bench_sizes, int, &bench_nsizes, 0);
+MODULE_PARM_DESC(request_size, "size of each request (list)");
+
+/*
+ * the algorithms to benchmark
+ */
+static char *request_alg = "aes-sha1";
+module_param(request_alg, charp, 0);
+MODULE_PARM_DESC(request_alg,
+	"algorithms to benchmark: aes,3des,sha1,aes-sha1,3des-sha1 or all");
+
+/*
+ * the OCF driver to benchmark,  by default whichever OCF picks
+ */
+static char *request_driver = NULL;
+module_param(request_driver, charp, 0);
+MODULE_PARM_DESC(request_driver, "OCF driver to benchmark (ie., cryptosoft)");
 
 /*
  * OCF batching of requests
@@ -108,6 +141,7 @@ typedef struct  {
 	IX_MBUF mbuf;
 #endif
 	unsigned char *buffer;
+	ktime_t start;
 } request_t;
 
 static request_t *requests;
@@ -116,12 +150,83 @@ static spinlock_t ocfbench_counter_lock;
 static int outstanding;
 static int total;
 
+/*
+ * completion latencies of the current run,  in usecs,  the last bucket
+ * also counts everything slower
+ */
+#define LAT_BUCKETS	16384
+static u32 *latency;
+
+/*
+ * every run is logged and also kept in debugfs as ocf-bench/results
+ */
+static char *results;
+static int results_max;
+static struct debugfs_blob_wrapper results_blob;
+static struct dentry *results_dir, *results_file;
+
+static void
+bench_report(const char *fmt, ...)
+{
+	char line[128];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if (len >= sizeof(line))
+		len = sizeof(line) - 1;
+
+	printk("%s", line);
+	if (results && results_blob.size + len < results_max) {
+		memcpy(results + results_blob.size, line, len);
+		results_blob.size += len;
+	}
+}
+
+/*
+ * the latency that pct percent of the requests completed within
+ */
+static int
+latency_pct(int pct)
+{
+	u64 n = 0;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS - 1; i++) {
+		n += latency[i];
+		if (n * 100 >= (u64) total * pct)
+			break;
+	}
+	return i;
+}
+
 /*************************************************************************/
 /*
  * OCF benchmark routines
  */
 
+/*
+ * the algorithms that can be benchmarked,  the combined ones do the
+ * cipher and HMAC in a single request
+ */
+static struct bench_alg {
+	char	*name;
+	int	cipher;
+	int	mac;
+	int	blksize;	/* sizes must be a multiple of this */
+} bench_algs[] = {
+	{ "aes",	CRYPTO_AES_CBC,		0,			16 },
+	{ "3des",	CRYPTO_3DES_CBC,	0,			8 },
+	{ "sha1",	0,			CRYPTO_SHA1_HMAC,	1 },
+	{ "aes-sha1",	CRYPTO_AES_CBC,		CRYPTO_SHA1_HMAC,	16 },
+	{ "3des-sha1",	CRYPTO_3DES_CBC,	CRYPTO_SHA1_HMAC,	8 },
+};
+
+static struct bench_alg *ocf_alg;
 static uint64_t ocf_cryptoid;
+static char ocf_driver[32];
 static unsigned long jstart, jstop;
 
 static int ocf_init(void);
@@ -134,32 +239,43 @@ static void ocf_request_wq(struct work_struct *work);
 static int
 ocf_init(void)
 {
-	int error;
+	int error, crid;
 	struct cryptoini crie, cria;
-	struct cryptodesc crda, crde;
+	device_t dev;
 
 	memset(&crie, 0, sizeof(crie));
 	memset(&cria, 0, sizeof(cria));
-	memset(&crde, 0, sizeof(crde));
-	memset(&crda, 0, sizeof(crda));
 
-	cria.cri_alg  = CRYPTO_SHA1_HMAC;
+	cria.cri_alg  = ocf_alg->mac;
 	cria.cri_klen = 20 * 8;
 	cria.cri_key  = "0123456789abcdefghij";
 
-	//crie.cri_alg  = CRYPTO_3DES_CBC;
-	crie.cri_alg  = CRYPTO_AES_CBC;
+	crie.cri_alg  = ocf_alg->cipher;
 	crie.cri_klen = 24 * 8;
 	crie.cri_key  = "0123456789abcdefghijklmn";
 
-	crie.cri_next = &cria;
+	if (ocf_alg->cipher && ocf_alg->mac)
+		crie.cri_next = &cria;
 
-	error = crypto_newsession(&ocf_cryptoid, &crie,
-				CRYPTOCAP_F_HARDWARE | CRYPTOCAP_F_SOFTWARE);
+	crid = CRYPTOCAP_F_HARDWARE | CRYPTOCAP_F_SOFTWARE;
+	if (request_driver) {
+		crid = crypto_find_driver(request_driver);
+		if (crid == -1) {
+			printk("OCF: no driver %s\n", request_driver);
+			return -1;
+		}
+	}
+
+	error = crypto_newsession(&ocf_cryptoid,
+				ocf_alg->cipher ? &crie : &cria, crid);
 	if (error) {
 		printk("crypto_newsession failed %d\n", error);
 		return -1;
 	}
+
+	dev = crypto_find_device_byhid(CRYPTO_SESID2HID(ocf_cryptoid));
+	strlcpy(ocf_driver, dev ? device_get_nameunit(dev) : "unknown",
+			sizeof(ocf_driver));
 	return 0;
 }
 
@@ -168,6 +284,10 @@ ocf_cb(struct cryptop *crp)
 {
 	request_t *r = (request_t *) crp->crp_opaque;
 	unsigned long flags;
+	u64 us;
+
+	us = ktime_to_ns(ktime_sub(ktime_get(), r->start));
+	do_div(us, 1000);
 
 	if (crp->crp_etype)
 		printk("Error in OCF processing: %d\n", crp->crp_etype);
@@ -176,6 +296,7 @@ ocf_cb(struct cryptop *crp)
 
 	/* do all requests  but take at least 1 second */
 	spin_lock_irqsave(&ocfbench_counter_lock, flags);
+	latency[us < LAT_BUCKETS ? (int) us : LAT_BUCKETS - 1]++;
 	total++;
 	if (total > request_num && jstart + HZ < jiffies) {
 		outstanding--;
@@ -193,10 +314,12 @@ static void
 ocf_request(void *arg)
 {
 	request_t *r = arg;
-	struct cryptop *crp = crypto_getreq(2);
-	struct cryptodesc *crde, *crda;
+	struct cryptop *crp;
+	struct cryptodesc *crde = NULL, *crda = NULL;
 	unsigned long flags;
 
+	crp = crypto_getreq((ocf_alg->cipher != 0) + (ocf_alg->mac != 0));
+
 	if (!crp) {
 		spin_lock_irqsave(&ocfbench_counter_lock, flags);
 		outstanding--;
@@ -204,25 +327,31 @@ ocf_request(void *arg)
 		return;
 	}
 
-	crde = crp->crp_desc;
-	crda = crde->crd_next;
-
-	crda->crd_skip = 0;
-	crda->crd_flags = 0;
-	crda->crd_len = request_size;
-	crda->crd_inject = request_size;
-	crda->crd_alg = CRYPTO_SHA1_HMAC;
-	crda->crd_key = "0123456789abcdefghij";
-	crda->crd_klen = 20 * 8;
+	if (ocf_alg->cipher) {
+		crde = crp->crp_desc;
+		crda = crde->crd_next;
+	} else
+		crda = crp->crp_desc;
+
+	if (crda) {
+		crda->crd_skip = 0;
+		crda->crd_flags = 0;
+		crda->crd_len = request_size;
+		crda->crd_inject = request_size;
+		crda->crd_alg = ocf_alg->mac;
+		crda->crd_key = "0123456789abcdefghij";
+		crda->crd_klen = 20 * 8;
+	}
 
-	crde->crd_skip = 0;
-	crde->crd_flags = CRD_F_IV_EXPLICIT | CRD_F_ENCRYPT;
-	crde->crd_len = request_size;
-	crde->crd_inject = request_size;
-	//crde->crd_alg = CRYPTO_3DES_CBC;
-	crde->crd_alg = CRYPTO_AES_CBC;
-	crde->crd_key = "0123456789abcdefghijklmn";
-	crde->crd_klen = 24 * 8;
+	if (crde) {
+		crde->crd_skip = 0;
+		crde->crd_flags = CRD_F_IV_EXPLICIT | CRD_F_ENCRYPT;
+		crde->crd_len = request_size;
+		crde->crd_inject = request_size;
+		crde->crd_alg = ocf_alg->cipher;
+		crde->crd_key = "0123456789abcdefghijklmn";
+		crde->crd_klen = 24 * 8;
+	}
 
 	crp->crp_ilen = request_size + 64;
 	crp->crp_flags = 0;
@@ -234,6 +363,7 @@ ocf_request(void *arg)
 	crp->crp_callback = ocf_cb;
 	crp->crp_sid = ocf_cryptoid;
 	crp->crp_opaque = (caddr_t) r;
+	r->start = ktime_get();
 	crypto_dispatch(crp);
 }
 
@@ -252,6 +382,67 @@ ocf_done(void)
 	crypto_freesession(ocf_cryptoid);
 }
 
+/*
+ * run the current algorithm with request_q_len requests of request_size
+ * bytes outstanding and report the throughput and latency
+ */
+static void
+ocf_run(void)
+{
+	unsigned long flags, ms;
+	u64 ops, bytes;
+	int i;
+
+	memset(latency, 0, LAT_BUCKETS * sizeof(*latency));
+	total = outstanding = 0;
+	jstart = jiffies;
+	for (i = 0; i < request_q_len; i++) {
+		spin_lock_irqsave(&ocfbench_counter_lock, flags);
+		outstanding++;
+		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
+		ocf_request(&requests[i]);
+	}
+	while (outstanding > 0)
+		schedule();
+	jstop = jiffies;
+
+	ms = jiffies_to_msecs(jstop - jstart);
+	if (ms == 0)
+		ms = 1;
+	ops = (u64) total * 1000;
+	do_div(ops, ms);
+	/* bytes per msec is thousands of bytes per second */
+	bytes = (u64) total * request_size;
+	do_div(bytes, ms);
+
+	bench_report("%-14s %-10s %6d %5d %8d %6lu %8lu %5lu.%03lu %7d %7d\n",
+			ocf_driver, ocf_alg->name, request_size, request_q_len,
+			total, ms, (unsigned long) ops,
+			(unsigned long) bytes / 1000, (unsigned long) bytes % 1000,
+			latency_pct(50), latency_pct(99));
+}
+
+/*
+ * see if an algorithm is in the request_alg list
+ */
+static int
+ocf_alg_selected(const char *name)
+{
+	const char *p = request_alg;
+	int len = strlen(name);
+
+	if (strcmp(p, "all") == 0)
+		return 1;
+	while (p) {
+		if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == '\0'))
+			return 1;
+		p = strchr(p, ',');
+		if (p)
+			p++;
+	}
+	return 0;
+}
+
 /*************************************************************************/
 #ifdef BENCH_IXP_ACCESS_LIB
 /*************************************************************************/
@@ -405,68 +596,93 @@ ixp_done(void)
 int
 ocfbench_init(void)
 {
-	int i;
+	int i, j, k, max_q_len = 0, max_size = 0, error = -EINVAL;
+#ifdef BENCH_IXP_ACCESS_LIB
 	unsigned long mbps;
 	unsigned long flags;
+#endif
 
 	printk("Crypto Speed tests\n");
 
-	requests = kmalloc(sizeof(request_t) * request_q_len, GFP_KERNEL);
-	if (!requests) {
-		printk("malloc failed\n");
+	for (i = 0; i < bench_nq_lens; i++)
+		max_q_len = max(max_q_len, bench_q_lens[i]);
+	for (i = 0; i < bench_nsizes; i++)
+		max_size = max(max_size, bench_sizes[i]);
+	if (max_q_len <= 0 || max_size <= 0) {
+		printk("bad request_q_len or request_size\n");
 		return -EINVAL;
 	}
 
-	for (i = 0; i < request_q_len; i++) {
+	requests = kmalloc(sizeof(request_t) * max_q_len, GFP_KERNEL);
+	if (requests)
+		memset(requests, 0, sizeof(request_t) * max_q_len);
+	latency = vmalloc(LAT_BUCKETS * sizeof(*latency));
+	/* a header and a line per run */
+	results_max = (ARRAY_SIZE(bench_algs) * bench_nsizes * bench_nq_lens + 1)
+			* 128;
+	results = vmalloc(results_max);
+	if (!requests || !latency || !results) {
+		printk("malloc failed\n");
+		error = -ENOMEM;
+		goto out;
+	}
+	results_blob.data = results;
+	results_blob.size = 0;
+
+	for (i = 0; i < max_q_len; i++) {
 		/* +64 for return data */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,20)
 		INIT_WORK(&requests[i].work, ocf_request_wq);
 #else
 		INIT_WORK(&requests[i].work, ocf_request, &requests[i]);
 #endif
-		requests[i].buffer = kmalloc(request_size + 128, GFP_DMA);
+		requests[i].buffer = kmalloc(max_size + 128, GFP_DMA);
 		if (!requests[i].buffer) {
 			printk("malloc failed\n");
-			return -EINVAL;
+			error = -ENOMEM;
+			goto out;
 		}
-		memset(requests[i].buffer, '0' + i, request_size + 128);
+		memset(requests[i].buffer, '0' + i, max_size + 128);
 	}
 
 	/*
-	 * OCF benchmark
+	 * OCF benchmark,  every selected algorithm at every size and
+	 * queue length
 	 */
 	printk("OCF: testing ...\n");
-	if (ocf_init() == -1)
-		return -EINVAL;
-
 	spin_lock_init(&ocfbench_counter_lock);
-	total = outstanding = 0;
-	jstart = jiffies;
-	for (i = 0; i < request_q_len; i++) {
-		spin_lock_irqsave(&ocfbench_counter_lock, flags);
-		outstanding++;
-		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
-		ocf_request(&requests[i]);
-	}
-	while (outstanding > 0)
-		schedule();
-	jstop = jiffies;
-
-	mbps = 0;
-	if (jstop > jstart) {
-		mbps = (unsigned long) total * (unsigned long) request_size * 8;
-		mbps /= ((jstop - jstart) * 1000) / HZ;
+	bench_report("%-14s %-10s %6s %5s %8s %6s %8s %9s %7s %7s\n",
+			"# driver", "alg", "size", "q_len", "requests", "msecs",
+			"ops/s", "MB/s", "p50(us)", "p99(us)");
+	for (i = 0; i < ARRAY_SIZE(bench_algs); i++) {
+		ocf_alg = &bench_algs[i];
+		if (!ocf_alg_selected(ocf_alg->name))
+			continue;
+		if (ocf_init() == -1)
+			continue;
+		for (j = 0; j < bench_nsizes; j++) {
+			request_size = bench_sizes[j];
+			if ((request_size % ocf_alg->blksize) != 0) {
+				printk("OCF: %s skipping size %d, not a multiple "
+						"of the block size\n", ocf_alg->name, request_size);
+				continue;
+			}
+			for (k = 0; k < bench_nq_lens; k++) {
+				request_q_len = bench_q_lens[k];
+				if (request_q_len > 0)
+					ocf_run();
+			}
+		}
+		ocf_done();
 	}
-	printk("OCF: %d requests of %d bytes in %d jiffies (%d.%03d Mbps)\n",
-			total, request_size, (int)(jstop - jstart),
-			((int)mbps) / 1000, ((int)mbps) % 1000);
-	ocf_done();
 
 #ifdef BENCH_IXP_ACCESS_LIB
 	/*
 	 * IXP benchmark
 	 */
 	printk("IXP: testing ...\n");
+	request_size = bench_sizes[0];
+	request_q_len = bench_q_lens[0];
 	ixp_init();
 	total = outstanding = 0;
 	jstart = jiffies;
@@ -496,14 +712,39 @@ ocfbench_init(void)
 	ixp_done();
 #endif /* BENCH_IXP_ACCESS_LIB */
 
-	for (i = 0; i < request_q_len; i++)
-		kfree(requests[i].buffer);
-	kfree(requests);
-	return -EINVAL; /* always fail to load so it can be re-run quickly ;-) */
+	/*
+	 * stay loaded while there is a results file to read,  otherwise
+	 * fail to load so it can be re-run quickly ;-)
+	 */
+	results_dir = debugfs_create_dir("ocf-bench", NULL);
+	if (results_dir && !IS_ERR(results_dir)) {
+		results_file = debugfs_create_blob("results", S_IRUGO, results_dir,
+				&results_blob);
+		if (results_file && !IS_ERR(results_file))
+			error = 0;
+		else
+			debugfs_remove(results_dir);
+	}
+
+out:
+	if (requests) {
+		for (i = 0; i < max_q_len; i++)
+			if (requests[i].buffer)
+				kfree(requests[i].buffer);
+		kfree(requests);
+	}
+	if (latency)
+		vfree(latency);
+	if (error && results)
+		vfree(results);
+	return error;
 }
 
 static void __exit ocfbench_exit(void)
 {
+	debugfs_remove(results_file);
+	debugfs_remove(results_dir);
+	vfree(results);
 }
 
 module_init(ocfbench_init);
@@ -512,3 +753,225 @@ module_exit(ocfbench_exit);
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("David McCullough <david_mccullough@mcafee.com>");
 MODULE_DESCRIPTION("Benchmark various in-kernel crypto speeds");
+
+#else /* !__KERNEL__ */
+
+/*
+ * Userspace benchmark, the requests go through /dev/crypto either one
+ * CIOCCRYPT at a time or with request_q_len of them kept in flight by
+ * CIOCASYNCCRYPT, reaping them in batches with poll and CIOCASYNCFETCH.
+ *
+ *	cc -I. -o ocf-bench ocf-bench.c
+ */
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <cryptodev.h>
+
+static int request_q_len = 40;
+static int request_num = 1024;
+static int request_size = 1488;
+
+static struct timeval tstart, tstop;
+
+static int
+elapsed_ms(void)
+{
+	gettimeofday(&tstop, NULL);
+	return (tstop.tv_sec - tstart.tv_sec) * 1000 +
+			(tstop.tv_usec - tstart.tv_usec) / 1000;
+}
+
+static void
+report(const char *name, int total)
+{
+	int ms = elapsed_ms();
+	unsigned long long kbps = 0;
+
+	if (ms > 0)
+		kbps = (unsigned long long) total * request_size * 8 / ms;
+	printf("%s: %d requests of %d bytes in %d.%03d secs (%d.%03d Mbps)\n",
+			name, total, request_size, ms / 1000, ms % 1000,
+			(int)(kbps / 1000), (int)(kbps % 1000));
+}
+
+static void
+setup_op(struct crypt_op *cop, u_int32_t ses, unsigned char *buf)
+{
+	static char iv[EALG_MAX_BLOCK_LEN];
+
+	memset(cop, 0, sizeof(*cop));
+	cop->ses = ses;
+	cop->op = COP_ENCRYPT;
+	cop->len = request_size;
+	cop->src = cop->dst = (caddr_t) buf;
+	cop->mac = (caddr_t) buf + request_size;
+	cop->iv = iv;
+}
+
+/* do all requests but take at least 1 second */
+static int
+more(int total)
+{
+	return total < request_num || elapsed_ms() < 1000;
+}
+
+static int
+bench_sync(int fd, u_int32_t ses, unsigned char *buf)
+{
+	struct crypt_op cop;
+	int total = 0;
+
+	gettimeofday(&tstart, NULL);
+	while (more(total)) {
+		setup_op(&cop, ses, buf);
+		if (ioctl(fd, CIOCCRYPT, &cop) == -1) {
+			perror("CIOCCRYPT");
+			return -1;
+		}
+		total++;
+	}
+	report("CIOCCRYPT", total);
+	return 0;
+}
+
+static int
+bench_async(int fd, u_int32_t ses, unsigned char *buf)
+{
+	struct crypt_aop *aops;
+	struct crypt_mop mop;
+	struct pollfd pfd;
+	int i, total = 0, outstanding, error = 0;
+
+	aops = calloc(request_q_len, sizeof(*aops));
+	if (!aops) {
+		perror("calloc");
+		return -1;
+	}
+	for (i = 0; i < request_q_len; i++) {
+		setup_op(&aops[i].cop, ses, buf + i * (request_size + 64));
+		aops[i].opaque = &aops[i];
+	}
+
+	/* we only sleep in poll, never in the fetch */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	gettimeofday(&tstart, NULL);
+	mop.count = request_q_len;
+	mop.ops = aops;
+	if (ioctl(fd, CIOCASYNCCRYPT, &mop) == -1) {
+		perror("CIOCASYNCCRYPT");
+		free(aops);
+		return -1;
+	}
+	outstanding = mop.count;
+
+	while (outstanding > 0) {
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			error = -1;
+			break;
+		}
+		mop.count = outstanding;
+		mop.ops = aops;
+		if (ioctl(fd, CIOCASYNCFETCH, &mop) == -1) {
+			perror("CIOCASYNCFETCH");
+			error = -1;
+			break;
+		}
+		for (i = 0; i < mop.count; i++)
+			if (aops[i].status)
+				fprintf(stderr, "Error in OCF processing: %d\n",
+						aops[i].status);
+		outstanding -= mop.count;
+		total += mop.count;
+
+		/* the finished ops go straight back in */
+		if (mop.count && more(total)) {
+			if (ioctl(fd, CIOCASYNCCRYPT, &mop) == -1) {
+				perror("CIOCASYNCCRYPT");
+				error = -1;
+				break;
+			}
+			outstanding += mop.count;
+		}
+	}
+	report("CIOCASYNCCRYPT", total);
+	free(aops);
+	return error;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct session2_op sop;
+	unsigned char *buf;
+	int c, fd, error;
+
+	while ((c = getopt(argc, argv, "q:n:s:")) != -1) {
+		switch (c) {
+		case 'q': request_q_len = atoi(optarg); break;
+		case 'n': request_num = atoi(optarg); break;
+		case 's': request_size = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-q queue-len] [-n requests] "
+					"[-s size]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (request_q_len < 1 || request_size < 16 || request_size % 16) {
+		fprintf(stderr, "bad queue length or request size\n");
+		return 1;
+	}
+
+	/* +64 for return data */
+	buf = malloc(request_q_len * (request_size + 64));
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+	memset(buf, '0', request_q_len * (request_size + 64));
+
+	fd = open("/dev/crypto", O_RDWR);
+	if (fd == -1) {
+		perror("/dev/crypto");
+		return 1;
+	}
+
+	memset(&sop, 0, sizeof(sop));
+	sop.cipher = CRYPTO_AES_CBC;
+	sop.keylen = 24;
+	sop.key = "0123456789abcdefghijklmn";
+	sop.mac = CRYPTO_SHA1_HMAC;
+	sop.mackeylen = 20;
+	sop.mackey = "0123456789abcdefghij";
+	sop.crid = CRYPTO_FLAG_HARDWARE | CRYPTO_FLAG_SOFTWARE;
+	if (ioctl(fd, CIOCGSESSION2, &sop) == -1) {
+		perror("CIOCGSESSION2");
+		return 1;
+	}
+
+	error = bench_sync(fd, sop.ses, buf);
+	if (!error)
+		error = bench_async(fd, sop.ses, buf);
+
+	ioctl(fd, CIOCFSESSION, &sop.ses);
+	close(fd);
+	free(buf);
+	return error ? 1 : 0;
+}
+
+#endif /* __KERNEL__ */
@@ -303,8 +303,10 @@ static inline void *sg_virt(struct scatterlist *sg)
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,4) || !defined(CONFIG_SMP)
 #define ocf_for_each_cpu(cpu) for ((cpu) = 0; (cpu) == 0; (cpu)++)
+#define ocf_this_cpu() 0
 #else
 #define ocf_for_each_cpu(cpu) for_each_present_cpu(cpu)
+#define ocf_this_cpu() raw_smp_processor_id()
 #endif
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27)
@@ -336,16 +336,16 @@ swconfig_unlock(void)
 }
 
 static struct switch_dev *
-swconfig_get_dev(struct genl_info *info)
+swconfig_find_dev(struct nlattr *id_attr)
 {
 	struct switch_dev *dev = NULL;
 	struct switch_dev *p;
 	int id;
 
-	if (!info->attrs[SWITCH_ATTR_ID])
+	if (!id_attr)
 		goto done;
 
-	id = nla_get_u32(info->attrs[SWITCH_ATTR_ID]);
+	id = nla_get_u32(id_attr);
 	swconfig_lock();
 	list_for_each_entry(p, &swdevs, dev_list) {
 		if (id != p->id)
@@ -363,6 +363,12 @@ done:
 	return dev;
 }
 
+static struct switch_dev *
+swconfig_get_dev(struct genl_info *info)
+{
+	return swconfig_find_dev(info->attrs[SWITCH_ATTR_ID]);
+}
+
 static inline void
 swconfig_put_dev(struct switch_dev *dev)
 {
@@ -843,6 +849,198 @@ error:
 	return err;
 }
 
+static bool
+swconfig_vlan_active(struct switch_dev *dev, int vlan)
+{
+	struct switch_val val;
+
+	/* without a port mapping there is nothing to filter on */
+	if (!dev->ops->get_vlan_ports)
+		return true;
+
+	memset(&val, 0, sizeof(val));
+	val.attr = &default_vlan[VLAN_PORTS];
+	val.port_vlan = vlan;
+	val.value.ports = dev->portbuf;
+	memset(dev->portbuf, 0,
+		sizeof(struct switch_port) * dev->ports);
+
+	if (dev->ops->get_vlan_ports(dev, &val))
+		return false;
+
+	return val.len > 0;
+}
+
+static int
+swconfig_dump_val(struct sk_buff *msg, struct netlink_callback *cb,
+		struct switch_dev *dev, const struct switch_attr *attr,
+		int id, int cmd, int port_vlan)
+{
+	struct switch_val val;
+	struct nlattr *n, *p;
+	void *hdr;
+	int err = -EOPNOTSUPP;
+	int i;
+
+	memset(&val, 0, sizeof(val));
+	val.attr = attr;
+	val.port_vlan = port_vlan;
+	if (attr->type == SWITCH_TYPE_PORTS) {
+		val.value.ports = dev->portbuf;
+		memset(dev->portbuf, 0,
+			sizeof(struct switch_port) * dev->ports);
+	}
+
+	if (attr->get)
+		err = attr->get(dev, attr, &val);
+
+	hdr = genlmsg_put(msg, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			&switch_fam, NLM_F_MULTI, cmd);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(msg, cmd == SWITCH_CMD_GET_VLAN ?
+			SWITCH_ATTR_OP_VLAN : SWITCH_ATTR_OP_PORT, port_vlan))
+		goto nla_put_failure;
+	if (nla_put_u32(msg, SWITCH_ATTR_OP_ID, id))
+		goto nla_put_failure;
+
+	/* unreadable attributes are sent without a value */
+	if (err)
+		goto done;
+
+	switch (attr->type) {
+	case SWITCH_TYPE_INT:
+		if (nla_put_u32(msg, SWITCH_ATTR_OP_VALUE_INT, val.value.i))
+			goto nla_put_failure;
+		break;
+	case SWITCH_TYPE_STRING:
+		if (nla_put_string(msg, SWITCH_ATTR_OP_VALUE_STR, val.value.s))
+			goto nla_put_failure;
+		break;
+	case SWITCH_TYPE_PORTS:
+		n = nla_nest_start(msg, SWITCH_ATTR_OP_VALUE_PORTS);
+		if (!n)
+			goto nla_put_failure;
+		for (i = 0; i < val.len; i++) {
+			p = nla_nest_start(msg, SWITCH_ATTR_PORT);
+			if (!p)
+				goto nla_put_failure;
+			if (nla_put_u32(msg, SWITCH_PORT_ID,
+					val.value.ports[i].id))
+				goto nla_put_failure;
+			if ((val.value.ports[i].flags &
+			     (1 << SWITCH_PORT_FLAG_TAGGED)) &&
+			    nla_put_flag(msg, SWITCH_PORT_FLAG_TAGGED))
+				goto nla_put_failure;
+			nla_nest_end(msg, p);
+		}
+		nla_nest_end(msg, n);
+		break;
+	default:
+		break;
+	}
+
+done:
+	return genlmsg_end(msg, hdr);
+nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+/*
+ * dump the values of all attributes of every port or every active vlan,
+ * one message per value. cb->args[0] holds the port/vlan and cb->args[1]
+ * the attribute index to resume from when the skb fills up.
+ */
+static int
+swconfig_dump_attrs(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct genlmsghdr *hdr = nlmsg_data(cb->nlh);
+	struct nlattr *attrs[SWITCH_ATTR_MAX+1];
+	const struct switch_attrlist *alist;
+	const struct switch_attr *attr;
+	struct switch_dev *dev;
+	int item = cb->args[0];
+	int i = cb->args[1];
+	int n_items, id;
+	int err;
+
+	/* defaults */
+	struct switch_attr *def_list;
+	unsigned long *def_active;
+	int n_def;
+
+	err = nlmsg_parse(cb->nlh, GENL_HDRLEN + switch_fam.hdrsize, attrs,
+			SWITCH_ATTR_MAX, switch_policy);
+	if (err < 0)
+		return err;
+
+	dev = swconfig_find_dev(attrs[SWITCH_ATTR_ID]);
+	if (!dev)
+		return -EINVAL;
+
+	switch (hdr->cmd) {
+	case SWITCH_CMD_GET_VLAN:
+		alist = &dev->ops->attr_vlan;
+		def_list = default_vlan;
+		def_active = &dev->def_vlan;
+		n_def = ARRAY_SIZE(default_vlan);
+		n_items = dev->vlans;
+		break;
+	case SWITCH_CMD_GET_PORT:
+		alist = &dev->ops->attr_port;
+		def_list = default_port;
+		def_active = &dev->def_port;
+		n_def = ARRAY_SIZE(default_port);
+		n_items = dev->ports;
+		break;
+	default:
+		WARN_ON(1);
+		err = -EINVAL;
+		goto out;
+	}
+
+	for (; item < n_items; item++, i = 0) {
+		if (hdr->cmd == SWITCH_CMD_GET_VLAN && i == 0 &&
+		    !swconfig_vlan_active(dev, item))
+			continue;
+
+		for (; i < alist->n_attr + n_def; i++) {
+			if (i < alist->n_attr) {
+				attr = &alist->attr[i];
+				if (attr->disabled)
+					continue;
+				id = i;
+			} else {
+				id = i - alist->n_attr;
+				if (!test_bit(id, def_active))
+					continue;
+				attr = &def_list[id];
+				id += SWITCH_ATTR_DEFAULTS_OFFSET;
+			}
+
+			if (attr->type == SWITCH_TYPE_NOVAL)
+				continue;
+
+			/* skb is full, continue from here on the next call */
+			if (swconfig_dump_val(skb, cb, dev, attr, id,
+					hdr->cmd, item) < 0)
+				goto out;
+		}
+	}
+
+out:
+	cb->args[0] = item;
+	cb->args[1] = i;
+	swconfig_put_dev(dev);
+
+	if (err < 0)
+		return err;
+
+	return skb->len;
+}
+
 static int
 swconfig_send_switch(struct sk_buff *msg, u32 pid, u32 seq, int flags,
 		const struct switch_dev *dev)
@@ -947,12 +1145,16 @@ static struct genl_ops swconfig_ops[] = {
 	{
 		.cmd = SWITCH_CMD_GET_VLAN,
 		.doit = swconfig_get_attr,
+		.dumpit = swconfig_dump_attrs,
 		.policy = switch_policy,
+		.done = swconfig_done,
 	},
 	{
 		.cmd = SWITCH_CMD_GET_PORT,
 		.doit = swconfig_get_attr,
+		.dumpit = swconfig_dump_attrs,
 		.policy = switch_policy,
+		.done = swconfig_done,
 	},
 	{
 		.cmd = SWITCH_CMD_SET_GLOBAL,
@@ -1357,20 +1357,82 @@ static int yaffs_change_obj_name(struct yaffs_obj *obj,
  *   In Linux, the page cache provides read buffering and the short op cache
  *   provides write buffering.
  *
- *   There are a small number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   The caches are found through a hash on (object, chunk) and kept on an
+ *   LRU list, so that a device can have hundreds of them without slowing
+ *   down short operations. Each object also lists its caches in chunk
+ *   order and the device lists the dirty ones, so flushing and
+ *   invalidating never scan the whole cache array.
  */
 
+static inline int yaffs_cache_hash_fn(const struct yaffs_obj *obj,
+				      int chunk_id)
+{
+	return ((u32) obj->obj_id * 61 + (u32) chunk_id) %
+		YAFFS_NCACHE_BUCKETS;
+}
+
+static void yaffs_set_cache_dirty(struct yaffs_dev *dev,
+				  struct yaffs_cache *cache, int dirty)
+{
+	if (cache->dirty == dirty)
+		return;
+	cache->dirty = dirty;
+	if (dirty) {
+		list_add_tail(&cache->dirty_link, &dev->cache_dirty);
+		dev->n_dirty_caches++;
+	} else {
+		list_del_init(&cache->dirty_link);
+		dev->n_dirty_caches--;
+	}
+}
+
+/* Attach a cache to a chunk of an object */
+static void yaffs_set_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
+			    struct yaffs_obj *obj, int chunk_id)
+{
+	struct list_head *i;
+
+	cache->object = obj;
+	cache->chunk_id = chunk_id;
+	yaffs_set_cache_dirty(dev, cache, 0);
+	cache->locked = 0;
+	list_del_init(&cache->hash_link);
+	list_add(&cache->hash_link,
+		 &dev->cache_bucket[yaffs_cache_hash_fn(obj, chunk_id)]);
+
+	/* Keep the object's caches in chunk order, appends are the
+	 * common case so look from the end. */
+	list_del_init(&cache->obj_link);
+	list_for_each_prev(i, &obj->cache_list) {
+		if (list_entry(i, struct yaffs_cache, obj_link)->chunk_id <
+		    chunk_id)
+			break;
+	}
+	list_add(&cache->obj_link, i);
+}
+
+/* Free a cache, free caches go to the LRU end so they get reused first */
+static void yaffs_release_cache(struct yaffs_dev *dev,
+				struct yaffs_cache *cache)
+{
+	cache->object = NULL;
+	yaffs_set_cache_dirty(dev, cache, 0);
+	list_del_init(&cache->hash_link);
+	list_del_init(&cache->obj_link);
+	list_move_tail(&cache->lru_link, &dev->cache_lru);
+}
+
 static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 {
-	struct yaffs_dev *dev = obj->my_dev;
-	int i;
 	struct yaffs_cache *cache;
-	int n_caches = obj->my_dev->param.n_caches;
+	struct list_head *i;
 
-	for (i = 0; i < n_caches; i++) {
-		cache = &dev->cache[i];
-		if (cache->object == obj && cache->dirty)
+	if (obj->my_dev->n_dirty_caches < 1)
+		return 0;
+
+	list_for_each(i, &obj->cache_list) {
+		cache = list_entry(i, struct yaffs_cache, obj_link);
+		if (cache->dirty)
 			return 1;
 	}
 
@@ -1380,40 +1442,35 @@ static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 static void yaffs_flush_file_cache(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int lowest = -99;	/* Stop compiler whining. */
-	int i;
-	struct yaffs_cache *cache;
-	int chunk_written = 0;
-	int n_caches = obj->my_dev->param.n_caches;
+	struct yaffs_cache *cache = NULL;
+	struct list_head *i, *n;
+	int chunk_written;
 
-	if (n_caches < 1)
+	if (dev->param.n_caches < 1 || dev->n_dirty_caches < 1)
 		return;
-	do {
-		cache = NULL;
 
-		/* Find the lowest dirty chunk for this object */
-		for (i = 0; i < n_caches; i++) {
-			if (dev->cache[i].object == obj &&
-			    dev->cache[i].dirty) {
-				if (!cache ||
-				    dev->cache[i].chunk_id < lowest) {
-					cache = &dev->cache[i];
-					lowest = cache->chunk_id;
-				}
-			}
+	/* Write out the dirty chunks of this object, lowest first */
+	list_for_each_safe(i, n, &obj->cache_list) {
+		cache = list_entry(i, struct yaffs_cache, obj_link);
+		if (!cache->dirty) {
+			cache = NULL;
+			continue;
 		}
 
-		if (cache && !cache->locked) {
-			/* Write it out and free it up */
-			chunk_written =
-			    yaffs_wr_data_obj(cache->object,
-					      cache->chunk_id,
-					      cache->data,
-					      cache->n_bytes, 1);
-			cache->dirty = 0;
-			cache->object = NULL;
-		}
-	} while (cache && chunk_written > 0);
+		if (cache->locked)
+			break;
+
+		/* Write it out and free it up */
+		chunk_written =
+		    yaffs_wr_data_obj(cache->object,
+				      cache->chunk_id,
+				      cache->data,
+				      cache->n_bytes, 1);
+		yaffs_release_cache(dev, cache);
+		if (chunk_written <= 0)
+			break;
+		cache = NULL;
+	}
 
 	if (cache)
 		/* Hoosterman, disk full while writing cache out. */
@@ -1428,23 +1485,20 @@ static void yaffs_flush_file_cache(struct yaffs_obj *obj)
 
 void yaffs_flush_whole_cache(struct yaffs_dev *dev)
 {
-	struct yaffs_obj *obj;
-	int n_caches = dev->param.n_caches;
-	int i;
+	struct yaffs_cache *cache;
 
-	/* Find a dirty object in the cache and flush it...
+	/* Flush the object of the oldest dirty cache...
 	 * until there are no further dirty objects.
 	 */
-	do {
-		obj = NULL;
-		for (i = 0; i < n_caches && !obj; i++) {
-			if (dev->cache[i].object && dev->cache[i].dirty)
-				obj = dev->cache[i].object;
-		}
-		if (obj)
-			yaffs_flush_file_cache(obj);
-	} while (obj);
+	while (!list_empty(&dev->cache_dirty)) {
+		cache = list_entry(dev->cache_dirty.next,
+				   struct yaffs_cache, dirty_link);
+		yaffs_flush_file_cache(cache->object);
 
+		/* Locked or out of space, it stays dirty */
+		if (dev->cache_dirty.next == &cache->dirty_link)
+			break;
+	}
 }
 
 /* Grab us a cache chunk for use.
@@ -1454,24 +1508,21 @@ void yaffs_flush_whole_cache(struct yaffs_dev *dev)
  */
 static struct yaffs_cache *yaffs_grab_chunk_worker(struct yaffs_dev *dev)
 {
-	int i;
+	struct yaffs_cache *cache;
 
-	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (!dev->cache[i].object)
-				return &dev->cache[i];
-		}
-	}
-	return NULL;
+	if (dev->param.n_caches < 1 || list_empty(&dev->cache_lru))
+		return NULL;
+
+	/* Any free cache is at the LRU end */
+	cache = list_entry(dev->cache_lru.prev, struct yaffs_cache, lru_link);
+	return cache->object ? NULL : cache;
 }
 
 static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 {
 	struct yaffs_cache *cache;
 	struct yaffs_obj *the_obj;
-	int usage;
-	int i;
-	int pushout;
+	struct list_head *i;
 
 	if (dev->param.n_caches < 1)
 		return NULL;
@@ -1481,8 +1532,8 @@ static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 	cache = yaffs_grab_chunk_worker(dev);
 
 	if (!cache) {
-		/* They were all dirty, find the LRU object and flush
-		 * its cache, then  find again.
+		/* They were all in use, take the LRU one if it is clean,
+		 * else flush its object and find again.
 		 * NB what's here is not very accurate,
 		 * we actually flush the object with the LRU chunk.
 		 */
@@ -1490,21 +1541,15 @@ static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 		/* With locking we can't assume we can use entry zero,
 		 * Set the_obj to a valid pointer for Coverity. */
 		the_obj = dev->cache[0].object;
-		usage = -1;
-		cache = NULL;
-		pushout = -1;
-
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object &&
-			    !dev->cache[i].locked &&
-			    (dev->cache[i].last_use < usage ||
-			    !cache)) {
-				usage = dev->cache[i].last_use;
-				the_obj = dev->cache[i].object;
-				cache = &dev->cache[i];
-				pushout = i;
-			}
+
+		list_for_each_prev(i, &dev->cache_lru) {
+			cache = list_entry(i, struct yaffs_cache, lru_link);
+			if (!cache->locked)
+				break;
+			cache = NULL;
 		}
+		if (cache)
+			the_obj = cache->object;
 
 		if (!cache || cache->dirty) {
 			/* Flush and try again */
@@ -1515,49 +1560,54 @@ static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
 	return cache;
 }
 
-/* Find a cached chunk */
-static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
-						  int chunk_id)
+/* Look up the cache of a chunk */
+static struct yaffs_cache *yaffs_lookup_chunk_cache(const struct yaffs_obj *obj,
+						    int chunk_id)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
+	struct yaffs_cache *cache;
+	struct list_head *i;
 
 	if (dev->param.n_caches < 1)
 		return NULL;
 
-	for (i = 0; i < dev->param.n_caches; i++) {
-		if (dev->cache[i].object == obj &&
-		    dev->cache[i].chunk_id == chunk_id) {
-			dev->cache_hits++;
-
-			return &dev->cache[i];
-		}
+	list_for_each(i, &dev->cache_bucket[yaffs_cache_hash_fn(obj, chunk_id)]) {
+		cache = list_entry(i, struct yaffs_cache, hash_link);
+		if (cache->object == obj && cache->chunk_id == chunk_id)
+			return cache;
 	}
 	return NULL;
 }
 
+/* Find a cached chunk for a read or write */
+static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
+						  int chunk_id)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+	struct yaffs_cache *cache;
+
+	if (dev->param.n_caches < 1)
+		return NULL;
+
+	cache = yaffs_lookup_chunk_cache(obj, chunk_id);
+	if (cache)
+		dev->cache_hits++;
+	else
+		dev->cache_misses++;
+	return cache;
+}
+
 /* Mark the chunk for the least recently used algorithym */
 static void yaffs_use_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
 			    int is_write)
 {
-	int i;
-
 	if (dev->param.n_caches < 1)
 		return;
 
-	if (dev->cache_last_use < 0 ||
-		dev->cache_last_use > 100000000) {
-		/* Reset the cache usages */
-		for (i = 1; i < dev->param.n_caches; i++)
-			dev->cache[i].last_use = 0;
-
-		dev->cache_last_use = 0;
-	}
-	dev->cache_last_use++;
-	cache->last_use = dev->cache_last_use;
+	list_move(&cache->lru_link, &dev->cache_lru);
 
 	if (is_write)
-		cache->dirty = 1;
+		yaffs_set_cache_dirty(dev, cache, 1);
 }
 
 /* Invalidate a single cache page.
@@ -1569,10 +1619,10 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
 	struct yaffs_cache *cache;
 
 	if (object->my_dev->param.n_caches > 0) {
-		cache = yaffs_find_chunk_cache(object, chunk_id);
+		cache = yaffs_lookup_chunk_cache(object, chunk_id);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_release_cache(object->my_dev, cache);
 	}
 }
 
@@ -1581,15 +1631,14 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
  */
 static void yaffs_invalidate_whole_cache(struct yaffs_obj *in)
 {
-	int i;
+	struct list_head *i, *n;
 	struct yaffs_dev *dev = in->my_dev;
 
 	if (dev->param.n_caches > 0) {
 		/* Invalidate it. */
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object == in)
-				dev->cache[i].object = NULL;
-		}
+		list_for_each_safe(i, n, &in->cache_list)
+			yaffs_release_cache(dev, list_entry(i,
+					struct yaffs_cache, obj_link));
 	}
 }
 
@@ -1811,6 +1860,7 @@ static struct yaffs_obj *yaffs_alloc_empty_obj(struct yaffs_dev *dev)
 	obj->variant_type = YAFFS_OBJECT_TYPE_UNKNOWN;
 	INIT_LIST_HEAD(&(obj->hard_links));
 	INIT_LIST_HEAD(&(obj->hash_link));
+	INIT_LIST_HEAD(&obj->cache_list);
 	INIT_LIST_HEAD(&obj->siblings);
 
 	/* Now make the directory sane */
@@ -3459,10 +3509,7 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 				if (!cache) {
 					cache =
 					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					yaffs_set_cache(dev, cache, in, chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
 					cache->n_bytes = 0;
@@ -3585,10 +3632,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 				if (!cache &&
 				    yaffs_check_alloc_available(dev, 1)) {
 					cache = yaffs_grab_chunk_cache(dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					yaffs_set_cache(dev, cache, in, chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
 				} else if (cache &&
@@ -3619,7 +3663,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 						     cache->chunk_id,
 						     cache->data,
 						     cache->n_bytes, 1);
-						cache->dirty = 0;
+						yaffs_set_cache_dirty(dev, cache, 0);
 					}
 				} else {
 					chunk_written = -1;	/* fail write */
@@ -4705,6 +4749,7 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	int init_failed = 0;
 	unsigned x;
 	int bits;
+	int i;
 
 	if(yaffs_guts_ll_init(dev) != YAFFS_OK)
 		return YAFFS_FAIL;
@@ -4813,15 +4858,20 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->cache = NULL;
 	dev->gc_cleanup_list = NULL;
 
+	INIT_LIST_HEAD(&dev->cache_lru);
+	INIT_LIST_HEAD(&dev->cache_dirty);
+	for (i = 0; i < YAFFS_NCACHE_BUCKETS; i++)
+		INIT_LIST_HEAD(&dev->cache_bucket[i]);
+	dev->n_dirty_caches = 0;
+
 	if (!init_failed && dev->param.n_caches > 0) {
-		int i;
 		void *buf;
-		int cache_bytes =
-		    dev->param.n_caches * sizeof(struct yaffs_cache);
+		int cache_bytes;
 
 		if (dev->param.n_caches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->param.n_caches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		cache_bytes = dev->param.n_caches * sizeof(struct yaffs_cache);
 		dev->cache = kmalloc(cache_bytes, GFP_NOFS);
 
 		buf = (u8 *) dev->cache;
@@ -4830,19 +4880,21 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 			memset(dev->cache, 0, cache_bytes);
 
 		for (i = 0; i < dev->param.n_caches && buf; i++) {
+			INIT_LIST_HEAD(&dev->cache[i].hash_link);
+			INIT_LIST_HEAD(&dev->cache[i].obj_link);
+			INIT_LIST_HEAD(&dev->cache[i].dirty_link);
+			list_add_tail(&dev->cache[i].lru_link, &dev->cache_lru);
 			dev->cache[i].object = NULL;
-			dev->cache[i].last_use = 0;
 			dev->cache[i].dirty = 0;
 			dev->cache[i].data = buf =
 			    kmalloc(dev->param.total_bytes_per_chunk, GFP_NOFS);
 		}
 		if (!buf)
 			init_failed = 1;
-
-		dev->cache_last_use = 0;
 	}
 
 	dev->cache_hits = 0;
+	dev->cache_misses = 0;
 
 	if (!init_failed) {
 		dev->gc_cleanup_list =
@@ -5006,21 +5058,13 @@ int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
 {
 	/* This is what we report to the outside world */
 	int n_free;
-	int n_dirty_caches;
 	int blocks_for_checkpt;
-	int i;
 
 	n_free = dev->n_free_chunks;
 	n_free += dev->n_deleted_files;
 
-	/* Now count and subtract the number of dirty chunks in the cache. */
-
-	for (n_dirty_caches = 0, i = 0; i < dev->param.n_caches; i++) {
-		if (dev->cache[i].dirty)
-			n_dirty_caches++;
-	}
-
-	n_free -= n_dirty_caches;
+	/* Now subtract the number of dirty chunks in the cache. */
+	n_free -= dev->n_dirty_caches;
 
 	n_free -=
 	    ((dev->param.n_reserved_blocks + 1) * dev->param.chunks_per_block);
@@ -104,7 +104,8 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA	0x21
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	1024
+#define YAFFS_NCACHE_BUCKETS		256
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -129,9 +130,12 @@
 
 /* ChunkCache is used for short read/write operations.*/
 struct yaffs_cache {
+	struct list_head hash_link;	/* list of caches in hash bucket */
+	struct list_head lru_link;	/* position in the device LRU list */
+	struct list_head obj_link;	/* caches of the object, by chunk_id */
+	struct list_head dirty_link;	/* on the device dirty list */
 	struct yaffs_obj *object;
 	int chunk_id;
-	int last_use;
 	int dirty;
 	int n_bytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
@@ -436,6 +440,8 @@ struct yaffs_obj {
 
 	struct list_head hash_link;	/* list of objects in hash bucket */
 
+	struct list_head cache_list;	/* short op caches, by chunk_id */
+
 	struct list_head hard_links;	/* hard linked object chain*/
 
 	/* directory structure stuff */
@@ -735,7 +741,11 @@ struct yaffs_dev {
 	int doing_buffered_block_rewrite;
 
 	struct yaffs_cache *cache;
-	int cache_last_use;
+	struct list_head cache_bucket[YAFFS_NCACHE_BUCKETS];
+	struct list_head cache_lru;	/* Most recently used first,
+					 * free caches at the tail */
+	struct list_head cache_dirty;	/* Dirty caches */
+	int n_dirty_caches;
 
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted
@@ -794,6 +804,7 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 cache_misses;
 	u32 tags_used;
 	u32 summary_used;
 
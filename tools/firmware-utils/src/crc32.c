@@ -0,0 +1,133 @@
+/*
+ *  Copyright (C) 2014 OpenWrt.org
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+#include "crc32.h"
+
+/*
+ * Slice-by-8: table[k][n] is the crc of byte n followed by k zero bytes,
+ * which allows to process eight input bytes with eight independent table
+ * lookups instead of a dependency chain of eight.
+ */
+static uint32_t crc32_table[8][256];
+static int crc32_ready;
+
+static void crc32_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : (crc >> 1);
+		crc32_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			crc32_table[j][i] = (crc32_table[j - 1][i] >> 8) ^
+				crc32_table[0][crc32_table[j - 1][i] & 0xff];
+
+	crc32_ready = 1;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t lo, hi;
+
+	if (!crc32_ready)
+		crc32_init();
+
+	/* byte loads keep this independent of host endianness and alignment */
+	for (; len >= 8; len -= 8, p += 8) {
+		lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+		hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t) p[7] << 24);
+
+		crc = crc32_table[7][lo & 0xff] ^
+		      crc32_table[6][(lo >> 8) & 0xff] ^
+		      crc32_table[5][(lo >> 16) & 0xff] ^
+		      crc32_table[4][lo >> 24] ^
+		      crc32_table[3][hi & 0xff] ^
+		      crc32_table[2][(hi >> 8) & 0xff] ^
+		      crc32_table[1][(hi >> 16) & 0xff] ^
+		      crc32_table[0][hi >> 24];
+	}
+
+	for (; len; len--, p++)
+		crc = crc32_table[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+/*
+ * The same for the non-reflected CRC-32 (polynomial 0x04c11db7) used by
+ * POSIX cksum, bytes enter the crc most significant bit first.
+ */
+static uint32_t crc32_be_table[8][256];
+static int crc32_be_ready;
+
+static void crc32_be_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = (uint32_t) i << 24;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+		crc32_be_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			crc32_be_table[j][i] = (crc32_be_table[j - 1][i] << 8) ^
+				crc32_be_table[0][crc32_be_table[j - 1][i] >> 24];
+
+	crc32_be_ready = 1;
+}
+
+uint32_t crc32_be_update(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t hi;
+
+	if (!crc32_be_ready)
+		crc32_be_init();
+
+	for (; len >= 8; len -= 8, p += 8) {
+		hi = crc ^ (((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+
+		crc = crc32_be_table[7][hi >> 24] ^
+		      crc32_be_table[6][(hi >> 16) & 0xff] ^
+		      crc32_be_table[5][(hi >> 8) & 0xff] ^
+		      crc32_be_table[4][hi & 0xff] ^
+		      crc32_be_table[3][p[4]] ^
+		      crc32_be_table[2][p[5]] ^
+		      crc32_be_table[1][p[6]] ^
+		      crc32_be_table[0][p[7]];
+	}
+
+	for (; len; len--, p++)
+		crc = (crc << 8) ^ crc32_be_table[0][(crc >> 24) ^ *p];
+
+	return crc;
+}
+
+uint32_t crc32_cksum_final(uint32_t crc, uintmax_t len)
+{
+	uint8_t c;
+
+	for (; len; len >>= 8) {
+		c = len & 0xff;
+		crc = crc32_be_update(crc, &c, 1);
+	}
+
+	return ~crc;
+}
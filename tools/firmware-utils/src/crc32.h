@@ -0,0 +1,33 @@
+/*
+ *  Copyright (C) 2014 OpenWrt.org
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+#ifndef _FWU_CRC32_H
+#define _FWU_CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Standard reflected CRC-32 (polynomial 0xedb88320) as used by zlib and
+ * Ethernet. The crc value is passed in and returned as is, callers apply
+ * the initial value and final inversion their image format expects, e.g.
+ * ~crc32_update(~0, buf, len) for the usual checksum.
+ */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+
+/*
+ * Non-reflected CRC-32 (polynomial 0x04c11db7) as used by POSIX cksum.
+ * crc32_cksum_final() appends the length, least significant byte first,
+ * and inverts the result, i.e. the cksum of a buffer is
+ * crc32_cksum_final(crc32_be_update(0, buf, len), len).
+ */
+uint32_t crc32_be_update(uint32_t crc, const void *buf, size_t len);
+uint32_t crc32_cksum_final(uint32_t crc, uintmax_t len);
+
+#endif /* _FWU_CRC32_H */
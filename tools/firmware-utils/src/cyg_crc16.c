@@ -96,15 +96,19 @@ static const cyg_uint16 crc16_tab[] = {
 };
 
 cyg_uint16
-cyg_crc16(unsigned char *buf, int len)
+cyg_crc16_accumulate(cyg_uint16 cksum, unsigned char *buf, int len)
 {
     int i;
-    cyg_uint16 cksum;
 
-    cksum = 0;
     for (i = 0;  i < len;  i++) {
         cksum = crc16_tab[((cksum>>8) ^ *buf++) & 0xFF] ^ (cksum << 8);
     }
     return cksum;
 }
 
+cyg_uint16
+cyg_crc16(unsigned char *buf, int len)
+{
+    return cyg_crc16_accumulate(0, buf, len);
+}
+
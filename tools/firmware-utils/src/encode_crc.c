@@ -31,22 +31,7 @@
 #include <string.h>
 #include <sys/stat.h>
 
-// *******************************************************************
-// CCITT polynom G(x)=x^16+x^12+x^5+1
-#define POLYNOM  0x1021
-
-// CRC algorithm with MSB first
-int make_crc16(int crc, char new)
-{
-  int i;
-  crc = crc ^ (((int)new) << 8);
-  
-  for(i=0; i<8; i++) {  // work on 8 bits in "new"
-    crc <<= 1;          // MSBs first
-    if(crc & 0x10000)  crc ^= POLYNOM;
-  }
-  return crc & 0xFFFF;
-}
+#include "cyg_crc.h"
 
 // *******************************************************************
 // Reads the file "filename" into memory and returns pointer to the buffer.
@@ -102,11 +87,10 @@ int main(int argc, char** argv)
     return 1;
   }
 
-  int crc = 0xFFFF, z;
+  int crc, z;
 
-  p = master;
-  for(z=0; z<count; z++)
-    crc = make_crc16(crc, *(p++));  // calculate CRC
+  // CCITT polynom G(x)=x^16+x^12+x^5+1, MSB first
+  crc = cyg_crc16_accumulate(0xFFFF, (unsigned char *)master, count);
   short crc16 = (short)crc;
 
 	/*
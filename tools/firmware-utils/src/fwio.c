@@ -0,0 +1,391 @@
+/*
+ *  Copyright (C) 2014 OpenWrt.org
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "crc32.h"
+#include "fwio.h"
+
+#define FWIO_FILL_SIZE	(64 * 1024)
+#define FWIO_IOV	64
+
+/* fill segments are written and hashed from one shared block per byte */
+static unsigned char *fill_block[256];
+
+static unsigned char *get_fill_block(int c)
+{
+	unsigned char *p = fill_block[c & 0xff];
+
+	if (!p) {
+		p = malloc(FWIO_FILL_SIZE);
+		if (!p)
+			return NULL;
+
+		memset(p, c, FWIO_FILL_SIZE);
+		fill_block[c & 0xff] = p;
+	}
+
+	return p;
+}
+
+/* fallback for pipes and other files which can't be mapped */
+static int read_all(int fd, struct fwio_file *f)
+{
+	size_t size = 0, alloc = 0;
+	char *buf = NULL, *p;
+	ssize_t n;
+
+	for (;;) {
+		if (size == alloc) {
+			alloc = alloc ? alloc * 2 : FWIO_FILL_SIZE;
+			p = realloc(buf, alloc);
+			if (!p)
+				goto err;
+			buf = p;
+		}
+
+		n = read(fd, buf + size, alloc - size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			goto err;
+		}
+		if (!n)
+			break;
+
+		size += n;
+	}
+
+	f->data = buf;
+	f->size = size;
+	f->heap = 1;
+	return 0;
+
+ err:
+	free(buf);
+	return -1;
+}
+
+int fwio_map(struct fwio_file *f, const char *name)
+{
+	struct stat st;
+	int ret = -1;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st))
+		goto out;
+
+	if (!S_ISREG(st.st_mode)) {
+		ret = read_all(fd, f);
+		goto out;
+	}
+
+	if (st.st_size) {
+		f->data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE, fd, 0);
+		if (f->data == MAP_FAILED) {
+			f->data = NULL;
+			goto out;
+		}
+
+		/* inputs are checksummed and written front to back */
+		madvise(f->data, st.st_size, MADV_SEQUENTIAL);
+	}
+
+	f->size = st.st_size;
+	ret = 0;
+
+ out:
+	close(fd);
+	return ret;
+}
+
+void fwio_unmap(struct fwio_file *f)
+{
+	if (f->heap)
+		free(f->data);
+	else if (f->data)
+		munmap(f->data, f->size);
+
+	memset(f, 0, sizeof(*f));
+}
+
+void fwio_init(struct fwio_image *img)
+{
+	memset(img, 0, sizeof(*img));
+}
+
+void fwio_free(struct fwio_image *img)
+{
+	free(img->seg);
+	fwio_init(img);
+}
+
+static struct fwio_seg *add_seg(struct fwio_image *img)
+{
+	struct fwio_seg *seg;
+	int max;
+
+	if (img->nseg == img->maxseg) {
+		max = img->maxseg ? img->maxseg * 2 : 16;
+		seg = realloc(img->seg, max * sizeof(*seg));
+		if (!seg)
+			return NULL;
+
+		img->seg = seg;
+		img->maxseg = max;
+	}
+
+	return &img->seg[img->nseg++];
+}
+
+int fwio_add(struct fwio_image *img, void *data, size_t len)
+{
+	struct fwio_seg *seg;
+
+	if (!len)
+		return 0;
+
+	seg = add_seg(img);
+	if (!seg)
+		return -1;
+
+	seg->data = data;
+	seg->len = len;
+	seg->fill = 0;
+	img->len += len;
+
+	return 0;
+}
+
+int fwio_fill(struct fwio_image *img, int c, size_t len)
+{
+	struct fwio_seg *seg;
+
+	if (!len)
+		return 0;
+
+	if (!get_fill_block(c))
+		return -1;
+
+	seg = img->nseg ? &img->seg[img->nseg - 1] : NULL;
+	if (!seg || seg->data || seg->fill != c) {
+		seg = add_seg(img);
+		if (!seg)
+			return -1;
+
+		seg->data = NULL;
+		seg->len = 0;
+		seg->fill = c;
+	}
+
+	seg->len += len;
+	img->len += len;
+
+	return 0;
+}
+
+void fwio_truncate(struct fwio_image *img, size_t len)
+{
+	struct fwio_seg *seg;
+
+	while (img->nseg && img->len > len) {
+		seg = &img->seg[img->nseg - 1];
+
+		if (img->len - seg->len >= len) {
+			img->len -= seg->len;
+			img->nseg--;
+		} else {
+			seg->len -= img->len - len;
+			img->len = len;
+		}
+	}
+}
+
+/* segment containing ofs, *start is set to its offset in the image */
+static struct fwio_seg *find_seg(struct fwio_image *img, size_t ofs,
+				 size_t *start)
+{
+	size_t pos = 0;
+	int i;
+
+	for (i = 0; i < img->nseg; i++) {
+		if (ofs < pos + img->seg[i].len) {
+			*start = pos;
+			return &img->seg[i];
+		}
+
+		pos += img->seg[i].len;
+	}
+
+	return NULL;
+}
+
+void *fwio_ptr(struct fwio_image *img, size_t ofs, size_t len)
+{
+	struct fwio_seg *seg;
+	size_t start;
+
+	seg = find_seg(img, ofs, &start);
+	if (!seg || !seg->data || ofs + len > start + seg->len)
+		return NULL;
+
+	return (char *) seg->data + (ofs - start);
+}
+
+void fwio_walk(struct fwio_image *img, size_t ofs, size_t len,
+	       fwio_cb_t cb, void *arg)
+{
+	struct fwio_seg *seg, *end;
+	size_t start, skip, n;
+
+	seg = find_seg(img, ofs, &start);
+	if (!seg)
+		return;
+
+	end = &img->seg[img->nseg];
+	skip = ofs - start;
+
+	for (; seg < end && len; seg++, skip = 0) {
+		n = seg->len - skip;
+		if (n > len)
+			n = len;
+		len -= n;
+
+		if (seg->data) {
+			cb(arg, (char *) seg->data + skip, n);
+			continue;
+		}
+
+		while (n) {
+			size_t chunk = n < FWIO_FILL_SIZE ? n : FWIO_FILL_SIZE;
+
+			cb(arg, fill_block[seg->fill & 0xff], chunk);
+			n -= chunk;
+		}
+	}
+}
+
+static void crc32_cb(void *arg, const void *data, size_t len)
+{
+	uint32_t *crc = arg;
+
+	*crc = crc32_update(*crc, data, len);
+}
+
+uint32_t fwio_crc32(struct fwio_image *img, uint32_t crc,
+		    size_t ofs, size_t len)
+{
+	fwio_walk(img, ofs, len, crc32_cb, &crc);
+	return crc;
+}
+
+static void md5_cb(void *arg, const void *data, size_t len)
+{
+	MD5_Update(arg, data, len);
+}
+
+void fwio_md5(struct fwio_image *img, MD5_CTX *ctx, size_t ofs, size_t len)
+{
+	fwio_walk(img, ofs, len, md5_cb, ctx);
+}
+
+static int write_iov(int fd, struct iovec *iov, int n)
+{
+	ssize_t ret;
+
+	while (n) {
+		ret = writev(fd, iov, n);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		while (n && ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			n--;
+		}
+
+		if (n) {
+			iov->iov_base = (char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+int fwio_write(struct fwio_image *img, int fd)
+{
+	struct iovec iov[FWIO_IOV];
+	struct fwio_seg *seg;
+	size_t len, chunk;
+	int i, n = 0;
+
+	for (i = 0; i < img->nseg; i++) {
+		seg = &img->seg[i];
+
+		for (len = seg->len; len; len -= chunk) {
+			if (seg->data) {
+				chunk = len;
+				iov[n].iov_base = (char *) seg->data +
+						  (seg->len - len);
+			} else {
+				chunk = len < FWIO_FILL_SIZE ?
+					len : FWIO_FILL_SIZE;
+				iov[n].iov_base = fill_block[seg->fill & 0xff];
+			}
+			iov[n++].iov_len = chunk;
+
+			if (n == FWIO_IOV) {
+				if (write_iov(fd, iov, n))
+					return -1;
+				n = 0;
+			}
+		}
+	}
+
+	return write_iov(fd, iov, n);
+}
+
+int fwio_write_file(struct fwio_image *img, const char *name)
+{
+	int ret, err;
+	int fd;
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+
+	ret = fwio_write(img, fd);
+	err = errno;
+
+	if (close(fd) && !ret) {
+		ret = -1;
+		err = errno;
+	}
+
+	errno = err;
+	return ret;
+}
@@ -0,0 +1,75 @@
+/*
+ *  Copyright (C) 2014 OpenWrt.org
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+#ifndef _FWU_FWIO_H
+#define _FWU_FWIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "md5.h"
+
+/*
+ * Input files are mapped privately and writable, a tool may patch the
+ * mapping (e.g. to blank a field for a checksum) without touching the
+ * file on disk. Empty files map to a NULL pointer with a size of zero.
+ */
+struct fwio_file {
+	void		*data;
+	size_t		size;
+	int		heap;		/* read into memory instead */
+};
+
+int fwio_map(struct fwio_file *f, const char *name);
+void fwio_unmap(struct fwio_file *f);
+
+/*
+ * An output image is described as a list of segments which either
+ * reference caller owned memory (headers, mapped input files) or stand
+ * for a run of a fill byte. Nothing is copied, the referenced memory has
+ * to stay valid until the image is written.
+ */
+struct fwio_seg {
+	void		*data;		/* NULL for a fill segment */
+	size_t		len;
+	int		fill;
+};
+
+struct fwio_image {
+	struct fwio_seg	*seg;
+	int		nseg;
+	int		maxseg;
+	size_t		len;
+};
+
+void fwio_init(struct fwio_image *img);
+void fwio_free(struct fwio_image *img);
+
+int fwio_add(struct fwio_image *img, void *data, size_t len);
+int fwio_fill(struct fwio_image *img, int c, size_t len);
+void fwio_truncate(struct fwio_image *img, size_t len);
+
+/* pointer to a range of the image if it lies within one data segment */
+void *fwio_ptr(struct fwio_image *img, size_t ofs, size_t len);
+
+/* feed a range of the image piecewise to a callback */
+typedef void (*fwio_cb_t)(void *arg, const void *data, size_t len);
+void fwio_walk(struct fwio_image *img, size_t ofs, size_t len,
+	       fwio_cb_t cb, void *arg);
+
+/* incremental checksums over a range, see crc32_update() for the crc */
+uint32_t fwio_crc32(struct fwio_image *img, uint32_t crc,
+		    size_t ofs, size_t len);
+void fwio_md5(struct fwio_image *img, MD5_CTX *ctx, size_t ofs, size_t len);
+
+/* gathered writes, returns 0 or -1 with errno set */
+int fwio_write(struct fwio_image *img, int fd);
+int fwio_write_file(struct fwio_image *img, const char *name);
+
+#endif /* _FWU_FWIO_H */
@@ -0,0 +1,118 @@
+/*
+ *  Copyright (C) 2014 OpenWrt.org
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+/*
+ * Multi-call binary for the firmware utilities. Each tool is built with
+ * its main() renamed and registered in the generated applets.h, the tool
+ * to run is selected by the name the binary is invoked as.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define ARRAY_SIZE(_a)	(sizeof((_a)) / sizeof((_a)[0]))
+
+extern char **environ;
+
+#define APPLET(_name, _main) int _main(int argc, char **argv, char **envp);
+#include "applets.h"
+#undef APPLET
+
+static const struct applet {
+	const char *name;
+	int (*main)(int argc, char **argv, char **envp);
+} applets[] = {
+#define APPLET(_name, _main) { _name, _main },
+#include "applets.h"
+#undef APPLET
+};
+
+static const char *progname = "firmware-utils";
+
+static const struct applet *find_applet(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(applets); i++)
+		if (!strcmp(applets[i].name, name))
+			return &applets[i];
+
+	return NULL;
+}
+
+static int install_links(const char *dir)
+{
+	char path[1024];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(applets); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, applets[i].name);
+
+		if (unlink(path) && errno != ENOENT) {
+			fprintf(stderr, "%s: unable to remove %s: %s\n",
+				progname, path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		if (symlink(progname, path)) {
+			fprintf(stderr, "%s: unable to link %s: %s\n",
+				progname, path, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static void usage(void)
+{
+	int i;
+
+	fprintf(stderr,
+		"Usage: %s <tool> [arguments]\n"
+		"   or: <tool> [arguments]  (invoked through a link)\n"
+		"   or: %s --install <dir>\n"
+		"\n"
+		"Tools:\n",
+		progname, progname);
+
+	for (i = 0; i < ARRAY_SIZE(applets); i++)
+		fprintf(stderr, "  %s\n", applets[i].name);
+}
+
+int main(int argc, char **argv)
+{
+	const struct applet *a;
+	const char *name;
+
+	name = strrchr(argv[0], '/');
+	name = name ? name + 1 : argv[0];
+
+	if (strcmp(name, progname)) {
+		a = find_applet(name);
+	} else if (argc == 3 && !strcmp(argv[1], "--install")) {
+		return install_links(argv[2]);
+	} else if (argc > 1) {
+		argc--;
+		argv++;
+		a = find_applet(argv[0]);
+	} else {
+		a = NULL;
+	}
+
+	if (!a) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	return a->main(argc, argv, environ);
+}
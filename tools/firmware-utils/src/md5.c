@@ -50,6 +50,21 @@
 /* forward declaration */
 static void Transform ();
 
+/* Decode little endian input bytes into len words */
+static void Decode (out, p, len)
+UINT4 *out;
+unsigned char *p;
+unsigned int len;
+{
+  unsigned int i;
+
+  for (i = 0; i < len; i++, p += 4)
+    out[i] = (((UINT4)p[3]) << 24) |
+             (((UINT4)p[2]) << 16) |
+             (((UINT4)p[1]) << 8) |
+             ((UINT4)p[0]);
+}
+
 static unsigned char PADDING[64] = {
   0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -126,7 +141,7 @@ unsigned int inLen;
 {
   UINT4 in[16];
   int mdi;
-  unsigned int i, ii;
+  unsigned int n;
 
   /* compute number of bytes mod 64 */
   mdi = (int)((mdContext->i[0] >> 3) & 0x3F);
@@ -137,17 +152,28 @@ unsigned int inLen;
   mdContext->i[0] += ((UINT4)inLen << 3);
   mdContext->i[1] += ((UINT4)inLen >> 29);
 
-  while (inLen--) {
-    /* add new character to buffer, increment mdi */
-    mdContext->in[mdi++] = *inBuf++;
+  while (inLen) {
+    /* whole blocks are transformed without copying them */
+    if (mdi == 0 && inLen >= 0x40) {
+      Decode (in, inBuf, 16);
+      Transform (mdContext->buf, in);
+      inBuf += 0x40;
+      inLen -= 0x40;
+      continue;
+    }
+
+    /* add new characters to buffer */
+    n = 0x40 - mdi;
+    if (n > inLen)
+      n = inLen;
+    memcpy (mdContext->in + mdi, inBuf, n);
+    mdi += n;
+    inBuf += n;
+    inLen -= n;
 
     /* transform if necessary */
     if (mdi == 0x40) {
-      for (i = 0, ii = 0; i < 16; i++, ii += 4)
-        in[i] = (((UINT4)mdContext->in[ii+3]) << 24) |
-                (((UINT4)mdContext->in[ii+2]) << 16) |
-                (((UINT4)mdContext->in[ii+1]) << 8) |
-                ((UINT4)mdContext->in[ii]);
+      Decode (in, mdContext->in, 16);
       Transform (mdContext->buf, in);
       mdi = 0;
     }
@@ -178,11 +204,7 @@ MD5_CTX *mdContext;
   MD5_Update (mdContext, PADDING, padLen);
 
   /* append length in bits and transform */
-  for (i = 0, ii = 0; i < 14; i++, ii += 4)
-    in[i] = (((UINT4)mdContext->in[ii+3]) << 24) |
-            (((UINT4)mdContext->in[ii+2]) << 16) |
-            (((UINT4)mdContext->in[ii+1]) << 8) |
-            ((UINT4)mdContext->in[ii]);
+  Decode (in, mdContext->in, 14);
   Transform (mdContext->buf, in);
 
   /* store buffer in digest */
@@ -28,32 +28,11 @@
 #include <netinet/in.h>
 #include <inttypes.h>
 
-#define BPB 8 /* bits/byte */
-
-static uint32_t crc32[1<<BPB];
-
-static void init_crc32()
-{
-	const uint32_t poly = ntohl(0x2083b8ed);
-	int n;
-
-	for (n = 0; n < 1<<BPB; n++) {
-		uint32_t crc = n;
-		int bit;
-
-		for (bit = 0; bit < BPB; bit++)
-			crc = (crc & 1) ? (poly ^ (crc >> 1)) : (crc >> 1);
-		crc32[n] = crc;
-	}
-}
+#include "crc32.h"
 
 static uint32_t crc32buf(unsigned char *buf, size_t len)
 {
-	uint32_t crc = 0xFFFFFFFF;
-
-	for (; len; len--, buf++)
-		crc = crc32[(uint8_t)crc ^ *buf] ^ (crc >> BPB);
-	return ~crc;
+	return ~crc32_update(~0, buf, len);
 }
 
 static void usage(const char *) __attribute__ (( __noreturn__ ));
@@ -127,7 +106,6 @@ static void appendfile(int outfd, char *path, int kernel) {
 		exit(1);
 	}
 
-	init_crc32();
 	crc = crc32buf(input_file, len);
 	fprintf(stderr, "crc32 for '%s' is %08x.\n", path, crc);
 
@@ -23,13 +23,13 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
-#include <zlib.h>
-#include <sys/mman.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
 #include "fw.h"
+#include "crc32.h"
+#include "fwio.h"
 
 typedef struct fw_layout_data {
 	char		name[PATH_MAX];
@@ -114,55 +114,53 @@ typedef struct image_info {
 	part_data_t parts[MAX_SECTIONS];
 } image_info_t;
 
-static void write_header(void* mem, const char *magic, const char* version)
+/* zlib style crc32 over a range of the image */
+static u_int32_t image_crc32(struct fwio_image* img, size_t ofs, size_t len)
+{
+	return ~fwio_crc32(img, ~0, ofs, len);
+}
+
+static int write_header(struct fwio_image* img, header_t* header,
+			const char *magic, const char* version)
 {
-	header_t* header = mem;
 	memset(header, 0, sizeof(header_t));
 
 	memcpy(header->magic, magic, MAGIC_LENGTH);
 	strncpy(header->version, version, sizeof(header->version));
-	header->crc = htonl(crc32(0L, (unsigned char *)header,
+	header->crc = htonl(~crc32_update(~0, header,
 				sizeof(header_t) - 2 * sizeof(u_int32_t)));
 	header->pad = 0L;
+
+	return fwio_add(img, header, sizeof(header_t));
 }
 
 
-static void write_signature(void* mem, u_int32_t sig_offset)
+static int write_signature(struct fwio_image* img, signature_t* sign)
 {
 	/* write signature */
-	signature_t* sign = (signature_t*)(mem + sig_offset);
 	memset(sign, 0, sizeof(signature_t));
 
 	memcpy(sign->magic, MAGIC_END, MAGIC_LENGTH);
-	sign->crc = htonl(crc32(0L,(unsigned char *)mem, sig_offset));
+	sign->crc = htonl(image_crc32(img, 0, img->len));
 	sign->pad = 0L;
+
+	return fwio_add(img, sign, sizeof(signature_t));
 }
 
-static int write_part(void* mem, part_data_t* d)
+static int write_part(struct fwio_image* img, part_t* p, part_crc_t* crc,
+		      struct fwio_file* f, part_data_t* d)
 {
-	char* addr;
-	int fd;
-	part_t* p = mem;
-	part_crc_t* crc = mem + sizeof(part_t) + d->stats.st_size;
+	size_t start = img->len;
 
-	fd = open(d->filename, O_RDONLY);
-	if (fd < 0)
-	{
-		ERROR("Failed opening file '%s'\n", d->filename);
-		return -1;
-	}
-
-	if ((addr=(char*)mmap(0, d->stats.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	if (fwio_map(f, d->filename) < 0)
 	{
 		ERROR("Failed mmaping memory for file '%s'\n", d->filename);
-		close(fd);
+		/* keep the layout, the part is left blank */
+		fwio_fill(img, 0, sizeof(part_t) + d->stats.st_size + sizeof(part_crc_t));
 		return -2;
 	}
 
-	memcpy(mem + sizeof(part_t), addr, d->stats.st_size);
-	munmap(addr, d->stats.st_size);
-
-	memset(p->name, 0, sizeof(p->name));
+	memset(p, 0, sizeof(part_t));
 	strncpy(p->magic, MAGIC_PART, MAGIC_LENGTH);
 	strncpy(p->name, d->partition_name, sizeof(p->name));
 	p->index = htonl(d->partition_index);
@@ -172,10 +170,14 @@ static int write_part(void* mem, part_data_t* d)
 	p->memaddr = htonl(d->partition_memaddr);
 	p->entryaddr = htonl(d->partition_entryaddr);
 
-	crc->crc = htonl(crc32(0L, mem, d->stats.st_size + sizeof(part_t)));
+	if (fwio_add(img, p, sizeof(part_t)) < 0 ||
+	    fwio_add(img, f->data, d->stats.st_size) < 0)
+		return -1;
+
+	crc->crc = htonl(image_crc32(img, start, d->stats.st_size + sizeof(part_t)));
 	crc->pad = 0L;
 
-	return 0;
+	return fwio_add(img, crc, sizeof(part_crc_t));
 }
 
 static void usage(const char* progname)
@@ -319,61 +321,55 @@ static int validate_image_layout(image_info_t* im)
 
 static int build_image(image_info_t* im)
 {
-	char* mem;
-	char* ptr;
-	u_int32_t mem_size;
-	FILE* f;
-	int i;
-
-	// build in-memory buffer
-	mem_size = sizeof(header_t) + sizeof(signature_t);
-	for (i = 0; i < im->part_count; ++i)
-	{
-		part_data_t* d = &im->parts[i];
-		mem_size += sizeof(part_t) + d->stats.st_size + sizeof(part_crc_t);
-	}
+	struct fwio_image img;
+	struct fwio_file files[MAX_SECTIONS];
+	part_t parts[MAX_SECTIONS];
+	part_crc_t crcs[MAX_SECTIONS];
+	header_t header;
+	signature_t sign;
+	int i, ret = 0;
+
+	// gather the image, the input files are referenced and not copied
+	fwio_init(&img);
+	memset(files, 0, sizeof(files));
 
-	mem = (char*)calloc(mem_size, 1);
-	if (mem == NULL)
+	// write header
+	if (write_header(&img, &header, im->magic, im->version) < 0)
 	{
-		ERROR("Cannot allocate memory chunk of size '%u'\n", mem_size);
+		ERROR("Cannot allocate image segments\n");
 		return -1;
 	}
-
-	// write header
-	write_header(mem, im->magic, im->version);
-	ptr = mem + sizeof(header_t);
 	// write all parts
 	for (i = 0; i < im->part_count; ++i)
 	{
 		part_data_t* d = &im->parts[i];
 		int rc;
-		if ((rc = write_part(ptr, d)) != 0)
+		if ((rc = write_part(&img, &parts[i], &crcs[i], &files[i], d)) != 0)
 		{
 			ERROR("ERROR: failed writing part %u '%s'\n", i, d->partition_name);
 		}
-		ptr += sizeof(part_t) + d->stats.st_size + sizeof(part_crc_t);
 	}
 	// write signature
-	write_signature(mem, mem_size - sizeof(signature_t));
-
-	// write in-memory buffer into file
-	if ((f = fopen(im->outputfile, "w")) == NULL)
+	if (write_signature(&img, &sign) < 0)
 	{
-		ERROR("Can not create output file: '%s'\n", im->outputfile);
-		return -10;
+		ERROR("Cannot allocate image segments\n");
+		ret = -1;
+		goto out;
 	}
 
-	if (fwrite(mem, mem_size, 1, f) != 1)
+	// write the gathered image into file
+	if (fwio_write_file(&img, im->outputfile) < 0)
 	{
-		ERROR("Could not write %d bytes into file: '%s'\n",
-				mem_size, im->outputfile);
-		return -11;
+		ERROR("Could not write %u bytes into file: '%s'\n",
+				(unsigned) img.len, im->outputfile);
+		ret = -11;
 	}
 
-	free(mem);
-	fclose(f);
-	return 0;
+out:
+	for (i = 0; i < im->part_count; ++i)
+		fwio_unmap(&files[i]);
+	fwio_free(&img);
+	return ret;
 }
 
 
@@ -26,6 +26,7 @@
 #include <netinet/in.h>
 
 #include "md5.h"
+#include "fwio.h"
 
 #define ALIGN(x,a) ({ typeof(a) __a = (a); (((x) + __a - 1) & ~(__a - 1)); })
 
@@ -115,23 +116,40 @@ struct board_info {
 	char		*layout_id;
 };
 
+struct fw_target {
+	char		*board_id;
+	char		*opt_hw_id;
+	char		*opt_hw_rev;
+	char		*layout_id;
+	char		*ofname;	/* full size image */
+	char		*sysupname;	/* image with the padding stripped */
+
+	struct board_info *board;
+	struct flash_layout *layout;
+	uint32_t	hw_id;
+	uint32_t	hw_rev;
+	uint32_t	kernel_la;
+	uint32_t	kernel_ep;
+	uint32_t	rootfs_ofs;
+	uint32_t	fw_max_len;
+};
+
+#define MAX_TARGETS	64
+
 /*
  * Globals
  */
 static char *ofname;
+static char *sysupname;
 static char *progname;
 static char *vendor = "TP-LINK Technologies";
 static char *version = "ver. 1.0";
 static char *fw_ver = "0.0.0";
 
 static char *board_id;
-static struct board_info *board;
 static char *layout_id;
-static struct flash_layout *layout;
 static char *opt_hw_id;
-static uint32_t hw_id;
 static char *opt_hw_rev;
-static uint32_t hw_rev;
 static int fw_ver_lo;
 static int fw_ver_mid;
 static int fw_ver_hi;
@@ -147,8 +165,9 @@ static int combined;
 static int strip_padding;
 static int add_jffs2_eof;
 static unsigned char jffs2_eof_mark[4] = {0xde, 0xad, 0xc0, 0xde};
-static uint32_t fw_max_len;
 static uint32_t reserved_space;
+static struct fw_target targets[MAX_TARGETS];
+static int num_targets;
 
 static struct file_info inspect_info;
 static int extract = 0;
@@ -482,6 +501,10 @@ static void usage(int status)
 "  -a <align>      align the rootfs start on an <align> bytes boundary\n"
 "  -R <offset>     overwrite rootfs offset with <offset> (hexval prefixed with 0x)\n"
 "  -o <file>       write output to the file <file>\n"
+"  -O <file>       also write the image with the padding stripped to <file>\n"
+"  -T <target>     add an image target, where <target> is\n"
+"                  <board>|<hwid>[/<hwrev>],[<layout>],[<file>][,<stripped file>]\n"
+"                  may be repeated, the kernel and rootfs are only read once\n"
 "  -s              strip padding from the end of the image\n"
 "  -j              add jffs2 end-of-filesystem markers\n"
 "  -N <vendor>     set image vendor to <vendor>\n"
@@ -549,69 +572,108 @@ static int read_to_buf(struct file_info *fdata, char *buf)
 	return ret;
 }
 
-static int check_options(void)
+static int check_target(struct fw_target *t)
 {
-	int ret;
-
-	if (inspect_info.file_name) {
-		ret = get_file_stat(&inspect_info);
-		if (ret)
-			return ret;
-
-		return 0;
-	} else if (extract) {
-		ERR("no firmware for inspection specified");
-		return -1;
-	}
-
-	if (board_id == NULL && opt_hw_id == NULL) {
+	if (t->board_id == NULL && t->opt_hw_id == NULL) {
 		ERR("either board or hardware id must be specified");
 		return -1;
 	}
 
-	if (board_id) {
-		board = find_board(board_id);
-		if (board == NULL) {
-			ERR("unknown/unsupported board id \"%s\"", board_id);
+	if (t->board_id) {
+		t->board = find_board(t->board_id);
+		if (t->board == NULL) {
+			ERR("unknown/unsupported board id \"%s\"", t->board_id);
 			return -1;
 		}
-		if (layout_id == NULL)
-			layout_id = board->layout_id;
+		if (t->layout_id == NULL)
+			t->layout_id = t->board->layout_id;
 
-		hw_id = board->hw_id;
-		hw_rev = board->hw_rev;
+		t->hw_id = t->board->hw_id;
+		t->hw_rev = t->board->hw_rev;
 	} else {
-		if (layout_id == NULL) {
+		if (t->layout_id == NULL) {
 			ERR("flash layout is not specified");
 			return -1;
 		}
-		hw_id = strtoul(opt_hw_id, NULL, 0);
+		t->hw_id = strtoul(t->opt_hw_id, NULL, 0);
 
-		if (opt_hw_rev)
-			hw_rev = strtoul(opt_hw_rev, NULL, 0);
+		if (t->opt_hw_rev)
+			t->hw_rev = strtoul(t->opt_hw_rev, NULL, 0);
 		else
-			hw_rev = 1;
+			t->hw_rev = 1;
 	}
 
-	layout = find_layout(layout_id);
-	if (layout == NULL) {
-		ERR("unknown flash layout \"%s\"", layout_id);
+	t->layout = find_layout(t->layout_id);
+	if (t->layout == NULL) {
+		ERR("unknown flash layout \"%s\"", t->layout_id);
 		return -1;
 	}
 
-	if (!kernel_la)
-		kernel_la = layout->kernel_la;
-	if (!kernel_ep)
-		kernel_ep = layout->kernel_ep;
-	if (!rootfs_ofs)
-		rootfs_ofs = layout->rootfs_ofs;
+	t->kernel_la = kernel_la ? kernel_la : t->layout->kernel_la;
+	t->kernel_ep = kernel_ep ? kernel_ep : t->layout->kernel_ep;
+	t->rootfs_ofs = rootfs_ofs ? rootfs_ofs : t->layout->rootfs_ofs;
 
-	if (reserved_space > layout->fw_max_len) {
+	if (reserved_space > t->layout->fw_max_len) {
 		ERR("reserved space is not valid");
 		return -1;
 	}
 
-	fw_max_len = layout->fw_max_len - reserved_space;
+	t->fw_max_len = t->layout->fw_max_len - reserved_space;
+
+	if (combined) {
+		if (kernel_info.file_size >
+		    t->fw_max_len - sizeof(struct fw_header)) {
+			ERR("kernel image is too big");
+			return -1;
+		}
+	} else if (rootfs_align) {
+		if (kernel_len + rootfs_info.file_size >
+		    t->fw_max_len - sizeof(struct fw_header)) {
+			ERR("images are too big");
+			return -1;
+		}
+	} else {
+		if (kernel_info.file_size >
+		    t->rootfs_ofs - sizeof(struct fw_header)) {
+			ERR("kernel image is too big");
+			return -1;
+		}
+
+		if (rootfs_info.file_size >
+		    (t->fw_max_len - t->rootfs_ofs)) {
+			ERR("rootfs image is too big");
+			return -1;
+		}
+	}
+
+	if (t->ofname == NULL && t->sysupname == NULL) {
+		ERR("no output file specified");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int check_options(void)
+{
+	int ret;
+	int i;
+
+	if (inspect_info.file_name) {
+		ret = get_file_stat(&inspect_info);
+		if (ret)
+			return ret;
+
+		return 0;
+	} else if (extract) {
+		ERR("no firmware for inspection specified");
+		return -1;
+	}
+
+	if (num_targets == 0) {
+		ERR("either board or hardware id must be specified");
+		return -1;
+	}
 
 	if (kernel_info.file_name == NULL) {
 		ERR("no kernel image specified");
@@ -624,13 +686,7 @@ static int check_options(void)
 
 	kernel_len = kernel_info.file_size;
 
-	if (combined) {
-		if (kernel_info.file_size >
-		    fw_max_len - sizeof(struct fw_header)) {
-			ERR("kernel image is too big");
-			return -1;
-		}
-	} else {
+	if (!combined) {
 		if (rootfs_info.file_name == NULL) {
 			ERR("no rootfs image specified");
 			return -1;
@@ -646,30 +702,13 @@ static int check_options(void)
 			kernel_len -= sizeof(struct fw_header);
 
 			DBG("kernel length aligned to %u", kernel_len);
-
-			if (kernel_len + rootfs_info.file_size >
-			    fw_max_len - sizeof(struct fw_header)) {
-				ERR("images are too big");
-				return -1;
-			}
-		} else {
-			if (kernel_info.file_size >
-			    rootfs_ofs - sizeof(struct fw_header)) {
-				ERR("kernel image is too big");
-				return -1;
-			}
-
-			if (rootfs_info.file_size >
-			    (fw_max_len - rootfs_ofs)) {
-				ERR("rootfs image is too big");
-				return -1;
-			}
 		}
 	}
 
-	if (ofname == NULL) {
-		ERR("no output file specified");
-		return -1;
+	for (i = 0; i < num_targets; i++) {
+		ret = check_target(&targets[i]);
+		if (ret)
+			return ret;
 	}
 
 	ret = sscanf(fw_ver, "%d.%d.%d", &fw_ver_hi, &fw_ver_mid, &fw_ver_lo);
@@ -681,7 +720,49 @@ static int check_options(void)
 	return 0;
 }
 
-static void fill_header(char *buf, int len)
+static int add_target(char *spec)
+{
+	struct fw_target *t;
+	char *id;
+
+	if (num_targets == MAX_TARGETS) {
+		ERR("too many targets");
+		return -1;
+	}
+
+	t = &targets[num_targets++];
+	if (!spec)
+		return 0;
+
+	/* <board>|<hwid>[/<hwrev>],[<layout>],[<file>][,<stripped file>] */
+	id = strsep(&spec, ",");
+	t->layout_id = strsep(&spec, ",");
+	t->ofname = strsep(&spec, ",");
+	t->sysupname = strsep(&spec, ",");
+
+	if (!id || !*id || spec) {
+		ERR("invalid target specification");
+		return -1;
+	}
+
+	if (!strncasecmp(id, "0x", 2)) {
+		t->opt_hw_id = strsep(&id, "/");
+		t->opt_hw_rev = id;
+	} else {
+		t->board_id = id;
+	}
+
+	if (t->layout_id && !*t->layout_id)
+		t->layout_id = NULL;
+	if (t->ofname && !*t->ofname)
+		t->ofname = NULL;
+	if (t->sysupname && !*t->sysupname)
+		t->sysupname = NULL;
+
+	return 0;
+}
+
+static void fill_header(struct fw_target *t, char *buf)
 {
 	struct fw_header *hdr = (struct fw_header *)buf;
 
@@ -690,39 +771,37 @@ static void fill_header(char *buf, int len)
 	hdr->version = htonl(HEADER_VERSION_V1);
 	strncpy(hdr->vendor_name, vendor, sizeof(hdr->vendor_name));
 	strncpy(hdr->fw_version, version, sizeof(hdr->fw_version));
-	hdr->hw_id = htonl(hw_id);
-	hdr->hw_rev = htonl(hw_rev);
+	hdr->hw_id = htonl(t->hw_id);
+	hdr->hw_rev = htonl(t->hw_rev);
 
 	if (boot_info.file_size == 0)
 		memcpy(hdr->md5sum1, md5salt_normal, sizeof(hdr->md5sum1));
 	else
 		memcpy(hdr->md5sum1, md5salt_boot, sizeof(hdr->md5sum1));
 
-	hdr->kernel_la = htonl(kernel_la);
-	hdr->kernel_ep = htonl(kernel_ep);
-	hdr->fw_length = htonl(layout->fw_max_len);
+	hdr->kernel_la = htonl(t->kernel_la);
+	hdr->kernel_ep = htonl(t->kernel_ep);
+	hdr->fw_length = htonl(t->layout->fw_max_len);
 	hdr->kernel_ofs = htonl(sizeof(struct fw_header));
 	hdr->kernel_len = htonl(kernel_len);
 	if (!combined) {
-		hdr->rootfs_ofs = htonl(rootfs_ofs);
+		hdr->rootfs_ofs = htonl(t->rootfs_ofs);
 		hdr->rootfs_len = htonl(rootfs_info.file_size);
 	}
 
 	hdr->ver_hi = htons(fw_ver_hi);
 	hdr->ver_mid = htons(fw_ver_mid);
 	hdr->ver_lo = htons(fw_ver_lo);
-
-	get_md5(buf, len, hdr->md5sum1);
 }
 
-static int pad_jffs2(char *buf, int currlen)
+static int pad_jffs2(struct fwio_image *img, uint32_t max_len)
 {
 	int len;
 	uint32_t pad_mask;
 
-	len = currlen;
+	len = img->len;
 	pad_mask = (64 * 1024);
-	while ((len < layout->fw_max_len) && (pad_mask != 0)) {
+	while ((len < max_len) && (pad_mask != 0)) {
 		uint32_t mask;
 		int i;
 
@@ -740,102 +819,141 @@ static int pad_jffs2(char *buf, int currlen)
 				pad_mask &= ~mask;
 		}
 
-		for (i = 0; i < sizeof(jffs2_eof_mark); i++)
-			buf[len + i] = jffs2_eof_mark[i];
+		if (fwio_fill(img, 0xff, len - img->len) ||
+		    fwio_add(img, jffs2_eof_mark, sizeof(jffs2_eof_mark)))
+			return -1;
 
 		len += sizeof(jffs2_eof_mark);
 	}
 
-	return len;
+	return 0;
 }
 
-static int write_fw(char *data, int len)
+static int write_fw(char *name, struct fwio_image *img)
 {
-	FILE *f;
 	int ret = EXIT_FAILURE;
 
-	f = fopen(ofname, "w");
-	if (f == NULL) {
-		ERRS("could not open \"%s\" for writing", ofname);
+	if (fwio_write_file(img, name)) {
+		ERRS("unable to write output file \"%s\"", name);
+		unlink(name);
 		goto out;
 	}
 
-	errno = 0;
-	fwrite(data, len, 1, f);
-	if (errno) {
-		ERRS("unable to write output file");
-		goto out_flush;
-	}
-
-	DBG("firmware file \"%s\" completed", ofname);
+	DBG("firmware file \"%s\" completed", name);
 
 	ret = EXIT_SUCCESS;
 
- out_flush:
-	fflush(f);
-	fclose(f);
-	if (ret != EXIT_SUCCESS) {
-		unlink(ofname);
-	}
  out:
 	return ret;
 }
 
-static int build_fw(void)
+/*
+ * The checksum covers the salted header followed by the image, so the
+ * stripped and the full size image of a target share the MD5 state up
+ * to the end of the stripped image.
+ */
+static int write_target(struct fw_target *t, struct fw_header *hdr,
+			struct fwio_file *kernel, struct fwio_file *rootfs)
 {
-	int buflen;
-	char *buf;
-	char *p;
+	struct fwio_image img;
+	int fw_len = t->layout->fw_max_len;
+	MD5_CTX ctx, full;
 	int ret = EXIT_FAILURE;
-	int writelen = 0;
-
-	buflen = layout->fw_max_len;
-
-	buf = malloc(buflen);
-	if (!buf) {
-		ERR("no memory for buffer\n");
-		goto out;
-	}
+	int len;
 
-	memset(buf, 0xff, buflen);
-	p = buf + sizeof(struct fw_header);
-	ret = read_to_buf(&kernel_info, p);
-	if (ret)
-		goto out_free_buf;
+	fill_header(t, (char *)hdr);
 
-	writelen = sizeof(struct fw_header) + kernel_len;
+	fwio_init(&img);
+	if (fwio_add(&img, hdr, sizeof(struct fw_header)) ||
+	    fwio_add(&img, kernel->data, kernel->size))
+		goto err;
 
 	if (!combined) {
 		if (rootfs_align)
-			p = buf + writelen;
+			len = sizeof(struct fw_header) + kernel_len;
 		else
-			p = buf + rootfs_ofs;
+			len = t->rootfs_ofs;
+
+		if (fwio_fill(&img, 0xff, len - img.len) ||
+		    fwio_add(&img, rootfs->data, rootfs->size))
+			goto err;
+
+		if (add_jffs2_eof && pad_jffs2(&img, t->layout->fw_max_len))
+			goto err;
+	}
+
+	len = img.len;
+
+	MD5_Init(&ctx);
+	fwio_md5(&img, &ctx, 0, len < fw_len ? len : fw_len);
+	full = ctx;
+
+	if (t->sysupname) {
+		if (len > fw_len)
+			fwio_md5(&img, &ctx, fw_len, len - fw_len);
+		MD5_Final(hdr->md5sum1, &ctx);
 
-		ret = read_to_buf(&rootfs_info, p);
+		ret = write_fw(t->sysupname, &img);
 		if (ret)
-			goto out_free_buf;
+			goto out;
+	}
 
-		if (rootfs_align)
-			writelen += rootfs_info.file_size;
-		else
-			writelen = rootfs_ofs + rootfs_info.file_size;
+	/* the rest of the full size image is padding, not the header */
+	if (t->ofname) {
+		if (len < fw_len) {
+			if (fwio_fill(&img, 0xff, fw_len - len))
+				goto err;
+			fwio_md5(&img, &full, len, fw_len - len);
+		} else {
+			fwio_truncate(&img, fw_len);
+		}
+		MD5_Final(hdr->md5sum1, &full);
 
-		if (add_jffs2_eof)
-			writelen = pad_jffs2(buf, writelen);
+		ret = write_fw(t->ofname, &img);
+		if (ret)
+			goto out;
 	}
 
-	if (!strip_padding)
-		writelen = buflen;
+	ret = EXIT_SUCCESS;
+	goto out;
 
-	fill_header(buf, writelen);
-	ret = write_fw(buf, writelen);
-	if (ret)
-		goto out_free_buf;
+ err:
+	ERR("no memory for image segments");
+ out:
+	fwio_free(&img);
+	return ret;
+}
+
+static int build_fw(void)
+{
+	struct fw_header hdr;
+	struct fwio_file kernel, rootfs;
+	int ret = EXIT_FAILURE;
+	int i;
+
+	memset(&rootfs, 0, sizeof(rootfs));
+
+	if (fwio_map(&kernel, kernel_info.file_name)) {
+		ERRS("could not open \"%s\" for reading", kernel_info.file_name);
+		goto out;
+	}
+
+	if (!combined && fwio_map(&rootfs, rootfs_info.file_name)) {
+		ERRS("could not open \"%s\" for reading", rootfs_info.file_name);
+		goto out_unmap;
+	}
+
+	for (i = 0; i < num_targets; i++) {
+		ret = write_target(&targets[i], &hdr, &kernel, &rootfs);
+		if (ret)
+			goto out_unmap;
+	}
 
 	ret = EXIT_SUCCESS;
 
- out_free_buf:
-	free(buf);
+ out_unmap:
+	fwio_unmap(&rootfs);
+	fwio_unmap(&kernel);
  out:
 	return ret;
 }
@@ -911,6 +1029,7 @@ static int inspect_fw(void)
 	struct fw_header *hdr;
 	uint8_t md5sum[MD5SUM_LEN];
 	struct board_info *board;
+	struct flash_layout *layout = NULL;
 	int ret = EXIT_FAILURE;
 
 	buf = malloc(inspect_info.file_size);
@@ -1063,7 +1182,7 @@ int main(int argc, char *argv[])
 	while ( 1 ) {
 		int c;
 
-		c = getopt(argc, argv, "a:B:H:E:F:L:V:N:W:ci:k:r:R:o:xX:hsjv:");
+		c = getopt(argc, argv, "a:B:H:E:F:L:V:N:W:ci:k:r:R:o:O:T:xX:hsjv:");
 		if (c == -1)
 			break;
 
@@ -1113,6 +1232,13 @@ int main(int argc, char *argv[])
 		case 'o':
 			ofname = optarg;
 			break;
+		case 'O':
+			sysupname = optarg;
+			break;
+		case 'T':
+			if (add_target(optarg))
+				goto out;
+			break;
 		case 's':
 			strip_padding = 1;
 			break;
@@ -1137,6 +1263,30 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (board_id || opt_hw_id || ofname || sysupname) {
+		struct fw_target *t;
+
+		if (strip_padding && sysupname) {
+			ERR("-O can not be used together with -s");
+			goto out;
+		}
+
+		if (add_target(NULL))
+			goto out;
+
+		t = &targets[num_targets - 1];
+		t->board_id = board_id;
+		t->opt_hw_id = opt_hw_id;
+		t->opt_hw_rev = opt_hw_rev;
+		t->layout_id = layout_id;
+		if (strip_padding) {
+			t->sysupname = ofname;
+		} else {
+			t->ofname = ofname;
+			t->sysupname = sysupname;
+		}
+	}
+
 	ret = check_options();
 	if (ret)
 		goto out;
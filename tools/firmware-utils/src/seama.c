@@ -49,6 +49,7 @@
 #include <arpa/inet.h>
 
 #include "md5.h"
+#include "fwio.h"
 #include "seama.h"
 
 #define PROGNAME			"seama"
@@ -164,24 +165,6 @@ static size_t calculate_digest(FILE * fh, size_t size, uint8_t * digest)
 	return bytes_read;
 }
 
-#define READ_BUFF_SIZE 8*1024
-static size_t copy_file(FILE * to, FILE * from)
-{
-	size_t i, fsize = 0;
-	uint8_t buf[READ_BUFF_SIZE];
-
-	while (!feof(from) && !ferror(from))
-	{
-		i = fread(buf, sizeof(uint8_t), READ_BUFF_SIZE, from);
-		if (i > 0)
-		{
-			fsize += i;
-			fwrite(buf, sizeof(uint8_t), i, to);
-		}
-	}
-	return fsize;
-}
-
 static int verify_seama(const char * fname, int msg)
 {
 	FILE * fh = NULL;
@@ -270,9 +253,8 @@ static int verify_seama(const char * fname, int msg)
 	return ret;
 }
 
-static size_t write_seama_header(FILE * fh, char * meta[], size_t msize, size_t size)
+static void fill_seama_header(seamahdr_t * shdr, char * meta[], size_t msize, size_t size)
 {
-	seamahdr_t shdr;
 	size_t i;
 	uint16_t metasize = 0;
 
@@ -283,21 +265,13 @@ static size_t write_seama_header(FILE * fh, char * meta[], size_t msize, size_t
 	verbose("SEAMA META : %d bytes\n", metasize);
 
 	/* Fill up the header, all the data endian should be network byte order. */
-	shdr.magic		= htonl(SEAMA_MAGIC);
-	shdr.reserved	= 0;
-	shdr.metasize	= htons(metasize);
-	shdr.size		= htonl(size);
-
-	/* Write the header */
-	return fwrite(&shdr, sizeof(seamahdr_t), 1, fh);
+	shdr->magic		= htonl(SEAMA_MAGIC);
+	shdr->reserved	= 0;
+	shdr->metasize	= htons(metasize);
+	shdr->size		= htonl(size);
 }
 
-static size_t write_checksum(FILE * fh, uint8_t * checksum)
-{
-	return fwrite(checksum, sizeof(uint8_t), 16, fh);
-}
-
-static size_t write_meta_data(FILE * fh, char * meta[], size_t size)
+static size_t add_meta_data(struct fwio_image * img, char * meta[], size_t size)
 {
 	size_t i,j;
 	size_t ret = 0;
@@ -305,16 +279,15 @@ static size_t write_meta_data(FILE * fh, char * meta[], size_t size)
 	for (i=0; i<size; i++)
 	{
 		verbose("SEAMA META data : %s\n", meta[i]);
-		j = fwrite(meta[i], sizeof(char), strlen(meta[i])+1, fh);
-		if (j != strlen(meta[i])+1) return 0;
+		j = strlen(meta[i])+1;
+		if (fwio_add(img, meta[i], j) < 0) return 0;
 		ret += j;
 	}
 	//+++ let meta data end on 4 alignment by siyou. 2010/3/1 03:58pm
 	j = ((ret+3)/4)*4;
-	for ( ; ret < j; ret++)
-		fwrite("", sizeof(char), 1, fh);
+	if (fwio_fill(img, 0, j - ret) < 0) return 0;
 
-	return ret;
+	return j;
 }
 
 /*******************************************************************/
@@ -326,8 +299,9 @@ static void dump_seama(const char * fname)
 
 static void seal_files(const char * file)
 {
-	FILE * fh;
-	FILE * ifh;
+	struct fwio_image img;
+	struct fwio_file ifh[MAX_IMAGE];
+	seamahdr_t shdr;
 	size_t i;
 
 	/* Each image should be seama. */
@@ -340,59 +314,59 @@ static void seal_files(const char * file)
 		}
 	}
 
-	/* Open file for write */
-	fh = fopen(file, "w+");
-	if (fh)
+	/* The header and the meta data followed by the image files */
+	fwio_init(&img);
+	fill_seama_header(&shdr, o_meta, o_msize, 0);
+	fwio_add(&img, &shdr, sizeof(shdr));
+	add_meta_data(&img, o_meta, o_msize);
+
+	for (i=0; i<o_isize; i++)
 	{
-		/* Write the header. */
-		write_seama_header(fh, o_meta, o_msize, 0);
-		write_meta_data(fh, o_meta, o_msize);
+		if (fwio_map(&ifh[i], o_images[i]) == 0)
+			fwio_add(&img, ifh[i].data, ifh[i].size);
+	}
 
-		/* Write image files */
-		for (i=0; i<o_isize; i++)
-		{
-			ifh = fopen(o_images[i], "r+");
-			if (ifh)
-			{
-				copy_file(fh, ifh);
-				fclose(ifh);
-			}
-		}
+	if (fwio_write_file(&img, file) < 0)
+		printf("Unable to write '%s'\n", file);
 
-		fclose(fh);
-	}
+	for (i=0; i<o_isize; i++) fwio_unmap(&ifh[i]);
+	fwio_free(&img);
 }
 
 static void pack_files(void)
 {
-	FILE * fh;
-	FILE * ifh;
-	size_t i, fsize;
+	struct fwio_image img;
+	struct fwio_file ifh;
+	seamahdr_t shdr;
+	MD5_CTX ctx;
+	size_t i;
 	char filename[512];
 	uint8_t digest[16];
 
 	for (i=0; i<o_isize; i++)
 	{
-		/* Open the input file. */
-		ifh = fopen(o_images[i], "r+");
-		if (ifh)
+		/* Map the input file. */
+		if (fwio_map(&ifh, o_images[i]) == 0)
 		{
-			fsize = calculate_digest(ifh, 0, digest);
-			verbose("file size (%s) : %d\n", o_images[i], fsize);
-			rewind(ifh);
+			MD5_Init(&ctx);
+			MD5_Update(&ctx, ifh.data, ifh.size);
+			MD5_Final(digest, &ctx);
+			verbose("file size (%s) : %d\n", o_images[i], ifh.size);
+
+			/* Gather the output file. */
+			fwio_init(&img);
+			fill_seama_header(&shdr, o_meta, o_msize, ifh.size);
+			fwio_add(&img, &shdr, sizeof(shdr));
+			fwio_add(&img, digest, sizeof(digest));
+			add_meta_data(&img, o_meta, o_msize);
+			fwio_add(&img, ifh.data, ifh.size);
 
-			/* Open the output file. */
 			sprintf(filename, "%s.seama", o_images[i]);
-			fh = fopen(filename, "w+");
-			if (fh)
-			{
-				write_seama_header(fh, o_meta, o_msize, fsize);
-				write_checksum(fh, digest);
-				write_meta_data(fh, o_meta, o_msize);
-				copy_file(fh, ifh);
-				fclose(fh);
-			}
-			fclose(ifh);
+			if (fwio_write_file(&img, filename) < 0)
+				printf("Unable to write '%s'\n", filename);
+
+			fwio_free(&img);
+			fwio_unmap(&ifh);
 		}
 		else
 		{